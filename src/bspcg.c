@@ -1,15 +1,15 @@
 #include <stdio.h>
 #include <unistd.h>
-#include <assert.h>
 #include <string.h>
 #include "libs/bspedupack.h"
 #include "libs/bspfuncs.h"
 #include "libs/vecio.h"
 #include "libs/paullib.h"
 #include "libs/debug.h"
-
-#define EPS (10E-12)
-#define KMAX (1500)
+#include "libs/cgsolver.h"
+#include "libs/partition.h"
+#include "libs/balance.h"
+#include "server.h"
 
 /*
  * This program takes as input:
@@ -27,12 +27,25 @@
 int P;
 
 char vfilename[STRLEN], ufilename[STRLEN], matrixfile[STRLEN];
+char socketname[STRLEN], guessfilename[STRLEN], ckptprefix[STRLEN];
+char solfilename[STRLEN], genspec[STRLEN];
+int ndefl, method, restart, ckptfreq, input, solformat, gather;
+int partmethod, parttwod; /* built-in partitioner, or partmethod < 0 */
+double balance; /* rebalance above this imbalance, or < 0 */
+double agglom;  /* agglomerate, keeping this many nz per processor, or < 0 */
+int nshift;
+double *shifts;
+
+/* the csv name of each INPUT_ mode, see vecio.h */
+const char *inputnames[] = {"serial", "parallel", "binary", "insitu"};
 
 void bspcg(){
 
-    int s, p, n, nz, i, iglob, nrows, ncols, nv, nu,
-        *ia, *ja, *rowindex, *colindex, *vindex, *uindex;
-    double *a, *v, *u, *r, time0, time1, time2;
+    int s, p, i, j;
+    gidx n, iglob, vol, maxvol;
+    double *x, **xs, time0, time1, time2;
+    cgsolver cg;
+    cgstats stats, *sstats;
 
     bsp_begin(P);
 
@@ -56,190 +69,170 @@ void bspcg(){
         getcwd(my_cwd, 1024);
         HERE("My working dir: PWD=%s\n", my_cwd);
 
-        if(!file_exists(matrixfile)) {
+        if(input == INPUT_GENERATED) {
+            // there are no files to check.
+        } else if(!file_exists(matrixfile)) {
             HERE("Matrix file doesn't exist. (%s)\n", matrixfile);
             bsp_abort("matrix doesn't exist\n");
-        }
-        if(!file_exists(vfilename)) {
+        } else if(input == INPUT_BINARY || partmethod >= 0) {
+            // the distributions are in the container, or made by us.
+        } else if(!file_exists(vfilename)) {
             HERE("V-distrib file doesn't exist. (%s)\n", vfilename);
             bsp_abort("vector v doesn't exist\n");
-        }
-        if(!file_exists(ufilename)) {
+        } else if(!file_exists(ufilename)) {
             HERE("U-distrib file doesn't exist. (%s)\n", ufilename);
             bsp_abort("vector u doesn't exist\n");
         }
+        if(guessfilename[0] != '\0' && !file_exists(guessfilename)) {
+            HERE("Initial guess file doesn't exist. (%s)\n", guessfilename);
+            bsp_abort("initial guess doesn't exist\n");
+        }
     }
     if (s==0){
         printf("CG solver\n");
         printf("   using %d processors\n",p);
     }
 
-    /* Input of sparse matrix */
-    bspinput2triple(matrixfile, p,s,&n,&nz,&ia,&ja,&a);
-    HERE("Done reading matrix file.\n");
-
-    /* Convert data structure to incremental compressed row storage */
-    triple2icrs(n,nz,ia,ja,a,&nrows,&ncols,&rowindex,&colindex);
-    HERE("Done converting to ICRS. nrows = %d, ncols = %d\n", nrows, ncols);
-    vecfreei(ja);
-
-    int *owneru, *indu;
-    /* Read vector distributions */
-    bspinputvec(p,s,ufilename,&n,&nu,&uindex, &u, &owneru, &indu);
-    HERE("Loaded distribution vec u (nu=%d).\n",nu);
-    for(i=0; i<nu; i++){
-        iglob= uindex[i];
-        HERE("original input vec %d = %lf\n", iglob, u[i]);
-    }
-    for(i=0;i<n;i++) {
-        HERE("u: global idx %d, and proc %d has it at spot %d\n", i,owneru[i],indu[i]);
-    }
-
-    int *ownerv, *indv;
-    bspinputvec(p,s,vfilename,&n,&nv,&vindex, &v, &ownerv, &indv);
-    HERE("Loaded distribution vec v (nv=%d). set to zero.\n",nv);
-    zero(nv,v);
-    for(i=0;i<n;i++) {
-        HERE("v: global idx %d, and proc %d has it at spot %d\n", i,ownerv[i],indv[i]);
-        if(ownerv[i] == s)
-            assert(i==vindex[indv[i]]); //sanity check.
+    /* Read the matrix and distributions, and initialise
+       the data structures for matrix-vector multiplications */
+    if (input == INPUT_GENERATED)
+        cgsetupgen(p,s,genspec,(partmethod < 0 ? PART_BLOCK : partmethod),parttwod,&cg);
+    else if (partmethod >= 0)
+        cgsetuppart(p,s,matrixfile,input,partmethod,parttwod,&cg);
+    else if (input == INPUT_BINARY)
+        cgsetupbin(p,s,matrixfile,&cg);
+    else
+        cgsetup(p,s,matrixfile,ufilename,vfilename,input,&cg);
+    cg.ndefl= ndefl;
+    cg.method= method;
+    if (restart > 0)
+        cg.restart= restart;
+    if (ckptprefix[0] != '\0') {
+        cg.ckpt= ckptprefix;
+        if (ckptfreq > 0)
+            cg.ckptfreq= ckptfreq;
     }
+    n= cg.n;
+    if (agglom >= 0)
+        cgagglomerate(&cg, agglom);
+    if (balance >= 0)
+        cgbalance(&cg, balance);
 
-    //if(p!=1)
-    //    assert(nv!=nu); // we want interesting testcases.
-    HERE("Loaded a %d*%d matrix, this proc has %d nz.\n", n,n,nz);
+    HERE("Loaded a %" GIDX "*%" GIDX " matrix, this proc has %d nz.\n", n,n,cg.nz);
     if(s==0)
-        printf("Loaded a %d*%d matrix, proc 0 has %d nz.\n", n,n,nz);
-
-    if (s==0){
-        HERE("Initialization for matrix-vector multiplications\n");
+        printf("Loaded a %" GIDX "*%" GIDX " matrix, proc 0 has %d nz.\n", n,n,cg.nz);
+    partvolume(p,s,cg.nrows,cg.ncols,cg.srcprocv,cg.destprocu,&vol,&maxvol);
+    if(s==0)
+        printf("Communication volume %" GIDX " words per multiplication, at most %" GIDX " on one processor.\n",
+               vol,maxvol);
+
+    if(socketname[0] != '\0') {
+        // keep the matrix around and serve solve requests.
+        cgserve(&cg, socketname);
+        cgfree(&cg);
+        bsp_end();
+        return;
     }
-    bsp_sync();
-
-    // alloc metadata arrays
-    int *srcprocv, *srcindv, *destprocu, *destindu;
 
-    srcprocv  = vecalloci(ncols);
-    srcindv   = vecalloci(ncols);
-    destprocu = vecalloci(nrows);
-    destindu  = vecalloci(nrows);
+    x = vecallocd(cg.nv);
+    if(guessfilename[0] != '\0') {
+        // warm start from a previous solution, in the v distribution.
+        bspinputdense(p,s,guessfilename,n,cg.nv,cg.vindex,x);
+        HERE("Loaded initial guess.\n");
+    }
 
     // do the heavy lifting.
     bsp_sync();
     time1= bsp_time();
 
-    int k;
-
-    k = 0; // iteration number
-
-    // initialise mv data structures for doing u <- A.v
-    bspmv_init(p,s,n,nrows,ncols,nv,nu,rowindex,colindex,vindex,uindex,
-               srcprocv,srcindv,destprocu,destindu);
-
-    r = vecallocd(nu);
-    // corresponds to:
-    // r := b - Ax,
-    // but our guess for x = 0;
-    // therefore the first time it corresponds to copying b into r
-    for(i=0; i< nu; i++) {
-        r[i] = u[i];
-    }
-
-    long double rho = bspip(p,s,nu,nu,r,uindex,r,owneru,indu);
-    long double alpha,gamma,rho_old,beta;
-    rho_old = 0; // just kills a warning.
-
-    double *pvec = vecallocd(nv);
-    double *w    = vecallocd(nu);
-
-    HERE("rho (r.r) turned out to be = %Lf\n", rho);
-    bsp_sync();
-    while ( k < KMAX &&
-            sqrt(rho) > EPS * bspip(p,s,nv,nv,v,vindex,v,ownerv,indv)) {
-        if(s==0)
-            printf("[Iteration %02d] rho  = %e\n", k+1, sqrt(rho));
-        if ( k == 0 ) {
-            // do p := r
-            copyvec(s,nu, nv,r,pvec, uindex, ownerv, indv);
-        } else {
-            beta = rho/rho_old;
-            // p:= r + beta*p
-            scalevec(nv, beta, pvec);
-            addvec(nv,pvec,vindex, nu, r, owneru, indu);
+    xs = NULL; sstats = NULL;
+    if (nshift > 0) {
+        // all shifted systems at once; x gets the first solution.
+        xs = matallocd(nshift, cg.nv);
+        sstats = malloc(nshift*sizeof(cgstats));
+        if (sstats == NULL)
+            bsp_abort("bspcg: not enough memory");
+        stats.iters = cgsolve_shifts(&cg, cg.b, nshift, shifts, xs, sstats);
+        stats.outer = 0;
+        stats.converged = 1;
+        stats.residual = 0.0;
+        for(j=0; j<nshift; j++) {
+            stats.converged = stats.converged && sstats[j].converged;
+            if (sstats[j].residual > stats.residual)
+                stats.residual = sstats[j].residual;
         }
-        // w := Ap
-        bspmv(p,s,n,nz,nrows,ncols,a,ia,srcprocv,srcindv,
-              destprocu,destindu,nv,nu,pvec,w);
-
-        // gamma = p.w
-        gamma = bspip(p,s,nv,nu,pvec,vindex,w,owneru,indu);
-
-        alpha = rho/gamma;
-
-        // x := x + alpha*p
-        local_axpy(nv,alpha,pvec,v,
-                                 v);
-
-        // r := r - alpha*w
-        local_axpy(nu,-alpha,w,r,
-                               r);
-
-        rho_old = rho;
-        // rho := ||rho||^2
-        rho = bspip(p,s,nu,nu,r,uindex,r,owneru,indu);
-
-        k++;
-
+        for(i=0; i<cg.nv; i++)
+            x[i] = xs[0][i];
+    } else {
+        bspsolve(&cg, cg.b, (guessfilename[0] != '\0' ? x : NULL), x, &stats);
     }
 
     // end heavy lifting.
 
-    // postcondition:
-    // v s.t. A.v = u
-
     bsp_sync();
     time2= bsp_time();
 
     if (s==0){
         HERE("End of matrix-vector multiplications.\n");
         printf("Initialization took only %.6lf seconds,\n", time1-time0);
-        printf("%d CG iterations took only %.6lf seconds (KMAX = %d).\n", k, (time2-time1), KMAX);
+        printf("%d CG iterations took only %.6lf seconds (KMAX = %d).\n", stats.iters, (time2-time1), cg.kmax);
         printf("The computed solution is:\n");
     }
 
-    for(i=0; i<nv; i++){
-        iglob=vindex[i];
-        HERE("FINAL ANSWER *** proc=%d v[%d]=%lf \n",s,iglob,v[i]);
+    for(i=0; i<cg.nv; i++){
+        iglob=cg.vindex[i];
+        HERE("FINAL ANSWER *** proc=%d v[%" GIDX "]=%lf \n",s,iglob,x[i]);
     }
 
-    double* answer = vecallocd(n);
-    bsp_push_reg(answer,n*SZDBL);
+    if(solfilename[0] != '\0') {
+        // every processor writes its own part of the solution.
+        bspoutputdense(p,s,solfilename,n,cg.nv,cg.vindex,x,solformat);
+        if(s==0)
+            printf("Solution written to %s\n", solfilename);
+    }
+
+    // with -G the solution is not gathered on processor 0 at all.
+    double* answer = vecallocd(gather ? n : 0);
+    bsp_push_reg(answer,(gather ? n : 0)*SZDBL);
     int* nz_per_proc = vecalloci(P);
     bsp_push_reg(nz_per_proc,P*SZINT);
 
     bsp_sync();
 
-    for(i=0; i<nv; i++){
-        iglob=vindex[i];
-        bsp_put(0, &v[i], answer, iglob*SZDBL, SZDBL);
+    for(i=0; gather && i<cg.nv; i++){
+        iglob=cg.vindex[i];
+        bsp_put(0, &x[i], answer, iglob*SZDBL, SZDBL);
     }
-    bsp_put(0, &nz, nz_per_proc, s*SZINT, SZINT);
+    bsp_put(0, &cg.nz, nz_per_proc, s*SZINT, SZINT);
     bsp_sync();
 
     if(s==0) {
 
-        int total_nz = 0;
-        for(i=0; i<p;i++)
+        gidx total_nz = 0;
+        int busy = 0;
+        for(i=0; i<p;i++) {
             total_nz += nz_per_proc[i];
+            if (nz_per_proc[i] > 0)
+                busy++;
+        }
 
         printf("========= Solution =========\n");
-        printf("Final error = %e\n\n", sqrt(rho_old));
-        printf("csv_answer_head:\tP,N,nz,time,iters,success\n");
-        printf("csv_answer_data:\t%d,%d,%d,%lf,%d,%d\n",P,n,total_nz,(time2-time1),k,k<KMAX);
+        printf("Final error = %e\n\n", stats.residual);
+        printf("csv_answer_head:\tP,N,nz,time,iters,success,method,outer,input,partition,volume,procs\n");
+        printf("csv_answer_data:\t%d,%" GIDX ",%" GIDX ",%lf,%d,%d,%s,%d,%s,%s%s,%" GIDX ",%d\n",P,n,total_nz,(time2-time1),stats.iters,stats.converged,
+               (nshift > 0 ? "multishift" : methodname(cg.method)),stats.outer,inputnames[input],
+               (partmethod >= 0 ? partnames[partmethod] : input == INPUT_GENERATED ? "block" : "file"),
+               (parttwod ? "2d" : ""),vol,busy);
+        if (nshift > 0) {
+            printf("csv_shift_head:\tP,N,shift,iters,success,residual\n");
+            for(j=0; j<nshift; j++)
+                printf("csv_shift_data:\t%d,%" GIDX ",%g,%d,%d,%e\n",P,n,shifts[j],sstats[j].iters,
+                       sstats[j].converged,sstats[j].residual);
+        }
 
 #ifdef DEBUG
-        for(i=0; i<n; i++) {
-            printf("solution[%d] = %lf\n", i, answer[i]);
+        for(iglob=0; gather && iglob<n; iglob++) {
+            printf("solution[%" GIDX "] = %lf\n", iglob, answer[iglob]);
         }
 #endif
     }
@@ -248,34 +241,210 @@ void bspcg(){
     bsp_pop_reg(nz_per_proc);
 
     vecfreed(answer);   vecfreei(nz_per_proc);
-    vecfreed(w);        vecfreed(pvec);
-    vecfreed(r);
-
-    vecfreei(destindu); vecfreei(destprocu);
-    vecfreei(srcindv);  vecfreei(srcprocv);
-    vecfreed(u);        vecfreed(v);
-    vecfreei(uindex);   vecfreei(vindex);
-    vecfreei(rowindex); vecfreei(colindex);
-    vecfreei(ia);       vecfreed(a);
+    vecfreed(x);
+    if (nshift > 0) {
+        matfreed(xs);
+        free(sstats);
+    }
+    cgfree(&cg);
     bsp_end();
 
 } /* end bspcg */
 
+/*
+ * Parse a comma separated list of shifts into the global array shifts.
+ * Returns the number of shifts, or -1 if the list is malformed.
+ */
+int parseshifts(const char *list)
+{
+    int k;
+    const char *c;
+    char *end;
+
+    k = 1;
+    for(c=list; *c != '\0'; c++)
+        if(*c == ',')
+            k++;
+    shifts = vecallocd(k);
+
+    k = 0;
+    c = list;
+    while(1) {
+        shifts[k++] = strtod(c, &end);
+        if(end == c)
+            return -1;
+        if(*end == '\0')
+            return k;
+        if(*end != ',')
+            return -1;
+        c = end+1;
+    }
+}
+
 int main(int argc, char **argv){
 
+    int c;
+
     bsp_init(bspcg, argc, argv);
     P = bsp_nprocs();
 
-    if(argc != 4){
+    socketname[0] = '\0';
+    guessfilename[0] = '\0';
+    ndefl = 0;
+    method = METHOD_CG;
+    restart = 0;
+    nshift = 0;
+    shifts = NULL;
+    ckptprefix[0] = '\0';
+    ckptfreq = 0;
+    input = INPUT_SERIAL;
+    solfilename[0] = '\0';
+    genspec[0] = '\0';
+    solformat = DENSE_TEXT;
+    gather = 1;
+    partmethod = -1;
+    parttwod = 0;
+    balance = -1.0;
+    agglom = -1.0;
+    while((c = getopt(argc, argv, "S:x:d:m:r:s:c:i:Ro:BGg:p:b:a:")) != -1) {
+        switch(c) {
+            case 'a':
+                if((agglom = atof(optarg)) < 0)
+                    argc = 0; // print usage
+                break;
+            case 'b':
+                if((balance = atof(optarg)) < 0)
+                    argc = 0; // print usage
+                break;
+            case 'p':
+                if(partbyname(optarg, &partmethod, &parttwod) < 0)
+                    argc = 0; // print usage
+                break;
+            case 'o':
+                strncpy(solfilename, optarg, STRLEN-1);
+                break;
+            case 'B':
+                solformat = DENSE_BINARY;
+                break;
+            case 'G':
+                gather = 0;
+                break;
+            case 'g':
+                strncpy(genspec, optarg, STRLEN-1);
+                break;
+            case 'R':
+                input = INPUT_PARALLEL;
+                break;
+            case 'c':
+                strncpy(ckptprefix, optarg, STRLEN-1);
+                break;
+            case 'i':
+                if((ckptfreq = atoi(optarg)) <= 0)
+                    argc = 0; // print usage
+                break;
+            case 's':
+                if((nshift = parseshifts(optarg)) <= 0)
+                    argc = 0; // print usage
+                break;
+            case 'r':
+                if((restart = atoi(optarg)) <= 0)
+                    argc = 0; // print usage
+                break;
+            case 'm':
+                if((method = methodbyname(optarg)) < 0)
+                    argc = 0; // print usage
+                break;
+            case 'd':
+                if((ndefl = atoi(optarg)) <= 0)
+                    argc = 0; // print usage
+                break;
+            case 'x':
+                strncpy(guessfilename, optarg, STRLEN-1);
+                break;
+            case 'S':
+                strncpy(socketname, optarg, STRLEN-1);
+                break;
+            default:
+                argc = 0; // print usage
+        }
+    }
+    // deflation, checkpoints and shifts are only done by plain CG.
+    if(method != METHOD_CG && (ndefl > 0 || ckptprefix[0] != '\0' || nshift > 0))
+        argc = 0; // print usage
+    if(nshift > 0 && (ndefl > 0 || ckptprefix[0] != '\0' || socketname[0] != '\0' ||
+                      guessfilename[0] != '\0'))
+        argc = 0; // print usage
+
+    if(genspec[0] != '\0' ? argc - optind != 0 :
+       partmethod >= 0 ? argc - optind != 1 : (argc - optind != 3 && argc - optind != 1)){
         fprintf(stderr, "Usage:\n");
-        fprintf(stderr, "\t%s [mtx-dist] [u-dist] [v-dist]\n\n", argv[0]);
+        fprintf(stderr, "\t%s [-S socket] [-x guess] [-d k] [-m method] [-r m] [-s shifts] [-c prefix [-i k]] [-R] [-o sol [-B]] [-G] [-a nzmin] [-b imbal] [mtx-dist] [u-dist] [v-dist]\n", argv[0]);
+        fprintf(stderr, "\t%s [options] [matrix.bin]\n", argv[0]);
+        fprintf(stderr, "\t%s [options] -p method matrix\n", argv[0]);
+        fprintf(stderr, "\t%s [options] -g family,n[,key=value]...\n\n", argv[0]);
+        fprintf(stderr, "\tmatrix.bin is a binary container made by emm2bin, holding the\n");
+        fprintf(stderr, "\tmatrix and both distributions; it is read with mmap by all processors.\n\n");
+        fprintf(stderr, "\t-g spec    generate the matrix in memory instead of reading it, as\n");
+        fprintf(stderr, "\t           genmat would: family random, poisson2d, poisson3d,\n");
+        fprintf(stderr, "\t           poisson27, aniso, banded or block, size n, and keys mu,\n");
+        fprintf(stderr, "\t           sparsity, eps, width, kappa, seed and nonsym, e.g.\n");
+        fprintf(stderr, "\t           -g poisson3d,100 or -g random,20000,mu=300,sparsity=0.01.\n");
+        fprintf(stderr, "\t           Every processor gets a block of rows, unless -p is given\n");
+        fprintf(stderr, "\t-p method  distribute the matrix ourselves, instead of reading\n");
+        fprintf(stderr, "\t           Mondriaan's distribution files: block, cyclic or graph\n");
+        fprintf(stderr, "\t           (multilevel graph partitioning), by rows, or with ,2d\n");
+        fprintf(stderr, "\t           on a grid of processors, e.g. -p graph,2d. The matrix\n");
+        fprintf(stderr, "\t           may be a plain Matrix Market file\n");
+        fprintf(stderr, "\t-a nzmin   time %d multiplications before solving, and gather\n", BALITERS);
+        fprintf(stderr, "\t           the problem onto fewer processors if that is predicted\n");
+        fprintf(stderr, "\t           to be faster, or to keep at least nzmin nonzeros per\n");
+        fprintf(stderr, "\t           processor (0: only the prediction). The others idle\n");
+        fprintf(stderr, "\t-b imbal   time %d multiplications before solving, and if the\n", BALITERS);
+        fprintf(stderr, "\t           computation of the slowest processor takes more than\n");
+        fprintf(stderr, "\t           imbal (e.g. 0.1) above the average, move rows of the\n");
+        fprintf(stderr, "\t           matrix and their vector components to faster ones\n");
+        fprintf(stderr, "\t-S socket  keep running, and serve solve requests on a Unix socket\n");
+        fprintf(stderr, "\t-x guess   start iterating from the initial guess in this vector file\n");
+        fprintf(stderr, "\t-o sol     write the solution to this vector file, every processor\n");
+        fprintf(stderr, "\t           its own part; all must be able to open it. It can be\n");
+        fprintf(stderr, "\t           given to -x of a later run\n");
+        fprintf(stderr, "\t-B         write the solution in binary rather than text\n");
+        fprintf(stderr, "\t-G         do not gather the solution on processor 0\n");
+        fprintf(stderr, "\t-d k       deflated CG: harvest k Ritz vectors per solve, and\n");
+        fprintf(stderr, "\t           project them out of later solves (useful with -S).\n");
+        fprintf(stderr, "\t           -d, -c and -s need -m cg, and -s goes with none of\n");
+        fprintf(stderr, "\t           -d, -c, -S or -x\n");
+        fprintf(stderr, "\t-m method  cg (default); mixed: single precision CG inside\n");
+        fprintf(stderr, "\t           double precision iterative refinement; for nonsymmetric\n");
+        fprintf(stderr, "\t           matrices bicgstab, or gmres: restarted GMRES(m)\n");
+        fprintf(stderr, "\t-r m       restart GMRES every m iterations (default %d)\n", GMRESRESTART);
+        fprintf(stderr, "\t-s shifts  solve (A + sigma I) x = b for a comma separated list of\n");
+        fprintf(stderr, "\t           shifts sigma at once, with multi-shift CG\n");
+        fprintf(stderr, "\t-c prefix  checkpoint CG to files prefix.*, and resume from the\n");
+        fprintf(stderr, "\t           latest checkpoint there if one exists\n");
+        fprintf(stderr, "\t-i k       checkpoint every k iterations (default %d)\n", CKPTFREQ);
+        fprintf(stderr, "\t-R         every processor reads its own part of the matrix file;\n");
+        fprintf(stderr, "\t           all must be able to open it. The byte offsets of the\n");
+        fprintf(stderr, "\t           parts are kept in mtx-dist.idx for next time\n\n");
         exit(1);
     }
 
-    strcpy(matrixfile, argv[1]);
-    strcpy(ufilename, argv[2]);
-    strcpy(vfilename, argv[3]);
+    if(genspec[0] != '\0') {
+        input = INPUT_GENERATED;
+    } else {
+        strncpy(matrixfile, argv[optind], STRLEN-1);
+        if(partmethod >= 0) {
+            // a plain matrix, distributed by us.
+        } else if(argc - optind == 1) {
+            input = INPUT_BINARY;
+        } else {
+            strncpy(ufilename, argv[optind+1], STRLEN-1);
+            strncpy(vfilename, argv[optind+2], STRLEN-1);
+        }
+    }
 
     bspcg();
+    if(shifts != NULL)
+        vecfreed(shifts);
     exit(0);
 }
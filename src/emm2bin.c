@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libs/gidx.h"
+#include "libs/vecalloc-seq.h"
+#include "libs/binio.h"
+#include "libs/zio.h"
+
+/*
+ * Convert the output of Mondriaan (a distributed matrix in EMM format,
+ * and the distribution files of u and v) into the binary container read
+ * by cg, see libs/binio.h.
+ *
+ * Usage: emm2bin matrix-P matrix-u matrix-v out.bin
+ */
+
+void die(const char *msg, const char *filename) {
+    fprintf(stderr, "emm2bin: %s %s\n", msg, filename);
+    exit(2);
+}
+
+/*
+ * Read a vector distribution file ("n p", then lines "i proc", 1-based)
+ * and encode the owners as runs. Returns the number of runs; *pruns is
+ * allocated here.
+ */
+int readruns(const char *filename, int n, int p, binrun **pruns) {
+
+    FILE *fp;
+    zfile zf;
+    int nfile, pfile, k, i, proc, nruns, maxruns;
+    binrun *runs;
+
+    if ((fp = zopen(&zf, filename)) == NULL)
+        die("cannot open", filename);
+    if (fscanf(fp, "%d %d\n", &nfile, &pfile) != 2 || nfile != n || pfile != p)
+        die("size or number of processors does not match the matrix in", filename);
+
+    maxruns = 1024;
+    runs = malloc(maxruns*sizeof(binrun));
+    nruns = 0;
+    for (k = 0; k < n; k++) {
+        if (runs == NULL)
+            die("out of memory reading", filename);
+        if (fscanf(fp, "%d %d\n", &i, &proc) != 2 || i != k+1 || proc < 1 || proc > p)
+            die("bad distribution line in", filename);
+        if (nruns > 0 && runs[nruns-1].proc == proc-1) {
+            runs[nruns-1].len++;
+            continue;
+        }
+        if (nruns == maxruns) {
+            maxruns *= 2;
+            if ((runs = realloc(runs, maxruns*sizeof(binrun))) == NULL)
+                die("out of memory reading", filename);
+        }
+        runs[nruns].len = 1;
+        runs[nruns].proc = proc-1;
+        nruns++;
+    }
+    if (zclose(&zf) != 0)
+        die("cannot decompress", filename);
+
+    *pruns = runs;
+    return nruns;
+}
+
+int main(int argc, char **argv) {
+
+    FILE *in, *out;
+    zfile zin;
+    binheader h;
+    binrun *runs_u, *runs_v;
+    int64_t *Pstart;
+    gidx m, n, nz, start;
+    int p, q, k, nzq, maxnzq, c, *ia, *ja;
+    double *a;
+
+    if (argc != 5) {
+        printf("Usage: %s matrix-P matrix-u matrix-v out.bin\n", argv[0]);
+        printf("\tconverts a matrix distributed by Mondriaan, and the distributions\n");
+        printf("\tof u and v, into a binary file that cg reads with mmap.\n");
+        exit(-1);
+    }
+
+    if ((in = zopen(&zin, argv[1])) == NULL)
+        die("cannot open", argv[1]);
+
+    // get rid of first line, the Mondriaan header:
+    while ((c = fgetc(in)) != '\n' && c != EOF)
+        ;
+    if (fscanf(in, "%" SCNGIDX " %" SCNGIDX " %" SCNGIDX " %d\n", &m, &n, &nz, &p) != 4 || m != n)
+        die("cannot read the header of a square matrix from", argv[1]);
+    if (n > INT32_MAX)
+        die("the binary format has 32-bit indices, too few for", argv[1]);
+
+    Pstart = malloc((p+1)*sizeof(int64_t));
+    maxnzq = 0;
+    for (q = 0; q <= p; q++) {
+        if (fscanf(in, "%" SCNGIDX "\n", &start) != 1)
+            die("cannot read Pstart from", argv[1]);
+        Pstart[q] = start;
+        if (q > 0 && Pstart[q]-Pstart[q-1] > INT_MAX)
+            die("more than 2^31-1 nonzeros for one processor in", argv[1]);
+        if (q > 0 && Pstart[q]-Pstart[q-1] > maxnzq)
+            maxnzq = Pstart[q]-Pstart[q-1];
+    }
+    if (Pstart[0] != 0 || Pstart[p] != nz)
+        die("Pstart does not cover all nonzeros in", argv[1]);
+
+    if ((out = fopen(argv[4], "wb")) == NULL)
+        die("cannot write", argv[4]);
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, BINMAGIC, 8);
+    h.version = BINVERSION;
+    h.p = p;
+    h.n = n;
+    h.nz = nz;
+    h.offpstart = sizeof(binheader);
+    h.offblocks = h.offpstart + (p+1)*sizeof(int64_t);
+    h.offblocks = (h.offblocks + 15)/16*16;
+    h.offu = h.offblocks + (int64_t)BINRECORD*nz;
+
+    // the header is written again at the end, when it is complete.
+    fwrite(&h, sizeof(binheader), 1, out);
+    fwrite(Pstart, sizeof(int64_t), p+1, out);
+    fseek(out, h.offblocks, SEEK_SET);
+
+    // one processor block at a time
+    a  = vecallocd(maxnzq);
+    ia = vecalloci(maxnzq);
+    ja = vecalloci(maxnzq);
+    for (q = 0; q < p; q++) {
+        nzq = Pstart[q+1]-Pstart[q];
+        for (k = 0; k < nzq; k++) {
+            if (fscanf(in, "%d %d %lf\n", &ia[k], &ja[k], &a[k]) != 3)
+                die("cannot read all nonzeros from", argv[1]);
+            ia[k]--;
+            ja[k]--;
+            if (ia[k] < 0 || ia[k] >= n || ja[k] < 0 || ja[k] >= n)
+                die("index out of range in", argv[1]);
+        }
+        fwrite(a, sizeof(double), nzq, out);
+        fwrite(ia, sizeof(int32_t), nzq, out);
+        fwrite(ja, sizeof(int32_t), nzq, out);
+    }
+    if (zclose(&zin) != 0)
+        die("cannot decompress", argv[1]);
+    vecfreed(a); vecfreei(ia); vecfreei(ja);
+
+    h.nruns_u = readruns(argv[2], n, p, &runs_u);
+    h.nruns_v = readruns(argv[3], n, p, &runs_v);
+    h.offv = h.offu + h.nruns_u*sizeof(binrun);
+    fwrite(runs_u, sizeof(binrun), h.nruns_u, out);
+    fwrite(runs_v, sizeof(binrun), h.nruns_v, out);
+
+    fseek(out, 0, SEEK_SET);
+    fwrite(&h, sizeof(binheader), 1, out);
+    if (fclose(out) != 0)
+        die("error writing", argv[4]);
+
+    printf("%s: %" GIDX " x %" GIDX ", %" GIDX " nonzeros on %d processors, %d+%d ownership runs\n",
+           argv[4], n, n, nz, p, h.nruns_u, h.nruns_v);
+
+    free(runs_u); free(runs_v);
+    free(Pstart);
+    return 0;
+}
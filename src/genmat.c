@@ -2,456 +2,353 @@
 #include "libs/vecalloc-seq.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
 #include <math.h>
-#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "genmat.h"
 #include "libs/paulbool.h"
 #include "libs/paullib.h"
-
-int N;
-double sparsity;
-
-#define SZCHAR (sizeof(char))
+#include "libs/zio.h"
 
 int main (int argc, char** argv) {
 
+    genparams g;
+    const char *suffix; // "", ".gz" or ".zst": compression of the output
+    bool mathematica;
+    int nthreads;
+    char msg[256];
+
     // aim for a nonzero density given by sparsity:
-    sparsity = 0.2; // nz = sparsity*100% of the size of the matrix
+    gendefaults(&g, GEN_RANDOM); // nz = sparsity*100% of the size of the matrix
 
     /*
-     * we say 'aim' here, since of course initially exactly
-     *    nz = sparsity * N^2
-     * nonzeroes will be generated at random spots, but because
-     * the matrix must be symmetric and diagonally positive, the
-     * actual number of nonzeroes will probably not be exactly
-     * the projected number.
+     * we say 'aim' here, since nonzeroes are generated at random
+     * spots, with on average 1/sparsity positions between them, so
+     * the actual number of nonzeroes will not be exactly
+     *    nz = sparsity * N^2.
+     * For a symmetric matrix only the lower triangle is drawn, and
+     * mirrored. The diagonal is always present, and mu is added to it
+     * to make the matrix diagonally dominant.
+     *
+     * With -n the lower and upper triangle are generated independently,
+     * giving a nonsymmetric (but still diagonally dominant) matrix.
+     *
+     * The matrix only depends on N, mu, sparsity and the seed (-s), not
+     * on the number of threads (-t).
+     *
+     * With -z gz or -z zst the matrix file is written compressed. With
+     * -m a Mathematica notebook is written as well, to check the
+     * matrix and solve the system.
+     *
+     * With -f another family of matrices is generated (see genmat.h),
+     * for benchmarks that need more iterations or more communication
+     * than the random matrices give. For the stencils N is the number
+     * of grid points per dimension, and mu (default 0) a shift of the
+     * diagonal; -k chooses that shift to give a condition number. For
+     * the banded and block matrices the diagonal is the sum of the
+     * absolute values in the row plus mu (default 1).
      */
+    mathematica = false;
+    nthreads = genthreads();
+    suffix = "";
+    int c;
+    while((c = getopt(argc, argv, "a:b:f:k:nms:t:z:")) != -1) {
+        if(c == 'a') {
+            if(sscanf(optarg, "%lf", &g.eps) != 1)
+                argc = 0;
+        } else if(c == 'b') {
+            if(sscanf(optarg, "%" SCNGIDX, &g.width) != 1)
+                argc = 0;
+        } else if(c == 'f') {
+            for(g.family = 0; g.family < NGENFAMILIES; g.family++)
+                if(strcmp(optarg, genfamilies[g.family]) == 0)
+                    break;
+            if(g.family == NGENFAMILIES)
+                argc = 0;
+        } else if(c == 'k') {
+            if(sscanf(optarg, "%lf", &g.kappa) != 1)
+                argc = 0;
+        } else if(c == 'n')
+            g.symmetric = false;
+        else if(c == 'm')
+            mathematica = true;
+        else if(c == 's') {
+            if(sscanf(optarg, "%llu", &g.seed) != 1)
+                argc = 0;
+        } else if(c == 't') {
+            if(sscanf(optarg, "%d", &nthreads) != 1 ||
+               nthreads < 1 || nthreads > GENMAXTHREADS)
+                argc = 0;
+        } else if(c == 'z' && strcmp(optarg, "gz") == 0)
+            suffix = ".gz";
+        else if(c == 'z' && strcmp(optarg, "zst") == 0)
+            suffix = ".zst";
+        else
+            argc = 0; // print usage
+    }
+    argc -= optind-1;
+    argv += optind-1;
 
     // read the desired size of the matrix from command line
     if (argc < 2) {
-        printf("Usage: %s N [mu] [sparsity]\n", argv[0]);
+        printf("Usage: %s [-f family] [-a eps] [-b width] [-k kappa] [-n] [-m] [-s seed]\n"
+               "       [-t threads] [-z gz|zst] N [mu] [sparsity]\n", argv[0]);
+        printf("\t-f  random (default), poisson2d, poisson3d, poisson27, aniso, banded\n"
+               "\t    or block; for the stencils N is the grid size per dimension\n");
+        printf("\t-a  anisotropy of aniso, default %g\n", GENEPS);
+        printf("\t-b  half-width of banded, or block size of block, default %d\n", GENWIDTH);
+        printf("\t-k  shift the diagonal of a stencil to get condition number kappa\n");
+        printf("\t-n  nonsymmetric: generate both triangles independently\n");
+        printf("\t-m  also write a Mathematica notebook\n");
+        printf("\t-s  seed of the random generator, default %d\n", GENSEED);
+        printf("\t-t  number of threads, default $CG_THREADS or all processors\n");
+        printf("\t-z  compress the matrix file with gzip or zstd\n");
         exit(-1);
     }
 
-    if(sscanf(argv[1], "%d", &N) != 1) {
-        printf("couldn't read command-line argument for N. must be an integer.\n");
+    if(sscanf(argv[1], "%" SCNGIDX, &g.n) != 1 || g.n < 1) {
+        printf("couldn't read command-line argument for N. must be a positive integer.\n");
         exit(-2);
     }
-    double mu;
-    mu = 2.5; //default scalar for making matrix diagonal-dominant
+    g.mu = gendefaultmu(g.family); //default scalar for making matrix diagonal-dominant
 
     // maybe the user supplied a different mu
-    if(argc > 2 && sscanf(argv[2], "%lf", &mu) != 1) {
+    if(argc > 2 && sscanf(argv[2], "%lf", &g.mu) != 1) {
         exit(-2);
     }
     // maybe the user supplied a different sparsity
-    if(argc > 3 && sscanf(argv[3], "%lf", &sparsity) != 1) {
+    if(argc > 3 && sscanf(argv[3], "%lf", &g.sparsity) != 1) {
         exit(-2);
     }
 
-    int nz = sparsity*N*N;
-    int* xs;
-    int* ys;
-    double* vals;
-
-    fprintf(stderr,"Generating matrix. N=%d, density=%lf, target nz=%d, ",
-            N, sparsity, nz);
-    fprintf(stderr, "mu = %lf\n", mu);
-
-    // seed the random generator.
-    srandom((unsigned)time(NULL));
-
-    xs = vecalloci(nz);
-    ys = vecalloci(nz);
-    vals = vecallocd(nz);
-
-    bool* diag_done;
-    diag_done = malloc(N*sizeof(bool));
-
-    int i;
-    for(i = 0; i<N; i++) {
-        diag_done[i] = false;
+    if(gencheck(&g, msg, sizeof(msg)) != 0) {
+        printf("%s.\n", msg);
+        exit(-2);
+    }
+    fprintf(stderr, "Generating ");
+    gendescribe(stderr, &g);
+    fprintf(stderr, ", %d thread(s)\n", nthreads);
+
+    genblock blocks[GENMAXTHREADS];
+    int t, nb;
+    for(t = 0; t < nthreads; t++) {
+        memset(&blocks[t], 0, sizeof(genblock));
+        blocks[t].g = &g;
+        blocks[t].mathematica = mathematica;
+        blocks[t].rowsum = vecallocd(GENTILE);
+        blocks[t].diag = vecallocd(GENTILE);
     }
 
-    int nz_generated;
-
-    int x,y;
-    nz_generated = 0;
-    double fake_transpose;
-    x=0;y=0;
-    while(x<N && y<N) { //don't escape matrix bounds.
-
-        if (nz_generated % 1000000 == 0) {
-            fprintf(stderr,"progress: %f%%\r", (double)nz_generated/(double)(nz/2.0)*100.0);
+    // first pass: count the nonzeros, as the header needs their number
+    // before any of them, and check the diagonal dominance before
+    // writing anything. A round generates one block per thread.
+    gidx nz = 0;
+    gidx first;
+    for(first = 0; first < g.ntiles; first += nthreads) {
+        nb = MIN(nthreads, g.ntiles - first);
+        for(t = 0; t < nb; t++) {
+            blocks[t].lo = (first + t) * GENTILE;
+            blocks[t].hi = MIN(blocks[t].lo + GENTILE, g.N);
+            blocks[t].mode = GENCOUNT;
         }
-        if(x==y) {
-            //diagonal, so always generate.
-
-            xs[nz_generated]=x;
-            ys[nz_generated]=y;
-            vals[nz_generated]=ran()*2.0-1.0;
-            diag_done[x] = true;
-
-#ifdef DEBUG
-            fprintf(stderr,"generated A[//][%d]=%lf\n"
-                                                      , ys[nz_generated]
-                                                      , vals[nz_generated]);
-#endif
-
-            nz_generated++;
-
-        } else {
-            // not a diagonal. only add if in
-            // lower triangular half
-            if(x<y) {
-
-                if(nz_generated > nz) {
-                    // this should NEVER happen, although all that's
-                    // stopping it from happening is our ran() being
-                    // well-behaved...........
-                    printf("EEK! something went wrong!!\n");
-                    exit(666);
-                }
-
-                xs[nz_generated]= x;
-                ys[nz_generated]= y;
-                // simulate the distribution of values which
-                // would occur if we do A+A^T afterwards.
-                if (ran() < sparsity) {
-                    fake_transpose    = ran()*2.0-1.0;
-                    vals[nz_generated]= ran()*2.0-1.0 + fake_transpose;
-                } else {
-                    vals[nz_generated]= ran()*2.0-1.0;
-                }
-#ifdef DEBUG
-            fprintf(stderr,"generated A[%d][%d]=%lf\n", xs[nz_generated]
-                                                      , ys[nz_generated]
-                                                      , vals[nz_generated]);
-#endif
-                nz_generated++;
-
-
+        genround(blocks, nb);
+        for(t = 0; t < nb; t++) {
+            genblock *b = &blocks[t];
+            if(b->bad >= 0) {
+                fprintf(stderr, "\nPROBLEM: diagonal > rowtotal doesn't hold: \n"
+                                "    diagonals[%" GIDX "] = %lf\n"
+                                "    rowtotal[%" GIDX "]  = %lf\n",
+                                b->bad, fabs(b->diag[b->bad - b->lo]),
+                                b->bad, b->rowsum[b->bad - b->lo]);
+                fprintf(stderr, "increase mu? or try another seed.\n");
+                exit(5);
             }
+            nz += b->nz;
         }
-        x += 1/sparsity * (ran() + 0.5);
-        if( x >= N ) {
-            y += x/N;
-            x  = x%N;
-        }
-
-    }
-
-    fprintf(stderr, "generated initial randoms\n");
-
-    int diagonals_present = 0;
-    for(i=0; i<nz_generated; i++) {
-        if(xs[i]==ys[i])
-            diagonals_present++;
-    }
-
-    fprintf(stderr,"generated %d nzeros, array was %d big.\n", nz_generated, nz);
-
-
-#ifdef DEBUG
-    fprintf(stderr, "found %d diagonal(s), still need %d more.\n", diagonals_present, (N-diagonals_present));
-#endif
-
-    // add the missing diagonals, and add mu to each diagonal.
-    int newsize = nz_generated + (N - diagonals_present);
-    fprintf(stderr,"reallocating values array to %lluM \n", (unsigned long long)(SZDBL+2*SZINT)*newsize/1048576);
-    int* diag_i;
-    int* diag_j;
-    double* diag_val;
-
-    diag_i   = realloc(xs  ,SZINT*newsize);
-    diag_j   = realloc(ys  ,SZINT*newsize);
-    diag_val = realloc(vals,SZDBL*newsize);
-
-    if(diag_i == NULL ||
-            diag_j == NULL ||
-            diag_val == NULL)
-    {
-        printf("out of memory!");
-        exit(44);
-    }
-
-    addDiagonal(mu, diag_i, diag_j, diag_val, nz_generated, newsize, diag_done);
-    nz_generated=newsize;
-#ifdef DEBUG
-    for(i=0;i<newsize;i++) {
-        fprintf(stderr,"after addDiagonal A[%d][%d]=%lf\n", diag_i[i],diag_j[i], diag_val[i]);
-    }
-
-    fprintf(stderr, "Going to make symmetric now... (nz_generated = %d)\n", nz_generated);
-#endif
-
-    // now we explicitly fill the array with the
-    // upper triangle values
-
-    // things must be symmetric, but they aren't, yet
-    // ... here's a good place to do the transposing thing.
-
-    newsize = nz_generated * 2 - N; //number of real nonzeros, don't
-                                    // count diagonals twice.
-    int *new_i;
-    int *new_j;
-    double *new_v;
-
-    new_i = realloc(diag_i  ,SZINT*newsize);
-    new_j = realloc(diag_j  ,SZINT*newsize);
-    new_v = realloc(diag_val,SZDBL*newsize);
-
-    if(new_i == NULL ||
-            new_i == NULL ||
-            new_v == NULL)
-    {
-        printf("out of memory (2)!");
-        exit(44);
+        fprintf(stderr, "counting: %f%%\r", 100.0*(first + nb)/g.ntiles);
     }
-    diag_i = new_i;
-    diag_j = new_j;
-    diag_val = new_v;
-    addTranspose(newsize,diag_i,diag_j,diag_val,
-                              nz_generated);
-
-#ifdef DEBUG
-    for(i=0;i<newsize;i++)
-        // to make diags stand out.
-        if(diag_i[i]==diag_j[i])
-            fprintf(stderr,"after transpose A[%d][%d]=%lf \\\\\n", diag_i[i],diag_j[i], diag_val[i]);
-        else
-            fprintf(stderr,"after transpose A[%d][%d]=%lf\n", diag_i[i],diag_j[i], diag_val[i]);
-#endif
-
-    checkStrictDiagonallyDominant(diag_i,diag_j,diag_val, newsize);
-
-    // now quickly generate a test-vector to solve against:
-
-    double *vec = vecallocd(N);
-    for(i=0;i<N;i++)
-        vec[i]=ran();
+    fprintf(stderr, "\n");
 
-    fprintf(stderr,"Left with %d nonzeroes; nonzero density = %lf (desired=%lf)\n", newsize, newsize/((double)N*N), sparsity);
+    fprintf(stderr,"Left with %" GIDX " nonzeroes; nonzero density = %lf", nz, nz/((double)g.N*g.N));
+    if(g.family == GEN_RANDOM)
+        fprintf(stderr, " (desired=%lf)", g.sparsity);
+    fprintf(stderr, "\n");
     fprintf(stderr,"========== OUTPUTTING ... ==========\n");
 
-    outputMondriaanMatrix(newsize, diag_i, diag_j, diag_val, vec);
-    outputMathematicaMatrix(newsize, diag_i, diag_j, diag_val, vec);
-
-    free(diag_done);
-    free(vec);
-    free(diag_i);
-    free(diag_j);
-    free(diag_val);
-
-    return 0;
-}
-
-void addDiagonal(double mu, int* i, int* j, double* v, int nz_generated, int newsize, bool* diags_done) {
-
-    int c;
-    int pos = nz_generated;
-    for(c=0; c<N; c++) {
-        if(!diags_done[c]){
-
-            i[pos] = c;
-            j[pos] = c;
-            v[pos] = ran()*2.0-1.0;
-
-            pos++;
-
-
-        }
-
+    // second pass: generate the same blocks again, and write them in order
+    char filename[1024];
+    char nbname[1024];
+    FILE *fp;
+    FILE *nbfp = NULL;
+    zfile zf;
+
+    char stem[900];
+    genname(stem, &g);
+    sprintf(filename,"linsys-%s.emm%s", stem, suffix);
+    fprintf(stderr,"%s\n", filename);
+    fp = zcreate(&zf, filename, ZIOLEVEL);
+    if(fp == NULL) {
+        fprintf(stderr, "cannot write %s\n", filename);
+        exit(3);
     }
-    // now add mu to each diagonal value.
-
-    for(c=0;c<newsize; c++) {
-
-        if(i[c]==j[c]) {
-            v[c] += mu;
-
+    //header:
+    fprintf(fp, "%%%%Extended-MatrixMarket matrix coordinate double general original\n");
+    //size line: m n nz
+    fprintf(fp, "%" GIDX " %" GIDX " %" GIDX "\n", g.N, g.N, nz);
+
+    if(mathematica) {
+        sprintf(nbname, "mat-check-%s.nb", stem);
+        fprintf(stderr,"%s\n", nbname);
+        nbfp = fopen(nbname, "w");
+        if(nbfp == NULL) {
+            fprintf(stderr, "cannot write %s\n", nbname);
+            exit(3);
         }
-
+        fprintf(nbfp,"Print[\"reading matrix...\"]\n");
+        fprintf(nbfp,"somemat = SparseArray[ { \n");
     }
 
-
-}
-
-/**
- * This function takes some matrix A and produces (almost) A' = A + A^T, which is
- * a symmetric matrix. Note that the diagonals are not added.
- *
- */
-void addTranspose(int final_size, int* i, int* j, double* v,
-                 int nz_generated) {
-
-    int pos = nz_generated;
-
-    int c;
-    for(c=0;c<nz_generated;c++) {
-
-        if(i[c] != j[c]) {
-            // not a diagonal, so copy over.
-
-            i[pos] = j[c];
-            j[pos] = i[c];
-            v[pos] = v[c];
-
-            pos++;
-
+    gidx written = 0;
+    bool firstrule = true;
+    for(first = 0; first < g.ntiles; first += nthreads) {
+        nb = MIN(nthreads, g.ntiles - first);
+        for(t = 0; t < nb; t++) {
+            blocks[t].lo = (first + t) * GENTILE;
+            blocks[t].hi = MIN(blocks[t].lo + GENTILE, g.N);
+            blocks[t].mode = GENTEXT;
         }
+        genround(blocks, nb);
+        for(t = 0; t < nb; t++) {
+            writeblock(fp, nbfp, &blocks[t], &firstrule);
+            written += blocks[t].nz;
+        }
+        fprintf(stderr, "writing: %f%%\r", 100.0*(first + nb)/g.ntiles);
     }
+    fprintf(stderr, "\n");
 
-}
-
-
-void checkStrictDiagonallyDominant(int* i, int* j, double* v, int nz)
-{
-
-    // steps:
-    // first sum all rows
-    // then find diagonals
-    // check each diagonal against the summed rows.
-
-    int c;
-    double * rowtotal;
-    rowtotal = vecallocd(N);
-    double * diagonals;
-    diagonals = vecallocd(N);
-
-    for(c = 0; c< N; c++)
-    {
-        rowtotal[c] = 0;
-        diagonals[c] = 0;
+    if(written != nz) {
+        // both passes generate the same matrix, so this should NEVER happen
+        printf("EEK! something went wrong!!\n");
+        exit(666);
     }
 
-    for(c = 0; c< nz; c++)
-    {
-        // find diagonals:
-        if(i[c] == j[c]){
-            diagonals[i[c]] = v[c];
-        } else {
-            rowtotal[i[c]] += fabs(v[c]);
-        }
-
+    // ...and now for the vector-to-be-solved-for:
+    unsigned long long vecseed = genstream(&g, 1);
+    gidx i;
+    fprintf(fp, "%%%%b vector double general array original\n");
+    //size line:
+    fprintf(fp, "%" GIDX "\n", g.N);
+    for(i=0;i<g.N;i++) {
+        fprintf(fp, "%lf\n", ranindex(vecseed, i));
     }
 
-    // foreach diag, check.
-    for(c=0; c<N; c++) {
-
-        if ( !(fabs(diagonals[c]) > rowtotal[c]) ) {
-            fprintf(stderr, "PROBLEM: diagonal > rowtotal doesn't hold: \n"
-                            "    diagonals[%d] = %lf\n"
-                            "    rowtotal[%d]  = %lf\n",
-                            c, fabs(diagonals[c]),
-                            c, rowtotal[c]
-                   );
-            fprintf(stderr, "increase mu? sometimes just running again is enough.\n");
-            exit(5);
-        }
-
+    if(zclose(&zf) != 0) {
+        fprintf(stderr, "error writing %s\n", filename);
+        exit(3);
     }
 
-    free(rowtotal);
-    free(diagonals);
-
-}
-
-void outputMathematicaMatrix(int nz, int*i, int*j, double*v, double*vec) {
-
-    // here we'll print the matrix in Mathematica format
-    FILE *fp;
+    if(mathematica) {
+        fprintf(nbfp,"\n} ] ;\n");
+        fprintf(nbfp,"(* somemat // MatrixForm *)\n");
 
-    char* filename = malloc(SZCHAR*1024);
+        fprintf(nbfp,"\n\n\n");
 
-    sprintf(filename, "mat-check-%d-%f.nb", N, sparsity);
-    fprintf(stderr,"%s\t", filename);
-    fp = fopen(filename, "w");
+        fprintf(nbfp,"(* ======= vector v follows ====== *)\n");
 
-    fprintf(fp,"Print[\"reading matrix...\"]\n");
-    fprintf(fp,"somemat = SparseArray[ { \n");
-    // the value lines: i j value:
-    int c;
-    for(c=0;c<nz-1;c++) {
+        fprintf(nbfp,"Print[\"reading vector...\"]\n");
+        fprintf(nbfp,"vec = {\n");
+        // N vector entries, in order of the vector indices.
+        for(i=0;i<g.N-1;i++) {
+            fprintf(nbfp,"%lf,\n", ranindex(vecseed, i));
+        }
+        // last line without comma.
+        fprintf(nbfp,"%lf\n};\n(* vec // MatrixForm *)\n", ranindex(vecseed, g.N-1));
 
-        //progress indicator
-        if((c % (nz/10) )==0)
-            fprintf(stderr, ".");
-        fprintf(fp,"{%d, %d} -> %lf,\n", i[c]+1, j[c]+1, v[c]); // Mathematica expects 1-based coordinates.
+        // and finally, for the paranoid:
+        if(g.symmetric) {
+            fprintf(nbfp,"Print[\"checking PosDef then Symm...\"]\n");
+            fprintf(nbfp,"\n\nPositiveDefiniteMatrixQ[somemat]\n\nSymmetricMatrixQ[somemat]\n");
+        }
+        fprintf(nbfp,"(* correctAnswer = LinearSolve[somemat,vec]; *)\n");
+        fprintf(nbfp,"(* correctAnswer // MatrixForm *)\n");
 
+        if(fclose(nbfp) != 0) {
+            fprintf(stderr, "error writing %s\n", nbname);
+            exit(3);
+        }
     }
-    fprintf(fp,"{%d, %d} -> %lf\n", i[nz-1]+1, j[nz-1]+1, v[nz-1]); // Mathematica expects 1-based coordinates.
-    fprintf(stderr, "\n");
-
-    fprintf(fp,"} ] ;\n");
-    fprintf(fp,"(* somemat // MatrixForm *)\n");
-
-    fprintf(fp,"\n\n\n");
-
-    fprintf(fp,"(* ======= vector v follows ====== *)\n");
 
-
-    fprintf(fp,"Print[\"reading vector...\"]\n");
-    fprintf(fp,"vec = {\n");
-    // N vector entries, one proc.
-    for(c=0;c<N-1;c++) {
-        // each line is a value, in order of the vector indices.
-        fprintf(fp,"%lf,\n", vec[c]);
+    for(t = 0; t < nthreads; t++) {
+        vecfreed(blocks[t].rowsum);
+        vecfreed(blocks[t].diag);
+        free(blocks[t].buf);
+        free(blocks[t].nb);
     }
-    // last line without comma.
-    fprintf(fp,"%lf\n};\n(* vec // MatrixForm *)\n", vec[N-1]);
-
-    // and finally, for the paranoid:
-    fprintf(fp,"Print[\"checking PosDef then Symm...\"]\n");
-    fprintf(fp,"\n\nPositiveDefiniteMatrixQ[somemat]\n\nSymmetricMatrixQ[somemat]\n");
-    fprintf(fp,"(* correctAnswer = LinearSolve[somemat,vec]; *)\n");
-    fprintf(fp,"(* correctAnswer // MatrixForm *)\n");
-
-    free(filename);
-    fclose(fp);
 
+    return 0;
 }
-void outputMondriaanMatrix(int nz, int*i, int*j, double*v, double*vec) {
 
-    // here we'll print the matrix in EMM format.
-
-    FILE* fp;
-
-    char* filename = malloc(SZCHAR*1024);
-    sprintf(filename,"linsys-%d-%f.emm", N, sparsity);
+/*
+ * Number of generator threads: the environment variable CG_THREADS, as
+ * for the parser in cg, or else the number of processors online.
+ */
+int genthreads(void) {
+
+    char *env;
+    long t;
+
+    env = getenv("CG_THREADS");
+    if(env != NULL)
+        t = atol(env);
+    else
+        t = sysconf(_SC_NPROCESSORS_ONLN);
+    if(t < 1)
+        t = 1;
+    if(t > GENMAXTHREADS)
+        t = GENMAXTHREADS;
+    return (int)t;
 
-    fprintf(stderr,"%s\t", filename);
+}
 
-    fp = fopen(filename,"w");
-    //header:
-    fprintf(fp, "%%%%Extended-MatrixMarket matrix coordinate double general original\n");
-    //size line: m n nz
-    fprintf(fp, "%d %d %d\n", N, N, nz);
+/*
+ * The file name of the matrix, between "linsys-" and the extension.
+ */
+void genname(char *stem, const genparams *g) {
+
+    const char *nonsym = g->symmetric ? "" : "-nonsym";
+
+    if(g->family == GEN_RANDOM)
+        sprintf(stem, "%" GIDX "-%f%s", g->N, g->sparsity, nonsym);
+    else if(g->family == GEN_ANISO)
+        sprintf(stem, "%s-%" GIDX "-%g", genfamilies[g->family], g->n, g->eps);
+    else if(g->family == GEN_BANDED || g->family == GEN_BLOCK)
+        sprintf(stem, "%s-%" GIDX "-%" GIDX "%s", genfamilies[g->family], g->N, g->width, nonsym);
+    else
+        sprintf(stem, "%s-%" GIDX, genfamilies[g->family], g->n);
+    if(g->kappa > 0.0)
+        sprintf(stem + strlen(stem), "-k%g", g->kappa);
+    else if(g->family != GEN_RANDOM && g->mu != gendefaultmu(g->family))
+        sprintf(stem + strlen(stem), "-mu%g", g->mu);
 
-    // next the value lines: i j v,
-    int c;
-    for(c=0;c<nz;c++) {
+}
 
-        //progress indicator
-        if((c % (nz/10) )==0)
-            fprintf(stderr, ".");
-        fprintf(fp, "%d %d %lf\n", i[c]+1, j[c]+1, v[c]); // Mondriaan expects 1-based coordinates.
+/*
+ * Write the text of block b to the matrix file fp and, if nbfp is not
+ * NULL, to the Mathematica file. The very first rule is written without
+ * its leading separator.
+ */
+void writeblock(FILE *fp, FILE *nbfp, genblock *b, bool *first) {
 
+    if(fwrite(b->buf, 1, b->len, fp) != b->len) {
+        fprintf(stderr, "error writing the matrix\n");
+        exit(3);
     }
-
-    fprintf(stderr, "\n");
-    // ...and now for the vector-to-be-solved-for:
-    fprintf(fp, "%%%%b vector double general array original\n");
-    //size line:
-    fprintf(fp, "%d\n", N);
-    for(c=0;c<N;c++) {
-        fprintf(fp, "%lf\n", vec[c]);
+    if(nbfp != NULL && b->nblen > 0) {
+        size_t skip = *first ? 2 : 0;
+        fwrite(b->nb + skip, 1, b->nblen - skip, nbfp);
+        *first = false;
     }
 
-
-    fclose(fp);
-    free(filename);
-
-
 }
-
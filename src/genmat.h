@@ -1,11 +1,11 @@
 #include "libs/paulbool.h"
+#include "libs/matgen.h"
 
-void   checkStrictDiagonallyDominant(int* i, int* j, double* v, int nz);
-int    countDiags(int* i, int* j, int nz);
-void   addTranspose(int nz, int* i, int* j, double* v, int maxsize);
-double ran();
-void addDiagonal(double mu, int* i, int* j, double* v, int nz, int diags_needed, bool* diags_done);
-// output functions
-void   outputMondriaanMatrix(int nz, int*i, int*j, double*v, double*vec);
-void   outputMathematicaMatrix(int nz, int*i, int*j, double*v, double*vec);
-void   outputSimpleMatrix(int nz, int*i, int*j, double*v, double*vec);
+/*
+ * genmat writes the matrix in blocks of GENTILE rows, a round of one
+ * block per thread at a time, so only that much text is held in memory.
+ */
+
+int    genthreads(void);
+void   genname(char *stem, const genparams *g);
+void   writeblock(FILE *fp, FILE *nbfp, genblock *b, bool *first);
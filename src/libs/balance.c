@@ -0,0 +1,687 @@
+#include <limits.h>
+#include "bspedupack.h"
+#include "bspfuncs.h"
+#include "cgsolver.h"
+#include "partition.h"
+#include "balance.h"
+#include "debug.h"
+
+/*
+ * Dynamic load balancing, see balance.h.
+ *
+ * The computation time of each processor is measured directly, in
+ * superstep 2 of bspmv. Its communication time cannot be, since
+ * in BSP every processor waits in the same syncs; it is modelled as
+ * g.h, where h is the number of words the processor sends and receives,
+ * and g is fitted to the time the multiplication takes beyond the
+ * slowest computation and three syncs of latency l.
+ *
+ * Only the computation is balanced. In BSP the computation and the
+ * communication are separate supersteps, each costing its maximum over
+ * the processors, and moving rows cannot lower the communication: the
+ * partitioner should take care of that. Rows move with the components
+ * of u and v of the same index, where the processor owns them, so that
+ * a distribution by rows stays one.
+ */
+
+/*
+ * Time BALITERS multiplications u := A.v. Returns the computation time
+ * of this processor and the time of the whole multiplication, both per
+ * multiplication.
+ */
+void balprobe(cgsolver *cg, double *ptcomp, double *ptmv)
+{
+    int i, k;
+    double *v, *u, time0;
+
+    v = vecallocd(cg->nv);
+    u = vecallocd(cg->nu);
+    for (i = 0; i < cg->nv; i++)
+        v[i] = 1.0;
+
+    *ptcomp = 0.0;
+    bsp_sync();
+    time0 = bsp_time();
+    for (k = 0; k < BALITERS; k++)
+        bspmv(cg->p,cg->s,cg->n,cg->nz,cg->nrows,cg->ncols,cg->a,cg->inc,
+              cg->srcprocv,cg->srcindv,cg->destprocu,cg->destindu,
+              cg->nv,cg->nu,v,u,ptcomp);
+    *ptmv = (bsp_time() - time0)/BALITERS;
+    *ptcomp /= BALITERS;
+
+    vecfreed(u); vecfreed(v);
+
+} /* end balprobe */
+
+/*
+ * The number of words this processor sends and receives in a
+ * multiplication: in the fanout, the larger of the components of v it
+ * gets and those gotten from it, and in the fanin the larger of the
+ * partial sums it sends and receives.
+ */
+int balwords(cgsolver *cg)
+{
+    int p, s, q, k, got, served, sent, recvd;
+    int *getfrom, *sendto, *servedto, *recvdfrom;
+
+    p = cg->p; s = cg->s;
+    getfrom = vecalloci(p);
+    sendto = vecalloci(p);
+    servedto = vecalloci(p);
+    recvdfrom = vecalloci(p);
+    for (q = 0; q < p; q++)
+        getfrom[q] = sendto[q] = servedto[q] = recvdfrom[q] = 0;
+    for (k = 0; k < cg->ncols; k++)
+        getfrom[cg->srcprocv[k]]++;
+    for (k = 0; k < cg->nrows; k++)
+        sendto[cg->destprocu[k]]++;
+
+    bsp_push_reg(servedto, p*SZINT);
+    bsp_push_reg(recvdfrom, p*SZINT);
+    bsp_sync();
+    for (q = 0; q < p; q++) {
+        if (q == s)
+            continue;
+        if (getfrom[q] > 0)
+            bsp_put(q, &getfrom[q], servedto, s*SZINT, SZINT);
+        if (sendto[q] > 0)
+            bsp_put(q, &sendto[q], recvdfrom, s*SZINT, SZINT);
+    }
+    bsp_sync();
+    bsp_pop_reg(recvdfrom);
+    bsp_pop_reg(servedto);
+
+    got = served = sent = recvd = 0;
+    for (q = 0; q < p; q++) {
+        if (q == s)
+            continue;
+        got += getfrom[q];
+        served += servedto[q];
+        sent += sendto[q];
+        recvd += recvdfrom[q];
+    }
+    vecfreei(recvdfrom); vecfreei(servedto);
+    vecfreei(sendto); vecfreei(getfrom);
+
+    return (got > served ? got : served) + (sent > recvd ? sent : recvd);
+
+} /* end balwords */
+
+/*
+ * The time of an empty sync on this processor, averaged over BALSYNCS.
+ */
+double ballatency(void)
+{
+    int k;
+    double time0;
+
+    bsp_sync();
+    time0 = bsp_time();
+    for (k = 0; k < BALSYNCS; k++)
+        bsp_sync();
+
+    return (bsp_time() - time0)/BALSYNCS;
+
+} /* end ballatency */
+
+/*
+ * Gather the times measured by balprobe on all processors, and print
+ * them: stat[q] becomes the computation time of processor q, stat[p+q]
+ * its modelled communication time and stat[2p+q] its number of
+ * nonzeros, stat[3p] is g and stat[3p+1] is l. All processors get the
+ * same numbers. Returns the imbalance of the computation, the largest
+ * time over the average minus one, and in *pmv the time of the whole
+ * multiplication. Processors without nonzeros are left out of the
+ * imbalances, as they are idle on purpose.
+ */
+double balmeasure(cgsolver *cg, double tcomp, double tmv, double *stat,
+                  double *pmv)
+{
+    int p, s, q, busy;
+    double *vals, mincomp, maxcomp, sumcomp, mincomm, maxcomm, sumcomm,
+           maxh, maxmv, l, g;
+
+    p = cg->p; s = cg->s;
+    vals = vecallocd(5*p);
+    for (q = 0; q < 5*p; q++)
+        vals[q] = 0.0;
+    vals[s] = tcomp;
+    vals[p+s] = tmv;
+    vals[2*p+s] = balwords(cg);
+    vals[3*p+s] = cg->nz;
+    vals[4*p+s] = ballatency();
+    bspreduce(p, s, 5*p, vals);
+
+    maxcomp = maxh = maxmv = l = 0.0;
+    for (q = 0; q < p; q++) {
+        if (vals[q] > maxcomp)
+            maxcomp = vals[q];
+        if (vals[p+q] > maxmv)
+            maxmv = vals[p+q];
+        if (vals[2*p+q] > maxh)
+            maxh = vals[2*p+q];
+        if (vals[4*p+q] > l)
+            l = vals[4*p+q];
+    }
+    g = 0.0;
+    if (maxh > 0 && maxmv - maxcomp - 3*l > 0)
+        g = (maxmv - maxcomp - 3*l)/maxh;
+
+    busy = 0;
+    sumcomp = sumcomm = 0.0;
+    mincomp = mincomm = maxcomm = 0.0;
+    for (q = 0; q < p; q++) {
+        stat[q] = vals[q];
+        stat[p+q] = g*vals[2*p+q];
+        stat[2*p+q] = vals[3*p+q];
+        if (stat[2*p+q] == 0)
+            continue;
+        sumcomp += stat[q];
+        sumcomm += stat[p+q];
+        if (busy == 0 || stat[q] < mincomp)
+            mincomp = stat[q];
+        if (busy == 0 || stat[p+q] < mincomm)
+            mincomm = stat[p+q];
+        if (stat[p+q] > maxcomm)
+            maxcomm = stat[p+q];
+        busy++;
+    }
+    stat[3*p] = g;
+    stat[3*p+1] = l;
+    vecfreed(vals);
+
+    if (s==0) {
+        printf("Multiplication takes %.3e s; per processor\n", maxmv);
+        printf("   computation   %.3e..%.3e s, imbalance %.3f\n", mincomp, maxcomp,
+               (sumcomp > 0 ? maxcomp*busy/sumcomp - 1.0 : 0.0));
+        printf("   communication %.3e..%.3e s, imbalance %.3f (g = %.3e s, l = %.3e s)\n",
+               mincomm, maxcomm, (sumcomm > 0 ? maxcomm*busy/sumcomm - 1.0 : 0.0), g, l);
+    }
+    *pmv = maxmv;
+
+    return (sumcomp > 0 ? maxcomp*busy/sumcomp - 1.0 : 0.0);
+
+} /* end balmeasure */
+
+/*
+ * Position of i in the increasing list index[0..n-1], or -1.
+ */
+int balfind(int n, gidx *index, gidx i)
+{
+    int lo, hi, mid;
+
+    lo = 0;
+    hi = n;
+    while (lo < hi) {
+        mid = lo + (hi - lo)/2;
+        if (index[mid] < i)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return (lo < n && index[lo] == i ? lo : -1);
+
+} /* end balfind */
+
+/*
+ * Send the components of a vector distribution, and their values if
+ * pvalues is not NULL, along with the local rows of the same index to
+ * rowdest. Components with no local row of their index go to vecdest,
+ * or stay if vecdest < 0. The new components replace the old ones in
+ * *pn, *pindex and *pvalues.
+ */
+void balvector(cgsolver *cg, int *rowdest, int vecdest, int *pn,
+               gidx **pindex, double **pvalues)
+{
+    int p, s, k, r, n, nkeep, nmove, m, *dest;
+    gidx *index, *newindex;
+    double *values, *newvalues;
+    balentry *mv, *in;
+
+    p = cg->p; s = cg->s;
+    n = *pn; index = *pindex;
+    values = (pvalues != NULL ? *pvalues : NULL);
+
+    dest = vecalloci(n+1);
+    nmove = 0;
+    for (k = 0; k < n; k++) {
+        r = balfind(cg->nrows, cg->rowindex, index[k]);
+        dest[k] = (r >= 0 ? rowdest[r] : vecdest >= 0 ? vecdest : s);
+        if (dest[k] != s)
+            nmove++;
+    }
+    mv = malloc((size_t)nmove*sizeof(balentry) + 1);
+    if (mv == NULL)
+        bsp_abort("balvector: not enough memory");
+    nkeep = nmove = 0;
+    for (k = 0; k < n; k++) {
+        if (dest[k] == s) {
+            index[nkeep] = index[k];
+            if (pvalues != NULL)
+                values[nkeep] = values[k];
+            nkeep++;
+        } else {
+            mv[nmove].i = index[k];
+            mv[nmove].x = (pvalues != NULL ? values[k] : 0.0);
+            dest[nmove++] = dest[k];
+        }
+    }
+    partexchange(p, s, nmove, dest, sizeof(balentry), mv, &m, (void **)&in);
+    free(mv);
+    vecfreei(dest);
+
+    newindex = vecallocg(nkeep+m);
+    for (k = 0; k < nkeep; k++)
+        newindex[k] = index[k];
+    for (k = 0; k < m; k++)
+        newindex[nkeep+k] = in[k].i;
+    vecfreeg(index);
+    *pindex = newindex;
+    if (pvalues != NULL) {
+        newvalues = vecallocd(nkeep+m);
+        for (k = 0; k < nkeep; k++)
+            newvalues[k] = values[k];
+        for (k = 0; k < m; k++)
+            newvalues[nkeep+k] = in[k].x;
+        vecfreed(values);
+        *pvalues = newvalues;
+    }
+    *pn = nkeep + m;
+    free(in);
+
+} /* end balvector */
+
+/*
+ * Move whole local rows so that the computation, at the time per
+ * nonzero measured on each processor (see balmeasure), takes equally
+ * long everywhere. Processors without nonzeros stay without, so they
+ * remain idle after cgagglomerate. Returns the total number of
+ * nonzeros moved.
+ *
+ * The local rows of all processors are laid out on a line in order of
+ * processor and row, and the line is cut anew at the targets. So rows
+ * only move to processors nearby in this order, and with a distribution
+ * in blocks of rows the blocks stay blocks.
+ */
+gidx balmove(cgsolver *cg, double *stat)
+{
+    int p, s, q, i, j, k, first, *rowdest;
+    double *comp, *nzq, *bound, sumnz, sumcomp, sumw, start, mid;
+    gidx moved;
+
+    p = cg->p; s = cg->s;
+    comp = stat; nzq = stat + 2*p;
+    bound = vecallocd(p+1);
+
+    /* processor q should get a share of the nonzeros proportional to
+       the number it does per second */
+    sumnz = sumcomp = 0.0;
+    for (q = 0; q < p; q++) {
+        sumnz += nzq[q];
+        sumcomp += comp[q];
+    }
+    sumw = 0.0;
+    bound[0] = 0.0;
+    for (q = 0; q < p; q++) {
+        // too fast to measure counts as average
+        if (nzq[q] > 0)
+            sumw += (comp[q] > 0 ? nzq[q]/comp[q] : sumnz/sumcomp);
+        bound[q+1] = sumw;
+    }
+    for (q = 1; q <= p; q++)
+        bound[q] *= sumnz/sumw;
+    start = 0.0;
+    for (q = 0; q < s; q++)
+        start += nzq[q];
+
+    /* where each of my rows goes */
+    rowdest = vecalloci(cg->nrows+1);
+    q = 0;
+    k = 0;
+    j = cg->inc[0];
+    for (i = 0; i < cg->nrows; i++) {
+        first = k;
+        while (j < cg->ncols) {
+            k++;
+            j += cg->inc[k];
+        }
+        j -= cg->ncols;
+        mid = start + 0.5*(first + k);
+        while (q < p-1 && bound[q+1] <= mid)
+            q++;
+        rowdest[i] = q;
+    }
+
+    moved = balmigrate(cg, rowdest, -1);
+    vecfreei(rowdest);
+    vecfreed(bound);
+
+    return moved;
+
+} /* end balmove */
+
+/*
+ * Send every local row i to processor rowdest[i], with the components
+ * of u, v and the right-hand side of the same index; other components
+ * go to vecdest, or stay if vecdest < 0. Then rebuild the ICRS and all
+ * communication metadata. Returns the total number of nonzeros moved.
+ */
+gidx balmigrate(cgsolver *cg, int *rowdest, int vecdest)
+{
+    int p, s, i, j, k, nz, nkeep, nmove, m, *dest;
+    gidx *ia, *ja;
+    double *a, moved;
+    parttriple *mv, *in;
+
+    p = cg->p; s = cg->s;
+
+    /* my nonzeros as triples */
+    nz = cg->nz;
+    ia = vecallocg(nz+1);
+    ja = vecallocg(nz+1);
+    a = vecallocd(nz+1);
+    dest = vecalloci(nz+1);
+    k = 0;
+    j = cg->inc[0];
+    for (i = 0; i < cg->nrows; i++) {
+        while (j < cg->ncols) {
+            ia[k] = cg->rowindex[i];
+            ja[k] = cg->colindex[j];
+            a[k] = cg->a[k];
+            dest[k] = rowdest[i];
+            k++;
+            j += cg->inc[k];
+        }
+        j -= cg->ncols;
+    }
+
+    nmove = 0;
+    for (k = 0; k < nz; k++)
+        if (dest[k] != s)
+            nmove++;
+    mv = malloc((size_t)nmove*sizeof(parttriple) + 1);
+    if (mv == NULL)
+        bsp_abort("balmigrate: not enough memory");
+    nkeep = nmove = 0;
+    for (k = 0; k < nz; k++) {
+        if (dest[k] == s) {
+            ia[nkeep] = ia[k];
+            ja[nkeep] = ja[k];
+            a[nkeep++] = a[k];
+        } else {
+            mv[nmove].i = ia[k];
+            mv[nmove].j = ja[k];
+            mv[nmove].a = a[k];
+            dest[nmove++] = dest[k];
+        }
+    }
+    partexchange(p, s, nmove, dest, sizeof(parttriple), mv, &m, (void **)&in);
+    free(mv);
+    vecfreei(dest);
+
+    if ((long)nkeep + m > INT_MAX)
+        bsp_abort("Error: processor %d would get too many nonzeros\n", s);
+    if (m > 0) {
+        ia = realloc(ia, ((size_t)nkeep+m+1)*sizeof(gidx));
+        ja = realloc(ja, ((size_t)nkeep+m+1)*sizeof(gidx));
+        a = realloc(a, ((size_t)nkeep+m+1)*sizeof(double));
+        if (ia == NULL || ja == NULL || a == NULL)
+            bsp_abort("balmigrate: not enough memory");
+    }
+    for (k = 0; k < m; k++) {
+        ia[nkeep+k] = in[k].i;
+        ja[nkeep+k] = in[k].j;
+        a[nkeep+k] = in[k].a;
+    }
+    free(in);
+
+    /* the vectors follow the rows, while we still know where they went */
+    balvector(cg, rowdest, vecdest, &cg->nu, &cg->uindex, &cg->b);
+    balvector(cg, rowdest, vecdest, &cg->nv, &cg->vindex, NULL);
+
+    /* rebuild the matrix; the order the nonzeros were read in is gone,
+       so cgupdate is no longer possible */
+    vecfreed(cg->a);          vecfreef(cg->af);
+    vecfreei(cg->inc);        vecfreei(cg->perm);
+    vecfreeg(cg->rowindex);   vecfreeg(cg->colindex);
+    vecfreei(cg->srcprocv);   vecfreei(cg->srcindv);
+    vecfreei(cg->destprocu);  vecfreei(cg->destindu);
+    cgmatrix(cg, nkeep+m, ia, ja, a);
+    vecfreei(cg->perm);
+    cg->perm = NULL;
+
+    vecfreei(cg->u2vproc);  vecfreei(cg->u2vind);
+    vecfreei(cg->v2uproc);  vecfreei(cg->v2uind);
+    cg->u2vproc = vecalloci(cg->nu);
+    cg->u2vind  = vecalloci(cg->nu);
+    cg->v2uproc = vecalloci(cg->nv);
+    cg->v2uind  = vecalloci(cg->nv);
+    bspvecmap(p,s,cg->n,cg->nu,cg->uindex,cg->nv,cg->vindex,cg->u2vproc,cg->u2vind);
+    bspvecmap(p,s,cg->n,cg->nv,cg->vindex,cg->nu,cg->uindex,cg->v2uproc,cg->v2uind);
+
+    moved = nmove;
+    bspreduce(p, s, 1, &moved);
+
+    return (gidx)moved;
+
+} /* end balmigrate */
+
+/*
+ * Time the multiplication, and if the computation of the slowest
+ * processor is more than a fraction imbal above the average, move rows
+ * to even it out and time it again. Must be called before the first
+ * solve, as the deflation space is not moved along.
+ */
+void cgbalance(cgsolver *cg, double imbal)
+{
+    int p, s;
+    gidx moved, vol, maxvol;
+    double *stat, tcomp, tmv, before, after, mvbefore, mvafter;
+
+    p = cg->p; s = cg->s;
+    if (cg->nw > 0)
+        bsp_abort("cgbalance: the deflation space would not move along\n");
+    stat = vecallocd(3*p+2);
+
+    balprobe(cg, &tcomp, &tmv);
+    before = balmeasure(cg, tcomp, tmv, stat, &mvbefore);
+    if (before <= imbal) {
+        if (s==0)
+            printf("Imbalance %.3f is not above %.3f, not rebalancing.\n", before, imbal);
+        vecfreed(stat);
+        return;
+    }
+
+    moved = balmove(cg, stat);
+    partvolume(p,s,cg->nrows,cg->ncols,cg->srcprocv,cg->destprocu,&vol,&maxvol);
+    if (s==0)
+        printf("Rebalanced: moved %" GIDX " nonzeros; communication volume now %" GIDX " words.\n",
+               moved, vol);
+
+    balprobe(cg, &tcomp, &tmv);
+    after = balmeasure(cg, tcomp, tmv, stat, &mvafter);
+    if (s==0)
+        printf("Imbalance %.3f after rebalancing (was %.3f), multiplication %.3e s (was %.3e s).\n",
+               after, before, mvafter, mvbefore);
+    vecfreed(stat);
+
+} /* end cgbalance */
+
+/*
+ * The group of processor s when p processors are merged into q groups
+ * of consecutive processors, and the processor that hosts group t, its
+ * first member.
+ */
+int balgroup(int p, int q, int s)
+{
+    return (int)((long)s*q/p);
+
+} /* end balgroup */
+
+int balhost(int p, int q, int t)
+{
+    return (int)(((long)t*p + q - 1)/q);
+
+} /* end balhost */
+
+/*
+ * Gather on all processors the words of each pair of processors in a
+ * multiplication: traffic[2p.s+q] is the number of components of v
+ * processor s gets from q in the fanout, traffic[2p.s+p+q] the number
+ * of partial sums s sends to q in the fanin.
+ */
+void baltraffic(cgsolver *cg, int *traffic)
+{
+    int p, s, q, k, *mine;
+
+    p = cg->p; s = cg->s;
+    for (k = 0; k < 2*p*p; k++)
+        traffic[k] = 0;
+    mine = traffic + 2*p*s;
+    for (k = 0; k < cg->ncols; k++)
+        mine[cg->srcprocv[k]]++;
+    for (k = 0; k < cg->nrows; k++)
+        mine[p + cg->destprocu[k]]++;
+
+    bsp_push_reg(traffic, 2*p*p*SZINT);
+    bsp_sync();
+    for (q = 0; q < p; q++)
+        if (q != s)
+            bsp_put(q, mine, traffic, 2*p*s*SZINT, 2*p*SZINT);
+    bsp_sync();
+    bsp_pop_reg(traffic);
+
+} /* end baltraffic */
+
+/*
+ * Predicted time of a multiplication when the p processors are merged
+ * into q groups, from the stat of balmeasure and the traffic of
+ * baltraffic: a group computes what all its members did, one after the
+ * other, and only exchanges the words its members exchanged with other
+ * groups. Partial sums for the same row that meet on one processor are
+ * still counted separately, so the communication is an upper bound.
+ * All p processors keep taking part in the three syncs.
+ */
+double balpredict(int p, int q, double *stat, int *traffic)
+{
+    int s, r, a, b, w;
+    double *comp, *got, *served, *sent, *recvd, maxcomp, maxh, h;
+
+    comp = vecallocd(q);
+    got = vecallocd(q);
+    served = vecallocd(q);
+    sent = vecallocd(q);
+    recvd = vecallocd(q);
+    for (a = 0; a < q; a++)
+        comp[a] = got[a] = served[a] = sent[a] = recvd[a] = 0.0;
+
+    for (s = 0; s < p; s++) {
+        a = balgroup(p, q, s);
+        comp[a] += stat[s];
+        for (r = 0; r < p; r++) {
+            b = balgroup(p, q, r);
+            if (b == a)
+                continue;
+            w = traffic[2*p*s + r];
+            got[a] += w;
+            served[b] += w;
+            w = traffic[2*p*s + p + r];
+            sent[a] += w;
+            recvd[b] += w;
+        }
+    }
+
+    maxcomp = maxh = 0.0;
+    for (a = 0; a < q; a++) {
+        if (comp[a] > maxcomp)
+            maxcomp = comp[a];
+        h = (got[a] > served[a] ? got[a] : served[a]) +
+            (sent[a] > recvd[a] ? sent[a] : recvd[a]);
+        if (h > maxh)
+            maxh = h;
+    }
+    vecfreed(recvd); vecfreed(sent); vecfreed(served);
+    vecfreed(got); vecfreed(comp);
+
+    return maxcomp + stat[3*p]*maxh + 3*stat[3*p+1];
+
+} /* end balpredict */
+
+/*
+ * Time the multiplication, predict with balpredict what it would take
+ * on fewer processors, and gather the whole problem onto the number q
+ * that is predicted fastest, if that is more than AGGMARGIN faster than
+ * all p. If nzmin > 0, q is also at most the total number of nonzeros
+ * over nzmin. The other processors keep no rows and no vector
+ * components, and only join the syncs. Must be called before the first
+ * solve, as the deflation space is not moved along. Returns q.
+ */
+int cgagglomerate(cgsolver *cg, double nzmin)
+{
+    int p, s, q, best, *traffic, *rowdest, i, host;
+    gidx moved, vol, maxvol;
+    double *stat, tcomp, tmv, mvbefore, mvafter, nz, t, tp, tbest;
+
+    p = cg->p; s = cg->s;
+    if (cg->nw > 0)
+        bsp_abort("cgagglomerate: the deflation space would not move along\n");
+    stat = vecallocd(3*p+2);
+    traffic = vecalloci(2*p*p);
+
+    balprobe(cg, &tcomp, &tmv);
+    balmeasure(cg, tcomp, tmv, stat, &mvbefore);
+    baltraffic(cg, traffic);
+
+    nz = 0.0;
+    for (q = 0; q < p; q++)
+        nz += stat[2*p+q];
+    tp = tbest = balpredict(p, p, stat, traffic);
+    best = p;
+    for (q = 1; q < p; q++) {
+        t = balpredict(p, q, stat, traffic);
+        if (t < tbest) {
+            best = q;
+            tbest = t;
+        }
+    }
+    if (tbest > (1.0 - AGGMARGIN)*tp) {
+        best = p;
+        tbest = tp;
+    }
+    if (nzmin > 0 && nz/nzmin < best) {
+        best = (nz/nzmin >= 1 ? (int)(nz/nzmin) : 1);
+        tbest = balpredict(p, best, stat, traffic);
+    }
+    vecfreei(traffic);
+
+    if (s==0)
+        printf("Predicted multiplication %.3e s on %d processors, %.3e s on %d.\n",
+               tp, p, tbest, best);
+    if (best == p) {
+        if (s==0)
+            printf("Keeping all %d processors.\n", p);
+        vecfreed(stat);
+        return p;
+    }
+
+    host = balhost(p, best, balgroup(p, best, s));
+    rowdest = vecalloci(cg->nrows);
+    for (i = 0; i < cg->nrows; i++)
+        rowdest[i] = host;
+    moved = balmigrate(cg, rowdest, host);
+    vecfreei(rowdest);
+    partvolume(p,s,cg->nrows,cg->ncols,cg->srcprocv,cg->destprocu,&vol,&maxvol);
+    if (s==0)
+        printf("Agglomerated onto %d of %d processors: moved %" GIDX " nonzeros; communication volume now %" GIDX " words.\n",
+               best, p, moved, vol);
+
+    balprobe(cg, &tcomp, &tmv);
+    balmeasure(cg, tcomp, tmv, stat, &mvafter);
+    if (s==0)
+        printf("Multiplication %.3e s on %d processors (was %.3e s on %d).\n",
+               mvafter, best, mvbefore, p);
+    vecfreed(stat);
+
+    return best;
+
+} /* end cgagglomerate */
@@ -0,0 +1,54 @@
+#ifndef __BALANCE
+#define __BALANCE
+
+#include "gidx.h"
+#include "cgsolver.h"
+
+/*
+ * Load balancing of the multiplication from measured times.
+ *
+ * The same number of nonzeros on every processor need not take the
+ * same time everywhere: row lengths, cache behaviour and the other
+ * work on a node differ. cgbalance times a few multiplications before
+ * the first solve, and if the computation of the slowest processor is
+ * too far above the average, moves whole rows from slow processors to
+ * fast ones, together with the vector components they own, rebuilds
+ * the ICRS and the communication metadata, and times again.
+ *
+ * Small problems go the other way: with few nonzeros per processor a
+ * multiplication is mostly latency and communication, and fewer
+ * processors would be faster. cgagglomerate predicts from the same
+ * timings what the multiplication would take on every smaller number
+ * of processors, and gathers the whole problem onto the best one. The
+ * process count of BSPlib is fixed at bsp_begin, so the processors left
+ * without work still take part in every sync.
+ */
+
+#define BALITERS (10)     /* multiplications timed by balprobe */
+#define BALSYNCS (10)     /* empty syncs timed to estimate the latency */
+#define AGGMARGIN (0.1)   /* predicted gain needed to agglomerate */
+
+/* a vector component on the move */
+typedef struct {
+    gidx i;              /* its global index */
+    double x;            /* its value, if it has one */
+} balentry;
+
+void   balprobe(cgsolver *cg, double *ptcomp, double *ptmv);
+int    balwords(cgsolver *cg);
+double ballatency(void);
+double balmeasure(cgsolver *cg, double tcomp, double tmv, double *stat,
+                  double *pmv);
+int    balfind(int n, gidx *index, gidx i);
+void   balvector(cgsolver *cg, int *rowdest, int vecdest, int *pn,
+                 gidx **pindex, double **pvalues);
+gidx   balmove(cgsolver *cg, double *stat);
+gidx   balmigrate(cgsolver *cg, int *rowdest, int vecdest);
+void   cgbalance(cgsolver *cg, double imbal);
+int    balgroup(int p, int q, int s);
+int    balhost(int p, int q, int t);
+void   baltraffic(cgsolver *cg, int *traffic);
+double balpredict(int p, int q, double *stat, int *traffic);
+int    cgagglomerate(cgsolver *cg, double nzmin);
+
+#endif
@@ -0,0 +1,160 @@
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bspedupack.h"
+#include "paullib.h"
+#include "binio.h"
+#include "debug.h"
+
+char *binmap(const char *filename, size_t *plen){
+
+    /* This function maps a binary matrix container into memory, read
+       only, and checks its header. Pages are only read from disk when
+       they are touched, so every processor can map the whole file and
+       pay only for the parts it uses.
+
+       Output:
+       len is the length of the mapping.
+       Returns the start of the mapping.
+    */
+
+    int fd;
+    struct stat st;
+    char *map;
+    binheader *h;
+    size_t len;
+
+    if ((fd= open(filename,O_RDONLY)) < 0)
+        bsp_abort("Error: cannot open binary matrix file %s\n",filename);
+    if (fstat(fd,&st) != 0 || st.st_size < (off_t)sizeof(binheader))
+        bsp_abort("Error: %s is too short for a binary matrix file\n",filename);
+    len= st.st_size;
+    map= mmap(NULL,len,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if (map==MAP_FAILED)
+        bsp_abort("Error: cannot map %s\n",filename);
+
+    h= (binheader*)map;
+    if (memcmp(h->magic,BINMAGIC,8) != 0)
+        bsp_abort("Error: %s is not a binary matrix file\n",filename);
+    if (h->version != BINVERSION)
+        bsp_abort("Error: %s has version %d, expected %d\n",
+                  filename,h->version,BINVERSION);
+    if (h->offpstart + (int64_t)(h->p+1)*8 > (int64_t)len ||
+            h->offblocks + BINRECORD*h->nz > (int64_t)len ||
+            h->offu + (int64_t)h->nruns_u*sizeof(binrun) > (int64_t)len ||
+            h->offv + (int64_t)h->nruns_v*sizeof(binrun) > (int64_t)len)
+        bsp_abort("Error: binary matrix file %s is truncated\n",filename);
+
+    *plen= len;
+    return map;
+
+} /* end binmap */
+
+void binunmap(char *map, size_t len){
+
+    munmap(map,len);
+
+} /* end binunmap */
+
+void bininput2triple(char *map, int p, int s, gidx *pnA, int *pnz,
+                     gidx **pia, gidx **pja, double **pa){
+
+    /* This function gets the local nonzeros of processor s from a
+       mapped binary matrix container, without any communication.
+       Output is as for bspinput2triple.
+    */
+
+    binheader *h;
+    int64_t *Pstart;
+    int32_t *bi, *bj;
+    char *block;
+    int nz, k;
+    gidx *ia, *ja;
+    double *a;
+
+    h= (binheader*)map;
+    if (h->p != p)
+        bsp_abort("Error: p not equal to p(A)\n");
+    Pstart= (int64_t*)(map + h->offpstart);
+    if (Pstart[s+1] - Pstart[s] > NZLOCMAX)
+        bsp_abort("Error: processor %d has more than %d nonzeros\n",s,NZLOCMAX);
+    nz= Pstart[s+1] - Pstart[s];
+    block= map + h->offblocks + BINRECORD*Pstart[s];
+
+    a= vecallocd(nz+1);
+    ia= vecallocg(nz+1);
+    ja= vecallocg(nz+1);
+    memcpy(a, block, nz*SZDBL);
+    bi= (int32_t*)(block + nz*SZDBL);
+    bj= (int32_t*)(block + nz*(SZDBL+sizeof(int32_t)));
+    for (k=0; k<nz; k++){
+        ia[k]= bi[k];
+        ja[k]= bj[k];
+    }
+
+    if (s==0)
+        printf("Matrix has %lld nonzeros.\n",(long long)h->nz);
+    *pnA= h->n;
+    *pnz= nz;
+    *pa= a;
+    *pia= ia;
+    *pja= ja;
+
+} /* end bininput2triple */
+
+void bininputvec(char *map, int p, int s, int v, int *pnv, gidx **pvindex,
+                 double **pvalues){
+
+    /* This function gets the distribution of u (v=0) or v (v=1) from
+       a mapped binary matrix container. Every processor walks the
+       ownership runs and keeps its own components; the random vector
+       values are drawn locally, as in bspinputvec. No communication
+       is needed.
+       Output is as for bspinputvec.
+    */
+
+    binrun *run;
+    binheader *h;
+    int nruns, r, i, nv;
+    gidx n, k, *vindex;
+    double *values;
+
+    h= (binheader*)map;
+    n= h->n;
+    run= (binrun*)(map + (v ? h->offv : h->offu));
+    nruns= (v ? h->nruns_v : h->nruns_u);
+
+    /* First count, then store my components */
+    k= 0; nv= 0;
+    for (r=0; r<nruns; r++){
+        if (run[r].proc < 0 || run[r].proc >= p || run[r].len < 0 || k + run[r].len > n)
+            bsp_abort("Error: bad ownership run in binary matrix file\n");
+        if (run[r].proc == s)
+            nv += run[r].len;
+        k += run[r].len;
+    }
+    if (k != n)
+        bsp_abort("Error: ownership runs cover %" GIDX " of %" GIDX " components\n",k,n);
+
+    vindex= vecallocg(nv);
+    k= 0; nv= 0;
+    for (r=0; r<nruns; r++){
+        if (run[r].proc == s)
+            for (i=0; i<run[r].len; i++)
+                vindex[nv++]= k+i;
+        k += run[r].len;
+    }
+
+    values= vecallocd(nv);
+    for (i=0; i<nv; i++)
+        values[i]= ranindex(VECSEED,vindex[i]);
+
+    *pnv= nv;
+    *pvindex= vindex;
+    *pvalues= values;
+
+} /* end bininputvec */
@@ -0,0 +1,68 @@
+#ifndef __BINIO
+#define __BINIO
+
+#include <stddef.h>
+#include <stdint.h>
+#include "gidx.h"
+
+/*
+ * Binary container for a distributed matrix together with the
+ * distributions of u and v, as written by emm2bin. All numbers are in
+ * the native byte order, indices start at 0.
+ *
+ *   binheader
+ *   int64_t Pstart[p+1]       at offpstart; processor q owns nonzeros
+ *                             Pstart[q]..Pstart[q+1]-1
+ *   nonzero blocks            at offblocks; the block of processor q
+ *                             starts at offblocks + BINRECORD*Pstart[q]
+ *                             and holds, with nzq = Pstart[q+1]-Pstart[q],
+ *                               double  a[nzq]
+ *                               int32_t i[nzq]
+ *                               int32_t j[nzq]
+ *   binrun u[nruns_u]         at offu; ownership of u, run-length encoded
+ *   binrun v[nruns_v]         at offv; the same for v
+ *
+ * A run gives the owner of len consecutive components; the runs cover
+ * 0..n-1 in order. Local indices on each processor follow the global
+ * order, as with bspinputvec.
+ *
+ * Each processor maps the file and only touches the header, the tables
+ * and its own block.
+ *
+ * The total number of nonzeros and Pstart are 64-bit, but the matrix
+ * size and the indices are 32-bit, so a container holds any number of
+ * nonzeros but at most 2^31-1 rows, even with -DINDEX64.
+ */
+
+#define BINMAGIC "BSPCGMAT"
+#define BINVERSION (1)
+#define BINRECORD (16)  /* bytes per nonzero */
+
+typedef struct {
+    char magic[8];      /* BINMAGIC, not null-terminated */
+    int32_t version;    /* BINVERSION */
+    int32_t p;          /* number of processors */
+    int32_t n;          /* matrix size */
+    int32_t nruns_u;    /* number of runs in the ownership of u */
+    int32_t nruns_v;    /* the same for v */
+    int32_t pad;
+    int64_t nz;         /* total number of nonzeros */
+    int64_t offpstart;  /* byte offsets of the sections */
+    int64_t offblocks;
+    int64_t offu;
+    int64_t offv;
+} binheader;
+
+typedef struct {
+    int32_t len;        /* number of consecutive components */
+    int32_t proc;       /* their owner */
+} binrun;
+
+char *binmap(const char *filename, size_t *plen);
+void binunmap(char *map, size_t len);
+void bininput2triple(char *map, int p, int s, gidx *pnA, int *pnz,
+                     gidx **pia, gidx **pja, double **pa);
+void bininputvec(char *map, int p, int s, int v, int *pnv, gidx **pvindex,
+                 double **pvalues);
+
+#endif
@@ -19,6 +19,21 @@ double *vecallocd(int n){
 
 } /* end vecallocd */
 
+float *vecallocf(int n){
+    /* This function allocates a vector of floats of length n */
+    float *pf;
+
+    if (n==0){
+        pf= NULL;
+    } else {
+        pf= (float *)malloc(n*SZFLT);
+        if (pf==NULL)
+            bsp_abort("vecallocf: not enough memory");
+    }
+    return pf;
+
+} /* end vecallocf */
+
 ulong *vecalloculi(ulong n)
 {
     /* This function allocates a vector of integers of length n */
@@ -49,6 +64,21 @@ int *vecalloci(int n){
 
 } /* end vecalloci */
 
+gidx *vecallocg(int n){
+    /* This function allocates a vector of global indices of length n */
+    gidx *pg;
+
+    if (n==0){
+        pg= NULL;
+    } else {
+        pg= (gidx *)malloc(n*SZGIDX);
+        if (pg==NULL)
+            bsp_abort("vecallocg: not enough memory");
+    }
+    return pg;
+
+} /* end vecallocg */
+
 double **matallocd(int m, int n){
     /* This function allocates an m x n matrix of doubles */
     int i;
@@ -84,6 +114,14 @@ void vecfreed(double *pd){
 
 } /* end vecfreed */
 
+void vecfreef(float *pf){
+    /* This function frees a vector of floats */
+
+    if (pf!=NULL)
+        free(pf);
+
+} /* end vecfreef */
+
 void vecfreeuli(ulong *pi){
     /* This function frees a vector of integers */
 
@@ -99,6 +137,14 @@ void vecfreei(int *pi){
 
 } /* end vecfreei */
 
+void vecfreeg(gidx *pg){
+    /* This function frees a vector of global indices */
+
+    if (pg!=NULL)
+        free(pg);
+
+} /* end vecfreeg */
+
 void matfreed(double **ppd){
     /* This function frees a matrix of doubles */
 
@@ -13,8 +13,10 @@
 #include <stdlib.h>
 #include <math.h>
 #include <bsp.h>
+#include "gidx.h"
 
 #define SZDBL (sizeof(double))
+#define SZFLT (sizeof(float))
 #define SZINT (sizeof(int))
 #define SZCHAR (sizeof(char))
 #define TRUE (1)
@@ -26,10 +28,14 @@
 #define ulong  long long
 
 double *vecallocd(int n);
+float *vecallocf(int n);
 int *vecalloci(int n);
+gidx *vecallocg(int n);
 ulong *vecalloculi(ulong n);
 double **matallocd(int m, int n);
 void vecfreed(double *pd);
+void vecfreef(float *pf);
 void vecfreeuli(ulong *pd);
 void vecfreei(int *pi);
+void vecfreeg(gidx *pg);
 void matfreed(double **ppd);
@@ -1,19 +1,39 @@
-void bspmv(int p, int s, int n, int nz, int nrows, int ncols,
+#include "gidx.h"
+
+void bspmv(int p, int s, gidx n, int nz, int nrows, int ncols,
            double *a, int *inc,
            int *srcprocv, int *srcindv, int *destprocu, int *destindu,
-           int nv, int nu, double *v, double *u);
+           int nv, int nu, double *v, double *u, double *tcomp);
+
+void bspmvf(int p, int s, gidx n, int nz, int nrows, int ncols,
+            float *a, int *inc,
+            int *srcprocv, int *srcindv, int *destprocu, int *destindu,
+            int nv, int nu, float *v, float *u);
 
-int nloc(int p, int s, int n);
+int nloc(int p, int s, gidx n);
 
-void bspmv_init(int p, int s, int n, int nrows, int ncols,
-                int nv, int nu, int *rowindex, int *colindex,
-                int *vindex, int *uindex, int *srcprocv, int *srcindv,
+void bspmv_init(int p, int s, gidx n, int nrows, int ncols,
+                int nv, int nu, gidx *rowindex, gidx *colindex,
+                gidx *vindex, gidx *uindex, int *srcprocv, int *srcindv,
                 int *destprocu, int *destindu);
 
-double bspip(int p,int s,int nv1, int nv2, double* v1, int*v1index,
+void bspvecmap(int p, int s, gidx n, int nu, gidx *uindex,
+               int nv, gidx *vindex, int *procv, int *indv);
+
+double bspip(int p,int s,int nv1, int nv2, double* v1,
              double *v2, int *procv2, int *indv2);
+double bspipsame(int p, int s, int n, double *v1, double *v2);
 
-void addvec(int nv, double *v,int*vindex, int nr, double *remote,
+void addvec(int nv, double *v, int nr, double *remote,
         int *procr, int *indr);
 void copyvec(int s,
-        int nv, int nu, double* v, double* u, int* uindex, int* procu, int* indu);
+        int nv, int nu, double* v, double* u, int* procu, int* indu);
+void bspreduce(int p, int s, int k, double *vals);
+
+double bspipf(int p,int s,int nv1, int nv2, float* v1,
+             float *v2, int *procv2, int *indv2);
+double bspipsamef(int p, int s, int n, float *v1, float *v2);
+void addvecf(int nv, float *v, int nr, float *remote,
+        int *procr, int *indr);
+void copyvecf(int s,
+        int nv, int nu, float* v, float* u, int* procu, int* indu);
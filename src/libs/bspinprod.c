@@ -15,15 +15,15 @@
  * - s: my processor id
  * - nv1 and nv2: the length of the vectors
  * - v1 and v2: the locally-stored components of v1 and v2
- * - v1index: the array which maps my local indexing of v1 to the global index
- * - procv2 and indv2: arrays mapping global vector indices to owner and offset on owner. (i.e. this tells us which processor owns a given nonzero)
+ * - procv2 and indv2: for each local component v1[i], the owner and the local
+ *   index on that owner of the same component of v2, see bspvecmap
  *
  * @return the inproduct of the two vectors
  */
 
 double bspip(int p,int s,
         int nv1, int nv2,
-        double* v1, int*v1index,
+        double* v1,
         double *v2, int *procv2, int *indv2)
 {
     /* Compute inner product of vectors x and y of length n>=0 */
@@ -38,9 +38,8 @@ double bspip(int p,int s,
     bsp_sync();
     for(i=0; i<nv1; i++) {
         // get all the vector components from v2, from where ever they're
-        // stored. the array procv2 tells us this, but it is indexed by the
-        // component's global index.
-        bsp_get(procv2[v1index[i]], v2, indv2[v1index[i]]*SZDBL, &v2_locals[i], SZDBL);
+        // stored. the arrays procv2 and indv2 tell us this.
+        bsp_get(procv2[i], v2, indv2[i]*SZDBL, &v2_locals[i], SZDBL);
     }
 
     double myip=0.0;
@@ -109,8 +108,8 @@ double bspip(int p,int s,
  * - s: my processor id
  * - nv and nu: the length of the vectors
  * - v and u: the locally-stored components of v and u
- * - vindex: the array which maps my local indexing of v to the global index
- * - procu and indu: arrays mapping global vector indices to owner and offset on owner. (i.e. this tells us which processor owns a given nonzero)
+ * - procu and indu: for each local component v[i], the owner and the local
+ *   index on that owner of the same component of u, see bspvecmap
  *
  * This function doesn't return anything, but places a copy of vector v into u, so
  * after the function terminates, u == v == \old{v}.
@@ -118,7 +117,6 @@ double bspip(int p,int s,
 void copyvec(int s,
         int nv, int nu,
         double* v, double* u,
-        int* vindex,
         int* procu, int* indu)
 {
     int i;
@@ -131,7 +129,7 @@ void copyvec(int s,
         // put my v into u somewhere remote;
         // we look up the correct processor and position on
         // that processor using the metadata arrays procu and indu
-        bsp_put(procu[vindex[i]], &v[i], u, indu[vindex[i]]*SZDBL, SZDBL);
+        bsp_put(procu[i], &v[i], u, indu[i]*SZDBL, SZDBL);
     }
 
     bsp_sync();
@@ -143,13 +141,13 @@ void copyvec(int s,
  *
  * - nv and nr: the length of the vectors
  * - v and remote: the locally-stored components of v and remote vector
- * - vindex: the array which maps my local indexing of v to the global index
- * - procr and indr: arrays mapping global vector indices to owner and offset on owner. (i.e. this tells us which processor owns a given nonzero)
+ * - procr and indr: for each local component v[i], the owner and the local
+ *   index on that owner of the same component of remote, see bspvecmap
  *
  * Ensures that afterwards, v = \old{v} + remote, componentwise and on each processor
  */
 
-void addvec(int nv, double *v, int*vindex, int nr, double *remote,
+void addvec(int nv, double *v, int nr, double *remote,
         int *procr, int *indr) {
 
     double *tmp = vecallocd(nv);
@@ -160,7 +158,7 @@ void addvec(int nv, double *v, int*vindex, int nr, double *remote,
     for(i=0;i<nv;i++) {
         // similar to how bspip above gets the proc that's relevant, and knows where
         // that processor stores the vector component we want.
-        bsp_get(procr[vindex[i]], remote, indr[vindex[i]]*SZDBL, &tmp[i], SZDBL);
+        bsp_get(procr[i], remote, indr[i]*SZDBL, &tmp[i], SZDBL);
     }
     bsp_pop_reg(remote);
     bsp_sync();
@@ -172,3 +170,167 @@ void addvec(int nv, double *v, int*vindex, int nr, double *remote,
 
     free(tmp);
 }
+
+/*
+ * Single precision versions of bspip, copyvec and addvec, for the
+ * inner iterations of the mixed precision solver. Vector components
+ * are communicated as floats; the local inner product is accumulated
+ * and reduced in double precision, which costs nothing extra.
+ */
+double bspipf(int p,int s,
+        int nv1, int nv2,
+        float* v1,
+        float *v2, int *procv2, int *indv2)
+{
+    float *v2_locals;
+    double myip;
+    int i;
+
+    v2_locals = vecallocf(nv1);
+    bsp_push_reg(v2, nv2*SZFLT);
+    bsp_sync();
+
+    for(i=0; i<nv1; i++)
+        bsp_get(procv2[i], v2, indv2[i]*SZFLT, &v2_locals[i], SZFLT);
+    bsp_sync();
+
+    myip = 0.0;
+    for(i=0;i<nv1;i++)
+        myip += (double)v1[i]*v2_locals[i];
+
+    bsp_pop_reg(v2);
+    vecfreef(v2_locals);
+
+    bspreduce(p, s, 1, &myip);
+    return myip;
+
+} /* end bspipf */
+
+void copyvecf(int s,
+        int nv, int nu,
+        float* v, float* u,
+        int* procu, int* indu)
+{
+    int i;
+
+    bsp_push_reg(u, nu*SZFLT);
+    bsp_sync();
+
+    for(i=0;i<nv;i++)
+        bsp_put(procu[i], &v[i], u, indu[i]*SZFLT, SZFLT);
+
+    bsp_sync();
+    bsp_pop_reg(u);
+}
+
+void addvecf(int nv, float *v, int nr, float *remote,
+        int *procr, int *indr) {
+
+    float *tmp = vecallocf(nv);
+    bsp_push_reg(remote,nr*SZFLT);
+    bsp_sync();
+
+    int i;
+    for(i=0;i<nv;i++)
+        bsp_get(procr[i], remote, indr[i]*SZFLT, &tmp[i], SZFLT);
+    bsp_pop_reg(remote);
+    bsp_sync();
+
+    for(i=0;i<nv;i++)
+        v[i] += tmp[i];
+
+    vecfreef(tmp);
+}
+
+/*
+ * Inner product of two vectors with the same distribution. No vector
+ * components have to move; only the local sums are exchanged, with
+ * bspreduce.
+ *
+ * - p: number of processors
+ * - s: my processor id
+ * - n: the local length of the vectors
+ * - v1 and v2: the locally-stored components
+ */
+double bspipsame(int p, int s, int n, double *v1, double *v2)
+{
+    double ip;
+    int i;
+
+    ip = 0.0;
+    for(i=0;i<n;i++)
+        ip += v1[i]*v2[i];
+    bspreduce(p, s, 1, &ip);
+    return ip;
+
+} /* end bspipsame */
+
+double bspipsamef(int p, int s, int n, float *v1, float *v2)
+{
+    double ip;
+    int i;
+
+    ip = 0.0;
+    for(i=0;i<n;i++)
+        ip += (double)v1[i]*v2[i];
+    bspreduce(p, s, 1, &ip);
+    return ip;
+
+} /* end bspipsamef */
+
+/*
+ * Sum k values over all processors, in a single all-to-all superstep.
+ * This is the reduction bspip does for one value, for use when several
+ * inner products can be computed locally at once. The contributions are
+ * added in order of processor number, so all processors end up with
+ * exactly the same sums.
+ *
+ * - p: number of processors
+ * - s: my processor id
+ * - k: number of values
+ * - vals: my contributions on input, the global sums on output
+ */
+void bspreduce(int p, int s, int k, double *vals)
+{
+    int i, j, nsums, status, tag;
+    double *all;
+
+#ifdef __GNUC__
+    size_t tagsz, nbytes;
+#else
+    int tagsz, nbytes;
+#endif
+
+    if (k == 0)
+        return;
+
+    tagsz = SZINT;
+    bsp_set_tagsize(&tagsz);
+    bsp_sync();
+
+    for(i=0;i<p;i++) {
+        if(s==i) // don't send myself messages.
+            continue;
+        bsp_send(i, &s, vals, k*SZDBL);
+    }
+    bsp_sync();
+
+    all = vecallocd(p*k);
+    for(j=0;j<k;j++)
+        all[s*k+j] = vals[j];
+
+    bsp_qsize(&nsums, &nbytes);
+    for(i=0;i<nsums; i++) {
+        // the tag tells us who sent this contribution
+        bsp_get_tag(&status, &tag);
+        bsp_move(&all[tag*k], k*SZDBL);
+    }
+
+    for(j=0;j<k;j++) {
+        vals[j] = 0.0;
+        for(i=0;i<p;i++)
+            vals[j] += all[i*k+j];
+    }
+    vecfreed(all);
+
+} /* end bspreduce */
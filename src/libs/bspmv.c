@@ -5,10 +5,10 @@
 // size_t instead of int. See the report for details.
 //                                          -- Paul, January 2012
 
-void bspmv(int p, int s, int n, int nz, int nrows, int ncols,
+void bspmv(int p, int s, gidx n, int nz, int nrows, int ncols,
            double *a, int *inc,
            int *srcprocv, int *srcindv, int *destprocu, int *destindu,
-           int nv, int nu, double *v, double *u){
+           int nv, int nu, double *v, double *u, double *tcomp){
 
     /* This function multiplies a sparse matrix A with a
        dense vector v, giving a dense vector u=Av.
@@ -49,10 +49,15 @@ void bspmv(int p, int s, int n, int nz, int nrows, int ncols,
        nu is the number of local components of the output vector u.
        v[k] is the k'th local component of v, 0 <= k < nv.
        u[k] is the k'th local component of u, 0 <= k < nu.
+
+       If tcomp != NULL, the time this processor spends on its local
+       multiplication is added to *tcomp. That is the only part of the
+       work that is its own: all the rest is waiting in syncs for the
+       slowest processor and for the communication.
     */
 
     int i, j, k, status, nsums, *pinc;
-    double sum, *psum, *pa, *vloc, *pvloc, *pvloc_end;
+    double sum, *psum, *pa, *vloc, *pvloc, *pvloc_end, time0;
 
 #ifdef __GNUC__
     size_t tagsz, nbytes;
@@ -75,6 +80,7 @@ void bspmv(int p, int s, int n, int nz, int nrows, int ncols,
     bsp_sync();
 
     /****** Superstep 2. Local matrix-vector multiplication and fanin */
+    time0= (tcomp != NULL ? bsp_time() : 0.0);
     psum= &sum;
     pa= a;
     pinc= inc;
@@ -93,6 +99,8 @@ void bspmv(int p, int s, int n, int nz, int nrows, int ncols,
         bsp_send(destprocu[i],&destindu[i],psum,SZDBL); 
         pvloc -= ncols;
     }
+    if (tcomp != NULL)
+        *tcomp += bsp_time() - time0;
     bsp_sync();
 
     /****** Superstep 3. Summation of nonzero partial sums ******/
@@ -110,17 +118,86 @@ void bspmv(int p, int s, int n, int nz, int nrows, int ncols,
 
 } /* end bspmv */
 
-int nloc(int p, int s, int n){
+void bspmvf(int p, int s, gidx n, int nz, int nrows, int ncols,
+            float *a, int *inc,
+            int *srcprocv, int *srcindv, int *destprocu, int *destindu,
+            int nv, int nu, float *v, float *u){
+
+    /* Single precision version of bspmv, used for the inner iterations
+       of the mixed precision solver. The matrix values, the vectors and
+       all fanout and fanin messages are floats, which halves the memory
+       traffic and the communication volume. The parameters are the same
+       as for bspmv. */
+
+    int i, j, k, status, nsums, *pinc;
+    float sum, *psum, *pa, *vloc, *pvloc, *pvloc_end;
+
+#ifdef __GNUC__
+    size_t tagsz, nbytes;
+#else
+    int tagsz, nbytes;
+#endif
+
+    /****** Superstep 0. Initialize and register ******/
+    for(i=0; i<nu; i++)
+        u[i]= 0.0;
+    vloc= vecallocf(ncols);
+    bsp_push_reg(v,nv*SZFLT);
+    tagsz= SZINT;
+    bsp_set_tagsize(&tagsz);
+    bsp_sync();
+
+    /****** Superstep 1. Fanout ******/
+    for(j=0; j<ncols; j++)
+        bsp_get(srcprocv[j],v,srcindv[j]*SZFLT,&vloc[j],SZFLT);
+    bsp_sync();
+
+    /****** Superstep 2. Local matrix-vector multiplication and fanin */
+    psum= &sum;
+    pa= a;
+    pinc= inc;
+    pvloc= vloc;
+    pvloc_end= pvloc + ncols;
+
+    pvloc += *pinc;
+    for(i=0; i<nrows; i++){
+        *psum= 0.0;
+        while (pvloc<pvloc_end){
+            *psum += (*pa) * (*pvloc);
+            pa++;
+            pinc++;
+            pvloc += *pinc;
+        }
+        bsp_send(destprocu[i],&destindu[i],psum,SZFLT);
+        pvloc -= ncols;
+    }
+    bsp_sync();
+
+    /****** Superstep 3. Summation of nonzero partial sums ******/
+    bsp_qsize(&nsums,&nbytes);
+    bsp_get_tag(&status,&i);
+    for(k=0; k<nsums; k++){
+        bsp_move(&sum,SZFLT);
+        u[i] += sum;
+        bsp_get_tag(&status,&i);
+    }
+
+    bsp_pop_reg(v);
+    vecfreef(vloc);
+
+} /* end bspmvf */
+
+int nloc(int p, int s, gidx n){
     /* Compute number of local components of processor s for vector
        of length n distributed cyclically over p processors. */
 
-    return  (n+p-s-1)/p ;
+    return  (int)((n+p-s-1)/p) ;
 
 } /* end nloc */
 
-void bspmv_init(int p, int s, int n, int nrows, int ncols,
-                int nv, int nu, int *rowindex, int *colindex,
-                int *vindex, int *uindex, int *srcprocv, int *srcindv,
+void bspmv_init(int p, int s, gidx n, int nrows, int ncols,
+                int nv, int nu, gidx *rowindex, gidx *colindex,
+                gidx *vindex, gidx *uindex, int *srcprocv, int *srcindv,
                 int *destprocu, int *destindu){
 
     /* This function initializes the communication data structure
@@ -143,16 +220,23 @@ void bspmv_init(int p, int s, int n, int nrows, int ncols,
        uindex[i] is the global index of the local u-component i, 0 <= i < nu.
 
        srcprocv, srcindv, destprocu, destindu are the same as in bspmv.
+
+       The global indices may exceed the range of int (see gidx.h),
+       but their positions in the cyclic directory, iglob/p, are local
+       indices and do not.
     */
 
-    int np, i, j, iglob, jglob, *tmpprocv, *tmpindv, *tmpprocu, *tmpindu;
+    int np, i, j, *tmpprocv, *tmpindv, *tmpprocu, *tmpindu;
+    gidx iglob, jglob;
 
     /****** Superstep 0. Allocate and register temporary arrays */
+    /* At least one element each, even if n < p, so that the
+       registered addresses are not all NULL and remain distinct. */
     np= nloc(p,s,n);
-    tmpprocv=vecalloci(np); bsp_push_reg(tmpprocv,np*SZINT);
-    tmpindv=vecalloci(np);  bsp_push_reg(tmpindv,np*SZINT);
-    tmpprocu=vecalloci(np); bsp_push_reg(tmpprocu,np*SZINT);
-    tmpindu=vecalloci(np);  bsp_push_reg(tmpindu,np*SZINT);
+    tmpprocv=vecalloci(np+1); bsp_push_reg(tmpprocv,np*SZINT);
+    tmpindv=vecalloci(np+1);  bsp_push_reg(tmpindv,np*SZINT);
+    tmpprocu=vecalloci(np+1); bsp_push_reg(tmpprocu,np*SZINT);
+    tmpindu=vecalloci(np+1);  bsp_push_reg(tmpindu,np*SZINT);
     bsp_sync();
 
     /****** Superstep 1. Write into temporary arrays ******/
@@ -192,3 +276,52 @@ void bspmv_init(int p, int s, int n, int nrows, int ncols,
     vecfreei(tmpindv); vecfreei(tmpprocv);   
 
 } /* end bspmv_init */
+
+void bspvecmap(int p, int s, gidx n, int nu, gidx *uindex,
+               int nv, gidx *vindex, int *procv, int *indv){
+
+    /* This function finds, for every local component of a vector in
+       the u distribution, the processor and local index of the same
+       component in the v distribution. It uses the cyclic directory
+       of bspmv_init, so memory use is O(n/p) and communication O(n).
+
+       uindex[i] is the global index of the local u-component i, 0 <= i < nu.
+       vindex[j] is the global index of the local v-component j, 0 <= j < nv.
+
+       Output:
+       procv[i] is the processor that owns global component uindex[i]
+                in the v distribution, and indv[i] its local index there.
+    */
+
+    int np, i, j, *tmpprocv, *tmpindv;
+    gidx iglob, jglob;
+
+    /****** Superstep 0. Allocate and register temporary arrays */
+    np= nloc(p,s,n);
+    tmpprocv=vecalloci(np+1); bsp_push_reg(tmpprocv,np*SZINT);
+    tmpindv=vecalloci(np+1);  bsp_push_reg(tmpindv,np*SZINT);
+    bsp_sync();
+
+    /****** Superstep 1. Write into temporary arrays ******/
+    for(j=0; j<nv; j++){
+        jglob= vindex[j];
+        bsp_put(jglob%p,&s,tmpprocv,(jglob/p)*SZINT,SZINT);
+        bsp_put(jglob%p,&j,tmpindv, (jglob/p)*SZINT,SZINT);
+    }
+    bsp_sync();
+
+    /****** Superstep 2. Read from temporary arrays ******/
+    for(i=0; i<nu; i++){
+        iglob= uindex[i];
+        bsp_get(iglob%p,tmpprocv,(iglob/p)*SZINT,&procv[i],SZINT);
+        bsp_get(iglob%p,tmpindv, (iglob/p)*SZINT,&indv[i], SZINT);
+    }
+    bsp_sync();
+
+    /****** Superstep 3. Deregister temporary arrays ******/
+    bsp_pop_reg(tmpindv); bsp_pop_reg(tmpprocv);
+    bsp_sync();
+
+    vecfreei(tmpindv); vecfreei(tmpprocv);
+
+} /* end bspvecmap */
@@ -0,0 +1,599 @@
+#include <string.h>
+#include <limits.h>
+#include "cgsolver.h"
+#include "bspedupack.h"
+#include "bspfuncs.h"
+#include "vecio.h"
+#include "binio.h"
+#include "paullib.h"
+#include "zio.h"
+#include "matgen.h"
+#include "partition.h"
+#include "debug.h"
+
+/*
+ * Read a distributed matrix and the distributions of u and v from
+ * file, and set up everything needed to solve A.v = u for as many
+ * right-hand sides as we like.
+ *
+ * The right-hand side that comes with the u distribution is kept in
+ * cg->b; the values read along with v are not needed.
+ *
+ * input is INPUT_SERIAL to have processor 0 read and distribute the
+ * matrix, or INPUT_PARALLEL to have every processor read its own part.
+ * A compressed matrix file cannot be read in parallel, as it has no
+ * offsets to seek to, and is always read by processor 0.
+ */
+void cgsetup(int p, int s, const char *matrixfile, const char *ufilename,
+             const char *vfilename, int input, cgsolver *cg)
+{
+    int nz, i, nu, nv;
+    gidx n, *ia, *ja, *uindex, *vindex;
+    double *a, *u, *v;
+
+    /* Input of sparse matrix */
+    cgreadmatrix(p,s,matrixfile,input,&n,&nz,&ia,&ja,&a);
+
+    /* Read vector distributions */
+    bspinputvec(p,s,ufilename,&n,&nu,&uindex, &u);
+    HERE("Loaded distribution vec u (nu=%d).\n",nu);
+    for(i=0; i<nu; i++){
+        HERE("original input vec %" GIDX " = %lf\n", uindex[i], u[i]);
+    }
+
+    bspinputvec(p,s,vfilename,&n,&nv,&vindex, &v);
+    HERE("Loaded distribution vec v (nv=%d).\n",nv);
+    vecfreed(v);
+
+    cginit(p,s,n,nz,ia,ja,a,nu,uindex,nv,vindex,cg);
+    cg->b = u;
+
+} /* end cgsetup */
+
+/*
+ * Read the triples of the matrix for cgsetup and cgsetuppart, serially
+ * or in parallel, see INPUT_SERIAL and INPUT_PARALLEL.
+ */
+void cgreadmatrix(int p, int s, const char *matrixfile, int input, gidx *pn,
+                  int *pnz, gidx **pia, gidx **pja, double **pa)
+{
+    if (input == INPUT_PARALLEL && zkind(matrixfile) > ZIO_PLAIN){
+        if (s==0)
+            printf("Matrix file %s is compressed, reading it serially.\n",matrixfile);
+        input= INPUT_SERIAL;
+    }
+    if (input == INPUT_PARALLEL)
+        bspinput2triple_par((char*)matrixfile, p,s,pn,pnz,pia,pja,pa);
+    else
+        bspinput2triple((char*)matrixfile, p,s,pn,pnz,pia,pja,pa);
+    HERE("Done reading matrix file.\n");
+
+} /* end cgreadmatrix */
+
+/*
+ * As cgsetup, but without distribution files: read the matrix, which
+ * may be a plain Matrix Market file, and distribute it with one of the
+ * built-in partitioners, see partition.h.
+ */
+void cgsetuppart(int p, int s, const char *matrixfile, int input,
+                 int method, int twod, cgsolver *cg)
+{
+    int nz;
+    gidx n, *ia, *ja;
+    double *a;
+
+    cgreadmatrix(p,s,matrixfile,input,&n,&nz,&ia,&ja,&a);
+    cgpartition(p,s,n,nz,ia,ja,a,method,twod,cg);
+
+} /* end cgsetuppart */
+
+/*
+ * Distribute the triples, wherever they are, with bsppartition, and set
+ * up the solver. u and v get the same distribution; the right-hand side
+ * is the one bspinputvec makes for a distribution file without values.
+ * The nonzeros no longer arrive in the order of the matrix file, so
+ * perm is dropped and the values cannot be updated.
+ */
+void cgpartition(int p, int s, gidx n, int nz, gidx *ia, gidx *ja, double *a,
+                 int method, int twod, cgsolver *cg)
+{
+    int i, nv;
+    gidx *uindex, *vindex;
+    double *u;
+
+    bsppartition(p,s,n,method,twod,&nz,&ia,&ja,&a,&nv,&vindex);
+    uindex= vecallocg(nv);
+    u= vecallocd(nv);
+    for(i=0; i<nv; i++){
+        uindex[i]= vindex[i];
+        u[i]= ranindex(VECSEED,vindex[i]);
+    }
+
+    cginit(p,s,n,nz,ia,ja,a,nv,uindex,nv,vindex,cg);
+    cg->b = u;
+    vecfreei(cg->perm);
+    cg->perm = NULL;
+
+} /* end cgpartition */
+
+/*
+ * As cgsetup, but take the matrix and both distributions from a single
+ * binary container written by emm2bin. Each processor maps the file and
+ * reads its own part directly.
+ */
+void cgsetupbin(int p, int s, const char *filename, cgsolver *cg)
+{
+    int nz, nu, nv;
+    gidx n, *ia, *ja, *uindex, *vindex;
+    double *a, *u, *v;
+    char *map;
+    size_t len;
+
+    map = binmap(filename, &len);
+    bininput2triple(map, p,s,&n,&nz,&ia,&ja,&a);
+    HERE("Done reading binary matrix file.\n");
+    bininputvec(map, p,s,0,&nu,&uindex,&u);
+    bininputvec(map, p,s,1,&nv,&vindex,&v);
+    vecfreed(v);
+    binunmap(map, len);
+
+    cginit(p,s,n,nz,ia,ja,a,nu,uindex,nv,vindex,cg);
+    cg->b = u;
+
+} /* end cgsetupbin */
+
+/*
+ * As cgsetup, but generate the matrix in memory instead of reading it,
+ * as described by spec (see genparse), so no files are involved at all.
+ *
+ * Processor s generates the nonzeros in its own block of about n/p
+ * consecutive rows, with as many threads as the parser uses. With
+ * method PART_BLOCK in 1D that is the distribution, and s owns the same
+ * block of u and v; otherwise the nonzeros are redistributed by
+ * cgpartition. The right-hand side is the one bspinputvec makes for a
+ * distribution file without values, so a run on the same matrix written
+ * by genmat and read back gives the same system. No value file matches
+ * the order the nonzeros are generated in, so perm is dropped and the
+ * values cannot be updated.
+ */
+void cgsetupgen(int p, int s, const char *spec, int method, int twod,
+                cgsolver *cg)
+{
+    genparams g;
+    genblock blk[GENMAXTHREADS];
+    char msg[256];
+    int nt, t, nloc, i;
+    gidx lo, nzloc, off, *ia, *ja, *uindex, *vindex;
+    double *a, *u, *rowsum, *diag;
+
+    if (genparse(&g,spec) != 0)
+        bsp_abort("Error: cannot parse matrix description %s\n",spec);
+    if (gencheck(&g,msg,sizeof(msg)) != 0)
+        bsp_abort("Error: %s\n",msg);
+    if (s==0){
+        printf("Generating a ");
+        gendescribe(stdout,&g);
+        printf("\n");
+    }
+
+    /* my block of rows lo..lo+nloc-1 */
+    lo= s*(g.N/p) + (s < g.N%p ? s : g.N%p);
+    if (g.N/p + 1 > INT_MAX)
+        bsp_abort("Error: %" GIDX " rows do not fit on %d processors\n",g.N,p);
+    nloc= g.N/p + (s < g.N%p ? 1 : 0);
+
+    nt= parsethreads();
+    if (nt > GENMAXTHREADS)
+        nt= GENMAXTHREADS;
+    if (nt > nloc)
+        nt= (nloc > 0 ? nloc : 1);
+
+    /* first count, then generate into arrays of the right size */
+    rowsum= vecallocd(nloc);
+    diag= vecallocd(nloc);
+    for(t=0; t<nt; t++){
+        blk[t].g= &g;
+        blk[t].lo= lo + (gidx)nloc*t/nt;
+        blk[t].hi= lo + (gidx)nloc*(t+1)/nt;
+        blk[t].mode= GENCOUNT;
+        blk[t].rowsum= rowsum + (blk[t].lo - lo);
+        blk[t].diag= diag + (blk[t].lo - lo);
+    }
+    genround(blk,nt);
+    nzloc= 0;
+    for(t=0; t<nt; t++){
+        if (blk[t].bad >= 0)
+            bsp_abort("Error: row %" GIDX " of the matrix is not diagonally dominant; increase mu\n",
+                      blk[t].bad);
+        nzloc += blk[t].nz;
+    }
+    if (nzloc > INT_MAX)
+        bsp_abort("Error: processor %d has too many nonzeros\n",s);
+    vecfreed(rowsum);
+    vecfreed(diag);
+
+    ia= vecallocg(nzloc+1);
+    ja= vecallocg(nzloc+1);
+    a= vecallocd(nzloc+1);
+    off= 0;
+    for(t=0; t<nt; t++){
+        blk[t].mode= GENTRIPLES;
+        blk[t].ia= ia + off;
+        blk[t].ja= ja + off;
+        blk[t].a= a + off;
+        off += blk[t].nz;
+    }
+    genround(blk,nt);
+    HERE("Generated %" GIDX " nonzeros in rows %" GIDX "..%" GIDX ".\n",nzloc,lo,lo+nloc-1);
+    if (method != PART_BLOCK || twod){
+        cgpartition(p,s,g.N,(int)nzloc,ia,ja,a,method,twod,cg);
+        return;
+    }
+
+    uindex= vecallocg(nloc);
+    vindex= vecallocg(nloc);
+    u= vecallocd(nloc);
+    for(i=0; i<nloc; i++){
+        uindex[i]= vindex[i]= lo+i;
+        u[i]= ranindex(VECSEED,lo+i);
+    }
+
+    cginit(p,s,g.N,(int)nzloc,ia,ja,a,nloc,uindex,nloc,vindex,cg);
+    cg->b = u;
+    vecfreei(cg->perm);
+    cg->perm = NULL;
+
+} /* end cgsetupgen */
+
+/*
+ * Set up a solver from a matrix in triple format with global indices
+ * and the distributions of u and v, as delivered by bspinput2triple
+ * and bspinputvec. The solver takes ownership of all arrays passed in;
+ * ia and a are freed here, ja is reused for the ICRS increments.
+ */
+void cginit(int p, int s, gidx n, int nz, gidx *ia, gidx *ja, double *a,
+            int nu, gidx *uindex, int nv, gidx *vindex, cgsolver *cg)
+{
+    cg->p = p;
+    cg->s = s;
+    cg->n = n;
+
+    cg->nu = nu; cg->uindex = uindex;
+    cg->nv = nv; cg->vindex = vindex;
+    cg->b = NULL;
+
+    cgmatrix(cg,nz,ia,ja,a);
+
+    cg->method = METHOD_CG;
+    cg->kmax = KMAX;
+    cg->eps = EPS;
+    cg->restart = GMRESRESTART;
+    cg->ckpt = NULL;
+    cg->ckptfreq = CKPTFREQ;
+
+    cg->ndefl = 0;
+    cg->nlanczos = DEFLLANCZOS;
+    cg->maxdefl = DEFLMAX;
+    cg->nw = 0;
+    cg->W = cg->WU = cg->AW = NULL;
+    cg->E = NULL;
+
+    // and for moving vectors between the u and v distributions
+    cg->u2vproc = vecalloci(nu);
+    cg->u2vind  = vecalloci(nu);
+    cg->v2uproc = vecalloci(nv);
+    cg->v2uind  = vecalloci(nv);
+    bspvecmap(p,s,n,nu,uindex,nv,vindex,cg->u2vproc,cg->u2vind);
+    bspvecmap(p,s,n,nv,vindex,nu,uindex,cg->v2uproc,cg->v2uind);
+
+} /* end cginit */
+
+/*
+ * Give the solver its local nonzeros: convert the triples to ICRS and
+ * initialise the communication metadata of bspmv, for the vector
+ * distributions already in cg. As in cginit, ia and a are freed and ja
+ * is reused. Also used by balmove to rebuild the matrix after moving
+ * rows.
+ */
+void cgmatrix(cgsolver *cg, int nz, gidx *ia, gidx *ja, double *a)
+{
+    int s, k;
+    double *order;
+
+    s = cg->s;
+    cg->nz = nz;
+
+    /* Convert data structure to incremental compressed row storage.
+       We sort the original positions of the triples instead of their
+       values, which gives us the permutation that cgupdate needs. It
+       is only right if the triples are in the order of the matrix file,
+       as bspinputvalues assumes; callers that reorder them must drop
+       perm. */
+    order = vecallocd(nz+1);
+    for(k=0; k<nz; k++)
+        order[k] = k;
+    triple2icrs(cg->n,nz,ia,ja,order,1,&cg->nrows,&cg->ncols,&cg->rowindex,&cg->colindex,
+                &cg->inc);
+    HERE("Done converting to ICRS. nrows = %d, ncols = %d\n", cg->nrows, cg->ncols);
+    vecfreeg(ia);
+
+    cg->perm = vecalloci(nz+1);
+    for(k=0; k<nz; k++) {
+        cg->perm[(int)order[k]] = k;
+        order[k] = a[(int)order[k]];
+    }
+    vecfreed(a);
+    cg->a = order;
+    cg->af = NULL;
+
+    // alloc metadata arrays
+    cg->srcprocv  = vecalloci(cg->ncols);
+    cg->srcindv   = vecalloci(cg->ncols);
+    cg->destprocu = vecalloci(cg->nrows);
+    cg->destindu  = vecalloci(cg->nrows);
+
+    // initialise mv data structures for doing u <- A.v
+    bspmv_init(cg->p,cg->s,cg->n,cg->nrows,cg->ncols,cg->nv,cg->nu,cg->rowindex,
+               cg->colindex,cg->vindex,cg->uindex,cg->srcprocv,cg->srcindv,
+               cg->destprocu,cg->destindu);
+
+} /* end cgmatrix */
+
+/*
+ * Give the matrix new numerical values, keeping its sparsity pattern,
+ * distribution and all communication metadata.
+ *
+ * values[k] is the new value of the k'th local nonzero in the order of
+ * bspinput2triple, as read by bspinputvalues. Costs a single pass over
+ * the values, plus a refresh of the deflation space if there is one.
+ * Not possible when perm is NULL: once cgbalance or cgagglomerate has
+ * moved nonzeros between processors, or when they were never read in
+ * the order of a value file; cgserve refuses the request then.
+ */
+void cgupdate(cgsolver *cg, double *values)
+{
+    int k;
+
+    if (cg->perm == NULL)
+        bsp_abort("cgupdate: the order of the nonzeros is not known\n");
+    for(k=0; k<cg->nz; k++)
+        cg->a[cg->perm[k]] = values[k];
+
+    if (cg->af != NULL)
+        for(k=0; k<cg->nz; k++)
+            cg->af[k] = cg->a[k];
+
+    // W is still a good space, but A.W and E have changed.
+    deflrefresh(cg);
+
+} /* end cgupdate */
+
+/*
+ * Solve A.x = b using the conjugate gradient method.
+ *
+ * - b: right-hand side, in the u distribution
+ * - x0: initial guess in the v distribution, or NULL to start from x = 0
+ * - x: the solution, in the v distribution. May be the same array as x0.
+ * - stats: filled with the iteration count, final residual and timing
+ *
+ * If cg->ndefl > 0, the deflation space built up by earlier solves is
+ * projected out, and this solve adds its own Ritz vectors to it.
+ *
+ * If cg->ckpt is set, the iteration state is checkpointed every
+ * cg->ckptfreq iterations, and the solve resumes from an earlier
+ * checkpoint of the same matrix, distribution, b and x0 if it finds one.
+ */
+void cgsolve(cgsolver *cg, double *b, double *x0, double *x, cgstats *stats)
+{
+    int p, s, nu, nv, i, k, m, harvest, resumed;
+    gidx n;
+    double *r, *pvec, *w, time0, **V, *lalpha, *lbeta, ckrho, ckrho_old;
+    long double rho, alpha, gamma, rho_old, beta;
+    ckptwriter *ck;
+
+    p = cg->p; s = cg->s; n = cg->n;
+    nu = cg->nu; nv = cg->nv;
+
+    bsp_sync();
+    time0 = bsp_time();
+
+    r    = vecallocd(nu);
+    pvec = vecallocd(nv);
+    w    = vecallocd(nu);
+
+    k = 0; // iteration number
+    ck = NULL;
+    resumed = 0;
+    if (cg->ckpt != NULL) {
+        ck = ckptopen(cg, b, x0);
+        resumed = ckptload(ck, &k, &ckrho, &ckrho_old, x, r, pvec);
+    }
+
+    // room for the Lanczos information we harvest Ritz vectors from
+    harvest = (cg->ndefl > 0 && cg->nw < cg->maxdefl && !resumed);
+    V = NULL; lalpha = lbeta = NULL;
+    m = 0;
+    if (cg->ndefl > 0)
+        deflalloc(cg);
+    if (harvest) {
+        V = matallocd(cg->nlanczos, nu);
+        lalpha = vecallocd(cg->nlanczos);
+        lbeta  = vecallocd(cg->nlanczos);
+    }
+
+    if (resumed) {
+        // x, r and p come from the checkpoint
+        rho = ckrho;
+        rho_old = ckrho_old;
+    } else if (x0 == NULL) {
+        // our guess for x = 0, so r := b - Ax
+        // corresponds to copying b into r
+        zero(nv,x);
+        for(i=0; i< nu; i++) {
+            r[i] = b[i];
+        }
+    } else {
+        if (x != x0)
+            for(i=0; i<nv; i++)
+                x[i] = x0[i];
+        // r := b - Ax
+        bspmv(p,s,n,cg->nz,cg->nrows,cg->ncols,cg->a,cg->inc,cg->srcprocv,cg->srcindv,
+              cg->destprocu,cg->destindu,nv,nu,x,w,NULL);
+        local_axpy(nu,-1.0,w,b,
+                               r);
+    }
+    if (!resumed) {
+        deflstart(cg, x, r);
+        rho = bspipsame(p,s,nu,r,r);
+        rho_old = 0; // just kills a warning.
+    }
+
+    HERE("rho (r.r) turned out to be = %Lf\n", rho);
+    while ( k < cg->kmax &&
+            sqrt(rho) > cg->eps * bspipsame(p,s,nv,x,x)) {
+        if(s==0)
+            printf("[Iteration %02d] rho  = %e\n", k+1, (double)sqrt(rho));
+        if ( k == 0 ) {
+            // do p := r
+            copyvec(s,nu,nv,r,pvec,cg->u2vproc,cg->u2vind);
+        } else {
+            beta = rho/rho_old;
+            // p:= r + beta*p
+            scalevec(nv, beta, pvec);
+            addvec(nv,pvec,nu,r,cg->v2uproc,cg->v2uind);
+        }
+        // p := p - W.mu, keeping p A-orthogonal to the deflation space
+        defldirection(cg, r, pvec);
+
+        if (harvest && k < cg->nlanczos) {
+            // keep the Lanczos vector r/||r||
+            for(i=0; i<nu; i++)
+                V[k][i] = r[i]/sqrt(rho);
+            lbeta[k] = (k == 0 ? 0.0 : rho/rho_old);
+        }
+
+        // w := Ap
+        bspmv(p,s,n,cg->nz,cg->nrows,cg->ncols,cg->a,cg->inc,cg->srcprocv,cg->srcindv,
+              cg->destprocu,cg->destindu,nv,nu,pvec,w,NULL);
+
+        // gamma = p.w
+        gamma = bspip(p,s,nv,nu,pvec,w,cg->v2uproc,cg->v2uind);
+
+        alpha = rho/gamma;
+        if (harvest && k < cg->nlanczos) {
+            lalpha[k] = alpha;
+            m = k+1;
+        }
+
+        // x := x + alpha*p
+        local_axpy(nv,alpha,pvec,x,
+                                 x);
+
+        // r := r - alpha*w
+        local_axpy(nu,-alpha,w,r,
+                               r);
+
+        rho_old = rho;
+        // rho := ||rho||^2
+        rho = bspipsame(p,s,nu,r,r);
+
+        k++;
+        if (ck != NULL && k % cg->ckptfreq == 0)
+            ckptsave(ck, k, rho, rho_old, x, r, pvec);
+    }
+
+    // postcondition:
+    // x s.t. A.x = b
+
+    bsp_sync();
+    stats->time = bsp_time() - time0;
+    stats->iters = k;
+    stats->outer = 0;
+    stats->converged = (k < cg->kmax);
+    stats->residual = sqrt(rho);
+    if (ck != NULL)
+        ckptclose(ck, stats->converged);
+
+    if (harvest) {
+        deflharvest(cg, m, V, lalpha, lbeta);
+        HERE("Deflation space now has %d vectors.\n", cg->nw);
+        matfreed(V);
+        vecfreed(lalpha); vecfreed(lbeta);
+    }
+
+    vecfreed(w); vecfreed(pvec);
+    vecfreed(r);
+
+} /* end cgsolve */
+
+/*
+ * Solve A.x = b with the method selected in cg->method. Parameters are
+ * the same as for cgsolve.
+ */
+void bspsolve(cgsolver *cg, double *b, double *x0, double *x, cgstats *stats)
+{
+    switch (cg->method) {
+        case METHOD_MIXED:
+            cgsolve_mixed(cg, b, x0, x, stats);
+            break;
+        case METHOD_BICGSTAB:
+            bicgstab(cg, b, x0, x, stats);
+            break;
+        case METHOD_GMRES:
+            gmres(cg, b, x0, x, stats);
+            break;
+        default:
+            cgsolve(cg, b, x0, x, stats);
+    }
+}
+
+/*
+ * Short name of a solution method, as used on the command line and in
+ * the CSV output.
+ */
+const char *methodname(int method)
+{
+    switch (method) {
+        case METHOD_MIXED:
+            return "mixed";
+        case METHOD_BICGSTAB:
+            return "bicgstab";
+        case METHOD_GMRES:
+            return "gmres";
+        default:
+            return "cg";
+    }
+}
+
+/*
+ * Look up a solution method by its short name; returns -1 if there is
+ * no such method.
+ */
+int methodbyname(const char *name)
+{
+    int method;
+
+    for (method = METHOD_CG; method <= METHOD_GMRES; method++)
+        if (strcmp(name, methodname(method)) == 0)
+            return method;
+    return -1;
+}
+
+/*
+ * Release everything owned by the solver.
+ */
+void cgfree(cgsolver *cg)
+{
+    vecfreei(cg->destindu); vecfreei(cg->destprocu);
+    vecfreei(cg->srcindv);  vecfreei(cg->srcprocv);
+    vecfreed(cg->b);
+    vecfreei(cg->u2vproc);  vecfreei(cg->u2vind);
+    vecfreei(cg->v2uproc);  vecfreei(cg->v2uind);
+    vecfreeg(cg->uindex);   vecfreeg(cg->vindex);
+    vecfreeg(cg->rowindex); vecfreeg(cg->colindex);
+    vecfreei(cg->inc);      vecfreed(cg->a);
+    vecfreei(cg->perm);
+    vecfreef(cg->af);
+    deflfree(cg);
+
+} /* end cgfree */
@@ -0,0 +1,141 @@
+#ifndef __CGSOLVER
+#define __CGSOLVER
+
+#include "gidx.h"
+
+#define EPS (10E-12)
+#define KMAX (1500)
+
+#define DEFLMAX (32)      /* maximum size of the deflation space */
+#define DEFLLANCZOS (40)  /* Lanczos vectors kept per solve for harvesting */
+#define DEFLTOL (1E-10)   /* relative pivot below which E is singular */
+
+#define MIXEDTOL (1E-4)   /* residual reduction of each inner solve */
+#define MIXEDOUTER (30)   /* maximum number of refinement steps */
+
+#define CKPTFREQ (100)    /* default iterations between checkpoints */
+#define CKPTPRINT (5)     /* numbers in the fingerprint of a solve */
+
+#define GMRESRESTART (30) /* default restart length of GMRES */
+#define GMRESCANCEL (1E-4) /* recompute ||w|| if Gram-Schmidt cancels more */
+
+/* solution methods */
+#define METHOD_CG (0)     /* conjugate gradients, see cgsolve */
+#define METHOD_MIXED (1)  /* mixed precision refinement, see mixed.c */
+#define METHOD_BICGSTAB (2) /* BiCGStab, see nonsym.c */
+#define METHOD_GMRES (3)  /* restarted GMRES, see nonsym.c */
+
+/*
+ * A distributed CG solver, split in a setup phase and a solve phase.
+ *
+ * cgsetup reads the matrix and vector distributions, converts the
+ * matrix to ICRS and initialises the communication metadata for
+ * bspmv. After that, cgsolve can be called as often as needed, each
+ * time with a new right-hand side, without paying for the setup again.
+ *
+ * Naming follows bspmv: u := A.v, so right-hand sides and residuals
+ * live in the u distribution, solutions and search directions in the
+ * v distribution.
+ */
+
+typedef struct {
+    int p, s;            /* number of processors, my processor id */
+    gidx n;              /* global matrix size */
+    int nz;              /* local number of nonzeros */
+    int nrows, ncols;    /* local nonempty rows and columns */
+    double *a;           /* ICRS numerical values, length nz+1 */
+    float *af;           /* single precision copy of a, made on demand */
+    int *inc;            /* ICRS increments, length nz+1 */
+    gidx *rowindex;      /* global index of local row i */
+    gidx *colindex;      /* global index of local column j */
+    int *perm;           /* position in a of the k'th nonzero as read, or NULL */
+
+    int nu; gidx *uindex; /* local part of the u distribution */
+    int nv; gidx *vindex; /* local part of the v distribution */
+    int *u2vproc, *u2vind; /* where each local u component is in v */
+    int *v2uproc, *v2uind; /* where each local v component is in u */
+
+    /* communication metadata, see bspmv_init */
+    int *srcprocv, *srcindv, *destprocu, *destindu;
+
+    double *b;           /* the right-hand side read along with u */
+
+    int method;          /* METHOD_CG, METHOD_MIXED, ... */
+    int kmax;            /* maximum number of iterations */
+    double eps;          /* tolerance of the stopping criterion */
+    int restart;         /* restart length of GMRES */
+
+    /* checkpointing of cgsolve, see checkpoint.c */
+    const char *ckpt;    /* checkpoint file prefix, NULL: off */
+    int ckptfreq;        /* iterations between checkpoints */
+
+    /* deflation, see deflate.c */
+    int ndefl;           /* Ritz vectors to harvest per solve, 0: off */
+    int nlanczos;        /* Lanczos vectors kept per solve */
+    int maxdefl;         /* maximum size of the deflation space */
+    int nw;              /* current size of the deflation space */
+    double **W;          /* deflation vectors, v distribution */
+    double **WU;         /* the same vectors in the u distribution */
+    double **AW;         /* A.W, u distribution */
+    double *E;           /* Cholesky factor of W^T.A.W, nw by nw */
+} cgsolver;
+
+typedef struct {
+    int iters;           /* number of (inner) iterations done */
+    int outer;           /* refinement steps or GMRES cycles, 0 for CG */
+    int converged;       /* did we stop before kmax? */
+    double residual;     /* norm of the final residual */
+    double time;         /* time spent in cgsolve */
+} cgstats;
+
+void cgsetup(int p, int s, const char *matrixfile, const char *ufilename,
+             const char *vfilename, int input, cgsolver *cg);
+void cgsetupbin(int p, int s, const char *filename, cgsolver *cg);
+void cgsetupgen(int p, int s, const char *spec, int method, int twod,
+                cgsolver *cg);
+void cgreadmatrix(int p, int s, const char *matrixfile, int input, gidx *pn,
+                  int *pnz, gidx **pia, gidx **pja, double **pa);
+void cgsetuppart(int p, int s, const char *matrixfile, int input,
+                 int method, int twod, cgsolver *cg);
+void cgpartition(int p, int s, gidx n, int nz, gidx *ia, gidx *ja, double *a,
+                 int method, int twod, cgsolver *cg);
+void cginit(int p, int s, gidx n, int nz, gidx *ia, gidx *ja, double *a,
+            int nu, gidx *uindex, int nv, gidx *vindex, cgsolver *cg);
+void cgmatrix(cgsolver *cg, int nz, gidx *ia, gidx *ja, double *a);
+void cgupdate(cgsolver *cg, double *values);
+void cgsolve(cgsolver *cg, double *b, double *x0, double *x, cgstats *stats);
+void bspsolve(cgsolver *cg, double *b, double *x0, double *x, cgstats *stats);
+const char *methodname(int method);
+int methodbyname(const char *name);
+void cgfree(cgsolver *cg);
+
+/* deflate.c */
+void deflalloc(cgsolver *cg);
+void deflstart(cgsolver *cg, double *x, double *r);
+void defldirection(cgsolver *cg, double *r, double *pvec);
+void deflharvest(cgsolver *cg, int m, double **V, double *alpha, double *beta);
+void deflrefresh(cgsolver *cg);
+void deflfree(cgsolver *cg);
+
+/* mixed.c */
+void cgsolve_mixed(cgsolver *cg, double *b, double *x0, double *x, cgstats *stats);
+
+/* nonsym.c */
+double localip(int n, double *x, double *y);
+void bicgstab(cgsolver *cg, double *b, double *x0, double *x, cgstats *stats);
+void gmres(cgsolver *cg, double *b, double *x0, double *x, cgstats *stats);
+
+/* checkpoint.c */
+typedef struct ckptwriter ckptwriter;
+ckptwriter *ckptopen(cgsolver *cg, double *b, double *x0);
+int ckptload(ckptwriter *ck, int *k, double *rho, double *rho_old,
+             double *x, double *r, double *pvec);
+void ckptsave(ckptwriter *ck, int k, double rho, double rho_old,
+              double *x, double *r, double *pvec);
+void ckptclose(ckptwriter *ck, int converged);
+
+/* multishift.c */
+int cgsolve_shifts(cgsolver *cg, double *b, int nshift, double *shift,
+                   double **x, cgstats *stats);
+
+#endif
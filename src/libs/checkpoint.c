@@ -0,0 +1,332 @@
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include "bspedupack.h"
+#include "bspfuncs.h"
+#include "vecio.h"
+#include "paullib.h"
+#include "cgsolver.h"
+#include "debug.h"
+
+/*
+ * Checkpoint/restart of the CG iteration state.
+ *
+ * Every cg->ckptfreq iterations, each processor writes k, rho, rho_old
+ * and its local parts of x, r and p to its own binary file
+ *
+ *   PREFIX.SLOT.s      (SLOT = 0 or 1, s = processor id)
+ *
+ * The state is copied to a buffer and written by a separate thread, so
+ * the iteration carries on while the disk works. Two slots are used in
+ * turn: a checkpoint is only referenced once all processors have
+ * finished writing it, and the files it is made of are not touched until
+ * the next one is complete. The small text file PREFIX.manifest records
+ * the iteration and slot of the latest complete checkpoint; it is
+ * replaced atomically by processor 0.
+ *
+ * The manifest also holds a fingerprint of the solve: the number of
+ * nonzeros and weighted sums of the matrix, the distribution, b and x0
+ * (see ckptprint). A solve only resumes from a manifest with the same
+ * number of processors, size and fingerprint, so a checkpoint of
+ * another matrix or right-hand side, or of an earlier server request,
+ * is ignored. A solve that converges removes its checkpoint files.
+ */
+
+typedef struct {
+    int k, p, s, nu, nv;
+    double rho, rho_old;
+} ckptheader;
+
+struct ckptwriter {
+    cgsolver *cg;
+    pthread_t thread;
+    int pending;       /* is there a write that is not committed yet? */
+    int running;       /* is a writer thread active? */
+    int ok;            /* did the last write succeed? */
+    int slot;          /* slot of the checkpoint being written */
+    int lastk;         /* iteration of the checkpoint being written */
+    ckptheader hdr;
+    double *buf;       /* copy of x, r and p */
+    double print[CKPTPRINT]; /* fingerprint of the solve */
+};
+
+/*
+ * Fingerprint of a solve of A.x = b from x0, the same on all
+ * processors: the number of nonzeros, and sums of the values of A, b
+ * and x0 and of the owners of u and v, each weighted by a hash of the
+ * global indices. Needs one superstep.
+ */
+void ckptprint(cgsolver *cg, double *b, double *x0, double *print)
+{
+    int s, i, j, k;
+
+    s = cg->s;
+    for (k = 0; k < CKPTPRINT; k++)
+        print[k] = 0.0;
+    print[0] = cg->nz;
+
+    k = 0;
+    j = cg->inc[0];
+    for (i = 0; i < cg->nrows; i++) {
+        while (j < cg->ncols) {
+            print[1] += cg->a[k] *
+                ranindex((unsigned long long)cg->rowindex[i], cg->colindex[j]);
+            k++;
+            j += cg->inc[k];
+        }
+        j -= cg->ncols;
+    }
+    for (i = 0; i < cg->nu; i++) {
+        print[2] += b[i] * ranindex(1, cg->uindex[i]);
+        print[3] += (s+1) * ranindex(2, cg->uindex[i]);
+    }
+    for (i = 0; i < cg->nv; i++) {
+        print[3] += (s+1) * ranindex(3, cg->vindex[i]);
+        if (x0 != NULL)
+            print[4] += x0[i] * ranindex(4, cg->vindex[i]);
+    }
+    bspreduce(cg->p, s, CKPTPRINT, print);
+}
+
+/*
+ * Name of the file of processor s in the given slot.
+ */
+void ckptname(char *name, const char *prefix, int slot, int s)
+{
+    snprintf(name, 2*STRLEN, "%s.%d.%d", prefix, slot, s);
+}
+
+/*
+ * Writer thread: dump the buffered state to disk.
+ */
+void *ckptwrite(void *arg)
+{
+    ckptwriter *ck;
+    char name[2*STRLEN];
+    FILE *fp;
+    size_t len;
+
+    ck = arg;
+    len = ck->hdr.nv + ck->hdr.nu + ck->hdr.nv;
+    ckptname(name, ck->cg->ckpt, ck->slot, ck->hdr.s);
+
+    ck->ok = 0;
+    if ((fp = fopen(name, "wb")) == NULL)
+        return NULL;
+    if (fwrite(&ck->hdr, sizeof(ckptheader), 1, fp) == 1 &&
+            fwrite(ck->buf, SZDBL, len, fp) == len)
+        ck->ok = 1;
+    if (fclose(fp) != 0)
+        ck->ok = 0;
+    return NULL;
+}
+
+/*
+ * Wait for the pending write, and if it succeeded on every processor,
+ * let processor 0 point the manifest at it. Needs one superstep.
+ */
+void ckptcommit(ckptwriter *ck)
+{
+    cgsolver *cg;
+    char name[2*STRLEN], tmpname[2*STRLEN];
+    int s, k;
+    double ok;
+    FILE *fp;
+
+    cg = ck->cg;
+    s = cg->s;
+    if (ck->running) {
+        pthread_join(ck->thread, NULL);
+        ck->running = 0;
+    }
+    ok = (ck->pending ? ck->ok : 0);
+    ck->pending = 0;
+    bspreduce(cg->p, cg->s, 1, &ok);
+    if (ok < cg->p)
+        return;
+
+    if (s == 0) {
+        snprintf(name, 2*STRLEN, "%s.manifest", cg->ckpt);
+        snprintf(tmpname, 2*STRLEN, "%s.manifest.tmp", cg->ckpt);
+        if ((fp = fopen(tmpname, "w")) == NULL) {
+            fprintf(stderr, "Warning: cannot write checkpoint manifest %s\n", tmpname);
+            return;
+        }
+        fprintf(fp, "%d %d %d %" GIDX, ck->lastk, ck->slot, cg->p, cg->n);
+        for (k = 0; k < CKPTPRINT; k++)
+            fprintf(fp, " %.17g", ck->print[k]);
+        fprintf(fp, "\n");
+        fclose(fp);
+        rename(tmpname, name);
+        HERE("Checkpoint of iteration %d complete.\n", ck->lastk);
+    }
+}
+
+/*
+ * Prepare for checkpointing the solve of A.x = b from x0 (or NULL)
+ * with cg->ckpt as file prefix.
+ */
+ckptwriter *ckptopen(cgsolver *cg, double *b, double *x0)
+{
+    ckptwriter *ck;
+
+    ck = malloc(sizeof(ckptwriter));
+    if (ck == NULL)
+        bsp_abort("ckptopen: not enough memory");
+    ck->cg = cg;
+    ck->pending = 0;
+    ck->running = 0;
+    ck->ok = 0;
+    ck->slot = 1;
+    ck->lastk = -1;
+    ck->buf = vecallocd(cg->nv + cg->nu + cg->nv);
+    ckptprint(cg, b, x0, ck->print);
+    return ck;
+}
+
+/*
+ * Resume from the latest checkpoint, if there is one. Returns 1 and
+ * fills in the state if so, or 0 if there is nothing to resume from.
+ */
+int ckptload(ckptwriter *ck, int *k, double *rho, double *rho_old,
+             double *x, double *r, double *pvec)
+{
+    cgsolver *cg;
+    char name[2*STRLEN];
+    double info[3], mprint[CKPTPRINT], ok;
+    int mk, mslot, mp, i, match;
+    gidx mn;
+    ckptheader hdr;
+    FILE *fp;
+
+    cg = ck->cg;
+
+    // processor 0 reads the manifest, and tells the others.
+    info[0] = info[1] = info[2] = 0.0;
+    if (cg->s == 0) {
+        snprintf(name, 2*STRLEN, "%s.manifest", cg->ckpt);
+        if ((fp = fopen(name, "r")) != NULL) {
+            match = (fscanf(fp, "%d %d %d %" SCNGIDX, &mk, &mslot, &mp, &mn) == 4 &&
+                     mp == cg->p && mn == cg->n);
+            for (i = 0; match && i < CKPTPRINT; i++)
+                match = (fscanf(fp, "%lg", &mprint[i]) == 1 && mprint[i] == ck->print[i]);
+            if (match) {
+                info[0] = 1.0; info[1] = mk; info[2] = mslot;
+            } else {
+                fprintf(stderr, "Warning: ignoring checkpoint %s, it does not match "
+                        "this matrix, distribution, right-hand side and guess\n", name);
+            }
+            fclose(fp);
+        }
+    }
+    bspreduce(cg->p, cg->s, 3, info);
+    if (info[0] == 0.0)
+        return 0;
+
+    mk = info[1];
+    mslot = info[2];
+    ckptname(name, cg->ckpt, mslot, cg->s);
+    ok = 0.0;
+    fp = fopen(name, "rb");
+    if (fp != NULL && fread(&hdr, sizeof(ckptheader), 1, fp) == 1 &&
+            hdr.k == mk && hdr.p == cg->p && hdr.s == cg->s &&
+            hdr.nu == cg->nu && hdr.nv == cg->nv)
+        ok = 1.0;
+    // the files must match on every processor, or nobody resumes.
+    bspreduce(cg->p, cg->s, 1, &ok);
+    if (ok < cg->p) {
+        if (fp != NULL)
+            fclose(fp);
+        if (cg->s == 0)
+            fprintf(stderr, "Warning: ignoring checkpoint %s.manifest, its files do not "
+                    "match it\n", cg->ckpt);
+        return 0;
+    }
+    if (fread(x, SZDBL, cg->nv, fp) != (size_t)cg->nv ||
+            fread(r, SZDBL, cg->nu, fp) != (size_t)cg->nu ||
+            fread(pvec, SZDBL, cg->nv, fp) != (size_t)cg->nv)
+        bsp_abort("Error: checkpoint file %s is truncated\n", name);
+    fclose(fp);
+
+    *k = hdr.k;
+    *rho = hdr.rho;
+    *rho_old = hdr.rho_old;
+
+    // the next checkpoint must not overwrite this one.
+    ck->slot = mslot;
+    ck->lastk = mk;
+    if (cg->s == 0)
+        printf("Resuming from the checkpoint of iteration %d\n", mk);
+    return 1;
+}
+
+/*
+ * Start writing a checkpoint of the state after iteration k. Commits the
+ * previous checkpoint first, which only waits if its write is still
+ * in progress.
+ */
+void ckptsave(ckptwriter *ck, int k, double rho, double rho_old,
+              double *x, double *r, double *pvec)
+{
+    cgsolver *cg;
+    int nu, nv;
+
+    cg = ck->cg;
+    nu = cg->nu; nv = cg->nv;
+
+    ckptcommit(ck);
+
+    ck->slot = 1 - ck->slot;
+    ck->lastk = k;
+    ck->hdr.k = k;
+    ck->hdr.p = cg->p;
+    ck->hdr.s = cg->s;
+    ck->hdr.nu = nu;
+    ck->hdr.nv = nv;
+    ck->hdr.rho = rho;
+    ck->hdr.rho_old = rho_old;
+    memcpy(ck->buf, x, nv*SZDBL);
+    memcpy(ck->buf+nv, r, nu*SZDBL);
+    memcpy(ck->buf+nv+nu, pvec, nv*SZDBL);
+
+    ck->pending = 1;
+    if (pthread_create(&ck->thread, NULL, ckptwrite, ck) == 0) {
+        ck->running = 1;
+    } else {
+        // no thread, write it ourselves.
+        ckptwrite(ck);
+        ck->running = 0;
+    }
+}
+
+/*
+ * Finish checkpointing at the end of a solve. The last checkpoint is
+ * committed, or, if the solve converged, all checkpoint files are
+ * removed.
+ */
+void ckptclose(ckptwriter *ck, int converged)
+{
+    cgsolver *cg;
+    char name[2*STRLEN];
+    int slot;
+
+    cg = ck->cg;
+    if (!converged) {
+        ckptcommit(ck);
+    } else {
+        if (ck->running) {
+            pthread_join(ck->thread, NULL);
+            ck->running = 0;
+        }
+        for (slot=0; slot<2; slot++) {
+            ckptname(name, cg->ckpt, slot, cg->s);
+            unlink(name);
+        }
+        if (cg->s == 0) {
+            snprintf(name, 2*STRLEN, "%s.manifest", cg->ckpt);
+            unlink(name);
+        }
+    }
+    vecfreed(ck->buf);
+    free(ck);
+}
@@ -0,0 +1,352 @@
+#include "bspedupack.h"
+#include "bspfuncs.h"
+#include "paullib.h"
+#include "cgsolver.h"
+#include "debug.h"
+
+/*
+ * Deflated CG for sequences of systems with the same matrix.
+ *
+ * Every solve keeps its first few residuals r_j/||r_j||, which are
+ * Lanczos vectors, together with CG's alpha and beta coefficients.
+ * From these we build the Lanczos tridiagonal matrix T, and the
+ * eigenvectors of T belonging to its smallest eigenvalues give Ritz
+ * vectors approximating the slowest eigenmodes of A. These are added
+ * to a deflation space W, which later solves project out:
+ *
+ *   x0 := x0 + W E^-1 W^T r0,   with E = W^T A W,
+ *   p  := r + beta p - W E^-1 (AW)^T r   each iteration.
+ *
+ * W is kept in the v distribution and, to avoid moving vectors around
+ * for every inner product, also in the u distribution (WU). All
+ * projections need the small dense matrix E and one bspreduce.
+ */
+
+/*
+ * In-place Cholesky factorisation of a small dense symmetric positive
+ * definite n by n matrix, stored row-wise. On return, the lower triangle
+ * holds L with A = L L^T. Returns the index of the first pivot that is
+ * not safely positive, or -1 if the factorisation succeeded.
+ */
+int cholesky(int n, double *a)
+{
+    int i, j, k;
+    double d;
+
+    for(j=0; j<n; j++) {
+        d = a[j*n+j];
+        for(k=0; k<j; k++)
+            d -= a[j*n+k]*a[j*n+k];
+        if (d <= DEFLTOL * fabs(a[j*n+j]) || d <= 0.0)
+            return j;
+        a[j*n+j] = sqrt(d);
+        for(i=j+1; i<n; i++) {
+            d = a[i*n+j];
+            for(k=0; k<j; k++)
+                d -= a[i*n+k]*a[j*n+k];
+            a[i*n+j] = d/a[j*n+j];
+        }
+    }
+    return -1;
+}
+
+/*
+ * Solve L L^T y = b for y, overwriting b, with L from cholesky.
+ */
+void cholsolve(int n, double *l, double *b)
+{
+    int i, k;
+
+    for(i=0; i<n; i++) {
+        for(k=0; k<i; k++)
+            b[i] -= l[i*n+k]*b[k];
+        b[i] /= l[i*n+i];
+    }
+    for(i=n-1; i>=0; i--) {
+        for(k=i+1; k<n; k++)
+            b[i] -= l[k*n+i]*b[k];
+        b[i] /= l[i*n+i];
+    }
+}
+
+/*
+ * Eigenvalues and eigenvectors of a small dense symmetric n by n matrix
+ * using cyclic Jacobi rotations. a is destroyed; on return evals[i] is
+ * the i'th eigenvalue and column i of evecs (row-wise, n by n) the
+ * corresponding eigenvector.
+ */
+void jacobieigen(int n, double *a, double *evals, double *evecs)
+{
+    int i, j, k, sweep;
+    double off, theta, t, c, sn, akp, akq, apq, app, aqq;
+
+    for(i=0; i<n; i++)
+        for(j=0; j<n; j++)
+            evecs[i*n+j] = (i==j ? 1.0 : 0.0);
+
+    for(sweep=0; sweep<100; sweep++) {
+        off = 0.0;
+        for(i=0; i<n; i++)
+            for(j=i+1; j<n; j++)
+                off += a[i*n+j]*a[i*n+j];
+        if (off < 1e-30)
+            break;
+
+        for(i=0; i<n; i++) {
+            for(j=i+1; j<n; j++) {
+                apq = a[i*n+j];
+                if (fabs(apq) < 1e-300)
+                    continue;
+                app = a[i*n+i];
+                aqq = a[j*n+j];
+                theta = (aqq-app)/(2.0*apq);
+                t = (theta >= 0 ? 1.0 : -1.0)/(fabs(theta)+sqrt(theta*theta+1.0));
+                c = 1.0/sqrt(t*t+1.0);
+                sn = t*c;
+
+                for(k=0; k<n; k++) {
+                    akp = a[k*n+i];
+                    akq = a[k*n+j];
+                    a[k*n+i] = c*akp - sn*akq;
+                    a[k*n+j] = sn*akp + c*akq;
+                }
+                for(k=0; k<n; k++) {
+                    akp = a[i*n+k];
+                    akq = a[j*n+k];
+                    a[i*n+k] = c*akp - sn*akq;
+                    a[j*n+k] = sn*akp + c*akq;
+                }
+                for(k=0; k<n; k++) {
+                    akp = evecs[k*n+i];
+                    akq = evecs[k*n+j];
+                    evecs[k*n+i] = c*akp - sn*akq;
+                    evecs[k*n+j] = sn*akp + c*akq;
+                }
+            }
+        }
+    }
+
+    for(i=0; i<n; i++)
+        evals[i] = a[i*n+i];
+}
+
+/*
+ * Allocate room for the deflation space. Called by cgsolve when
+ * deflation is switched on.
+ */
+void deflalloc(cgsolver *cg)
+{
+    if (cg->W != NULL)
+        return;
+    cg->W  = matallocd(cg->maxdefl, cg->nv);
+    cg->WU = matallocd(cg->maxdefl, cg->nu);
+    cg->AW = matallocd(cg->maxdefl, cg->nu);
+    cg->E  = vecallocd(cg->maxdefl*cg->maxdefl);
+    cg->nw = 0;
+}
+
+/*
+ * Local parts of the inner products of the vectors in V with r, all in
+ * the u distribution, summed over all processors in one superstep.
+ */
+void multiip(cgsolver *cg, double **V, double *r, double *c)
+{
+    int i, k;
+
+    for(k=0; k<cg->nw; k++) {
+        c[k] = 0.0;
+        for(i=0; i<cg->nu; i++)
+            c[k] += V[k][i]*r[i];
+    }
+    bspreduce(cg->p, cg->s, cg->nw, c);
+}
+
+/*
+ * Project the deflation space out of the starting vector:
+ *   c := E^-1 W^T r,  x := x + W c,  r := r - AW c.
+ */
+void deflstart(cgsolver *cg, double *x, double *r)
+{
+    int i, k;
+    double *c;
+
+    if (cg->nw == 0)
+        return;
+
+    c = vecallocd(cg->nw);
+    multiip(cg, cg->WU, r, c);
+    cholsolve(cg->nw, cg->E, c);
+    for(k=0; k<cg->nw; k++) {
+        for(i=0; i<cg->nv; i++)
+            x[i] += c[k]*cg->W[k][i];
+        for(i=0; i<cg->nu; i++)
+            r[i] -= c[k]*cg->AW[k][i];
+    }
+    vecfreed(c);
+}
+
+/*
+ * Keep the search direction A-orthogonal to the deflation space:
+ *   p := p - W E^-1 (AW)^T r.
+ */
+void defldirection(cgsolver *cg, double *r, double *pvec)
+{
+    int i, k;
+    double *c;
+
+    if (cg->nw == 0)
+        return;
+
+    c = vecallocd(cg->nw);
+    multiip(cg, cg->AW, r, c);
+    cholsolve(cg->nw, cg->E, c);
+    for(k=0; k<cg->nw; k++)
+        for(i=0; i<cg->nv; i++)
+            pvec[i] -= c[k]*cg->W[k][i];
+    vecfreed(c);
+}
+
+/*
+ * Drop deflation vector k, moving the last one in its place.
+ */
+void deflremove(cgsolver *cg, int k)
+{
+    double *tmp;
+
+    cg->nw--;
+    tmp = cg->W[k];  cg->W[k] = cg->W[cg->nw];   cg->W[cg->nw] = tmp;
+    tmp = cg->WU[k]; cg->WU[k] = cg->WU[cg->nw]; cg->WU[cg->nw] = tmp;
+    tmp = cg->AW[k]; cg->AW[k] = cg->AW[cg->nw]; cg->AW[cg->nw] = tmp;
+}
+
+/*
+ * Compute E = W^T A W with a single reduction and factorise it.
+ * Vectors that make E (numerically) singular are dropped.
+ */
+void deflgram(cgsolver *cg)
+{
+    int s, i, k, l, nw, bad;
+    double *E;
+
+    s = cg->s;
+
+    while (cg->nw > 0) {
+        nw = cg->nw;
+        E = cg->E;
+        for(k=0; k<nw; k++)
+            for(l=0; l<nw; l++) {
+                E[k*nw+l] = 0.0;
+                for(i=0; i<cg->nu; i++)
+                    E[k*nw+l] += cg->WU[k][i]*cg->AW[l][i];
+            }
+        bspreduce(cg->p, cg->s, nw*nw, E);
+
+        // symmetrise, to be robust against rounding.
+        for(k=0; k<nw; k++)
+            for(l=0; l<k; l++)
+                E[k*nw+l] = E[l*nw+k] = 0.5*(E[k*nw+l]+E[l*nw+k]);
+
+        if ((bad = cholesky(nw, E)) < 0)
+            return;
+        HERE("Dropping dependent deflation vector %d\n", bad);
+        deflremove(cg, bad);
+    }
+}
+
+/*
+ * Harvest Ritz vectors from the Lanczos information of a finished solve
+ * and add them to the deflation space.
+ *
+ * - m: number of Lanczos vectors kept
+ * - V: V[j] = r_j/||r_j||, in the u distribution
+ * - alpha, beta: the CG coefficients; beta[j] = rho_j/rho_{j-1} is the
+ *   one used to build p_j, beta[0] is not used.
+ */
+void deflharvest(cgsolver *cg, int m, double **V, double *alpha, double *beta)
+{
+    int s, i, j, k, l, nnew, *chosen;
+    double *T, *evals, *evecs, *y;
+
+    s = cg->s;
+
+    nnew = cg->ndefl;
+    if (nnew > cg->maxdefl - cg->nw)
+        nnew = cg->maxdefl - cg->nw;
+    if (nnew > m)
+        nnew = m;
+    if (nnew <= 0)
+        return;
+
+    /* Lanczos matrix of CG, in the basis r_j/||r_j|| */
+    T = vecallocd(m*m);
+    for(i=0; i<m*m; i++)
+        T[i] = 0.0;
+    for(j=0; j<m; j++) {
+        T[j*m+j] = 1.0/alpha[j];
+        if (j > 0)
+            T[j*m+j] += beta[j]/alpha[j-1];
+        if (j+1 < m)
+            T[j*m+j+1] = T[(j+1)*m+j] = -sqrt(beta[j+1])/alpha[j];
+    }
+
+    evals = vecallocd(m);
+    evecs = vecallocd(m*m);
+    jacobieigen(m, T, evals, evecs);
+
+    /* pick the smallest Ritz values, their modes slow CG down most */
+    chosen = vecalloci(m);
+    for(i=0; i<m; i++)
+        chosen[i] = 0;
+    for(k=0; k<nnew; k++) {
+        j = -1;
+        for(i=0; i<m; i++)
+            if (!chosen[i] && (j < 0 || evals[i] < evals[j]))
+                j = i;
+        chosen[j] = 1;
+        HERE("Harvesting Ritz value %e\n", evals[j]);
+
+        /* y := V s_j, computed locally */
+        y = cg->WU[cg->nw];
+        for(i=0; i<cg->nu; i++) {
+            y[i] = 0.0;
+            for(l=0; l<m; l++)
+                y[i] += evecs[l*m+j]*V[l][i];
+        }
+        // move a copy to the v distribution, and multiply by A
+        copyvec(cg->s,cg->nu,cg->nv,y,cg->W[cg->nw],cg->u2vproc,cg->u2vind);
+        bspmv(cg->p,cg->s,cg->n,cg->nz,cg->nrows,cg->ncols,cg->a,cg->inc,
+              cg->srcprocv,cg->srcindv,cg->destprocu,cg->destindu,
+              cg->nv,cg->nu,cg->W[cg->nw],cg->AW[cg->nw],NULL);
+        cg->nw++;
+    }
+    deflgram(cg);
+
+    vecfreei(chosen);
+    vecfreed(evecs); vecfreed(evals);
+    vecfreed(T);
+}
+
+/*
+ * Recompute A.W and E after the values of A have changed.
+ */
+void deflrefresh(cgsolver *cg)
+{
+    int k;
+
+    for(k=0; k<cg->nw; k++)
+        bspmv(cg->p,cg->s,cg->n,cg->nz,cg->nrows,cg->ncols,cg->a,cg->inc,
+              cg->srcprocv,cg->srcindv,cg->destprocu,cg->destindu,
+              cg->nv,cg->nu,cg->W[k],cg->AW[k],NULL);
+    deflgram(cg);
+}
+
+void deflfree(cgsolver *cg)
+{
+    matfreed(cg->W);
+    matfreed(cg->WU);
+    matfreed(cg->AW);
+    vecfreed(cg->E);
+    cg->W = cg->WU = cg->AW = NULL;
+    cg->E = NULL;
+    cg->nw = 0;
+}
@@ -0,0 +1,38 @@
+#ifndef __GIDX
+#define __GIDX
+
+/*
+ * Global indices and counts: the matrix size n, the global row, column
+ * and vector indices, and total numbers of nonzeros. They are int by
+ * default; compile everything with -DINDEX64 for matrices with more than
+ * 2^31-1 rows or nonzeros. Local indices and counts, which is what bspmv
+ * streams through, stay int either way.
+ *
+ * Print with "%" GIDX and scan with "%" SCNGIDX, e.g.
+ * printf("n=%" GIDX "\n", n).
+ */
+
+#include <limits.h>
+
+#ifdef INDEX64
+#include <stdint.h>
+#include <inttypes.h>
+typedef int64_t gidx;
+#define GIDX PRId64
+#define SCNGIDX SCNd64
+#define GIDXMAX INT64_MAX
+#else
+typedef int gidx;
+#define GIDX "d"
+#define SCNGIDX "d"
+#define GIDXMAX INT_MAX
+#endif
+
+#define SZGIDX (sizeof(gidx))
+
+/* Most nonzeros on one processor: the bytes of their values and global
+   indices are registered and put as an int by bspinput2triple and
+   bspinputvalues, and a gidx is never wider than a double. */
+#define NZLOCMAX ((int)(INT_MAX/sizeof(double)))
+
+#endif
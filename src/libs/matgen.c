@@ -0,0 +1,583 @@
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "matgen.h"
+#include "paullib.h"
+
+#ifndef MIN
+#define MIN(a,b) ((a)<(b) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a,b) ((a)>(b) ? (a) : (b))
+#endif
+
+const char *genfamilies[NGENFAMILIES] = {
+    "random", "poisson2d", "poisson3d", "poisson27", "aniso", "banded", "block"
+};
+
+/*
+ * Set the parameters of a matrix of the given family to their defaults.
+ */
+void gendefaults(genparams *g, int family) {
+
+    g->family = family;
+    g->n = g->N = 0;
+    g->sparsity = GENSPARSITY;
+    g->mu = gendefaultmu(family);
+    g->eps = GENEPS;
+    g->width = GENWIDTH;
+    g->kappa = 0.0;
+    g->symmetric = true;
+    g->seed = GENSEED;
+    g->ntiles = 0;
+
+}
+
+/*
+ * The default mu of a family: for the random matrices enough to make
+ * sparse ones diagonally dominant, for the stencils no shift.
+ */
+double gendefaultmu(int family) {
+
+    if(family == GEN_RANDOM)
+        return 2.5;
+    if(family == GEN_BANDED || family == GEN_BLOCK)
+        return 1.0;
+    return 0.0;
+
+}
+
+/*
+ * The smallest and largest eigenvalue of the stencils, without the
+ * shift mu, on a grid with Dirichlet boundaries. In one dimension
+ * tridiag(-1,2,-1) has eigenvalues 4 sin^2(j theta/2), j=1..n, with
+ * theta = pi/(n+1); the 27-point stencil is 27I minus the Kronecker
+ * cube of tridiag(1,1,1), whose eigenvalues are 1+2cos(j theta).
+ * Returns 0 for the random families, whose spectrum is not known.
+ */
+int genspectrum(const genparams *g, double *lmin, double *lmax) {
+
+    double theta = M_PI / (g->n + 1);
+    double lo = 4.0 * sin(theta/2) * sin(theta/2);    // of tridiag(-1,2,-1)
+    double hi = 4.0 * cos(theta/2) * cos(theta/2);
+    double fmax = 1.0 + 2.0*cos(theta);                // of tridiag(1,1,1)
+    double fmin = 1.0 - 2.0*cos(theta);
+
+    switch(g->family) {
+    case GEN_POISSON2D:
+        *lmin = 2*lo;
+        *lmax = 2*hi;
+        return 1;
+    case GEN_POISSON3D:
+        *lmin = 3*lo;
+        *lmax = 3*hi;
+        return 1;
+    case GEN_POISSON27:
+        *lmin = 27.0 - fmax*fmax*fmax;
+        *lmax = 27.0 - (fmin < 0.0 ? fmin*fmax*fmax : fmin*fmin*fmin);
+        return 1;
+    case GEN_ANISO:
+        *lmin = (1.0 + g->eps) * lo;
+        *lmax = (1.0 + g->eps) * hi;
+        return 1;
+    default:
+        return 0;
+    }
+
+}
+
+/*
+ * Parse a matrix description "family,n[,key=value]...", as given to
+ * cg -g. The keys are mu, sparsity, eps, width, kappa and seed; the
+ * key nonsym takes no value. Returns 0, or -1 if spec is malformed.
+ */
+int genparse(genparams *g, const char *spec) {
+
+    char key[32];
+    const char *c, *comma;
+    char *end;
+    double x;
+    int family, k;
+
+    comma = strchr(spec, ',');
+    if(comma == NULL)
+        return -1;
+    for(family = 0; family < NGENFAMILIES; family++)
+        if(strlen(genfamilies[family]) == (size_t)(comma - spec) &&
+           strncmp(spec, genfamilies[family], comma - spec) == 0)
+            break;
+    if(family == NGENFAMILIES)
+        return -1;
+    gendefaults(g, family);
+
+    g->n = strtoll(comma+1, &end, 10);
+    if(end == comma+1)
+        return -1;
+    c = end;
+    while(*c == ',') {
+        c++;
+        for(k = 0; k < 31 && c[k] != '\0' && c[k] != '=' && c[k] != ','; k++)
+            key[k] = c[k];
+        key[k] = '\0';
+        c += k;
+        if(strcmp(key, "nonsym") == 0) {
+            g->symmetric = false;
+            continue;
+        }
+        if(*c != '=')
+            return -1;
+        c++;
+        if(strcmp(key, "seed") == 0) {
+            g->seed = strtoull(c, &end, 10);
+        } else if(strcmp(key, "width") == 0) {
+            g->width = strtoll(c, &end, 10);
+        } else {
+            x = strtod(c, &end);
+            if(strcmp(key, "mu") == 0)
+                g->mu = x;
+            else if(strcmp(key, "sparsity") == 0)
+                g->sparsity = x;
+            else if(strcmp(key, "eps") == 0)
+                g->eps = x;
+            else if(strcmp(key, "kappa") == 0)
+                g->kappa = x;
+            else
+                return -1;
+        }
+        if(end == c)
+            return -1;
+        c = end;
+    }
+    return (*c == '\0' ? 0 : -1);
+
+}
+
+/*
+ * Check the parameters of the matrix, and derive its number of rows
+ * and, for a given condition number, the shift mu. Returns 0, or -1
+ * with the reason in msg if the matrix cannot be generated.
+ */
+int gencheck(genparams *g, char *msg, int len) {
+
+    double rows, nztarget, lmin, lmax;
+    int known;
+
+    if(g->n < 1) {
+        snprintf(msg, len, "the matrix size must be positive");
+        return -1;
+    }
+    if(!(g->sparsity > 0.0 && g->sparsity <= 1.0)) {
+        snprintf(msg, len, "sparsity must be in (0,1]");
+        return -1;
+    }
+    if(!(g->eps > 0.0) || g->width < 1 || (g->kappa != 0.0 && !(g->kappa > 1.0))) {
+        snprintf(msg, len, "eps must be positive, width at least 1, and kappa above 1");
+        return -1;
+    }
+    if(g->family != GEN_RANDOM && g->family != GEN_BANDED &&
+       g->family != GEN_BLOCK && !g->symmetric) {
+        snprintf(msg, len, "the %s matrices are symmetric", genfamilies[g->family]);
+        return -1;
+    }
+    switch(g->family) {
+    case GEN_RANDOM:
+        // in floating point: N*N overflows an int long before nz does
+        rows = g->n;
+        nztarget = g->sparsity*rows*rows;
+        break;
+    case GEN_POISSON2D:
+    case GEN_ANISO:
+        rows = (double)g->n * g->n;
+        nztarget = 5*rows;
+        break;
+    case GEN_POISSON3D:
+        rows = (double)g->n * g->n * g->n;
+        nztarget = 7*rows;
+        break;
+    case GEN_POISSON27:
+        rows = (double)g->n * g->n * g->n;
+        nztarget = 27*rows;
+        break;
+    case GEN_BANDED:
+        rows = g->n;
+        nztarget = (2.0*g->width + 1)*rows;
+        break;
+    default:
+        rows = g->n;
+        nztarget = 3.0*g->width*rows;
+        break;
+    }
+    if(nztarget > GIDXMAX/2) {
+        snprintf(msg, len, "%.0lf nonzeros do not fit in the index type, see libs/gidx.h", nztarget);
+        return -1;
+    }
+    g->N = rows;
+    g->ntiles = (g->N + GENTILE - 1) / GENTILE;
+
+    known = genspectrum(g, &lmin, &lmax);
+    if(g->kappa > 0.0) {
+        if(!known) {
+            snprintf(msg, len, "the spectrum of the %s matrices is not known; "
+                     "a condition number can only be given for the stencils",
+                     genfamilies[g->family]);
+            return -1;
+        }
+        // (lmax+mu)/(lmin+mu) = kappa
+        g->mu = (lmax - g->kappa*lmin) / (g->kappa - 1.0);
+    }
+    if(known && !(lmin + g->mu > 0.0)) {
+        snprintf(msg, len, "mu = %lf makes the matrix indefinite; the smallest eigenvalue is %lf",
+                 g->mu, lmin);
+        return -1;
+    }
+    return 0;
+
+}
+
+/*
+ * Print a one-line description of a checked matrix, without newline.
+ */
+void gendescribe(FILE *fp, const genparams *g) {
+
+    double lmin, lmax;
+
+    fprintf(fp, "%s matrix, N=%" GIDX ", ", genfamilies[g->family], g->N);
+    if(g->family == GEN_RANDOM)
+        fprintf(fp, "density=%lf, target nz=%.0lf, ", g->sparsity,
+                g->sparsity*(double)g->N*(double)g->N);
+    else if(g->family == GEN_ANISO)
+        fprintf(fp, "eps=%g, ", g->eps);
+    else if(g->family == GEN_BANDED || g->family == GEN_BLOCK)
+        fprintf(fp, "width=%" GIDX ", ", g->width);
+    if(!g->symmetric)
+        fprintf(fp, "nonsymmetric, ");
+    if(genspectrum(g, &lmin, &lmax))
+        fprintf(fp, "condition number %g, ", (lmax + g->mu)/(lmin + g->mu));
+    fprintf(fp, "mu = %lf, seed = %llu", g->mu, g->seed);
+
+}
+
+/*
+ * Seed of random stream number 'stream' of the matrix: 0 gives the
+ * diagonal, 1 the vector, and 2+I*ntiles+J tile (I,J) of a random
+ * matrix, or 2 the values of a banded or block matrix.
+ */
+unsigned long long genstream(const genparams *g, unsigned long long stream) {
+
+    return g->seed + stream * 0xD1B54A32D192ED03ULL;
+
+}
+
+/*
+ * Append to a growing text buffer, printf style. Only used by genmat,
+ * which it stops if memory runs out.
+ */
+void genprintf(char **buf, size_t *len, size_t *cap, const char *fmt, ...) {
+
+    va_list ap;
+    size_t newcap;
+    int n;
+
+    if(*cap - *len < GENLINE) {
+        newcap = MAX(2 * *cap, 1<<20);
+        *buf = realloc(*buf, newcap);
+        if(*buf == NULL) {
+            printf("out of memory!");
+            exit(44);
+        }
+        *cap = newcap;
+    }
+    va_start(ap, fmt);
+    n = vsnprintf(*buf + *len, *cap - *len, fmt, ap);
+    va_end(ap);
+    if((size_t)n >= *cap - *len) {
+        // a line longer than GENLINE, e.g. for a huge mu
+        newcap = 2 * (*len + n + 1);
+        *buf = realloc(*buf, newcap);
+        if(*buf == NULL) {
+            printf("out of memory!");
+            exit(44);
+        }
+        *cap = newcap;
+        va_start(ap, fmt);
+        vsnprintf(*buf + *len, *cap - *len, fmt, ap);
+        va_end(ap);
+    }
+    *len += n;
+
+}
+
+/*
+ * Add nonzero a_ij = v to block b, according to b->mode. Nonzeros
+ * outside the rows of b, from tiles that only partly overlap them,
+ * are dropped.
+ */
+void genemit(genblock *b, gidx i, gidx j, double v) {
+
+    if(i < b->lo || i >= b->hi)
+        return;
+    switch(b->mode) {
+    case GENCOUNT:
+        if(i == j)
+            b->diag[i - b->lo] = v;
+        else
+            b->rowsum[i - b->lo] += fabs(v);
+        break;
+    case GENTEXT:
+        // Mondriaan and Mathematica expect 1-based coordinates.
+        genprintf(&b->buf, &b->len, &b->cap, "%" GIDX " %" GIDX " %lf\n", i+1, j+1, v);
+        if(b->mathematica)
+            genprintf(&b->nb, &b->nblen, &b->nbcap, ",\n{%" GIDX ", %" GIDX "} -> %lf", i+1, j+1, v);
+        break;
+    default:
+        b->ia[b->nz] = i;
+        b->ja[b->nz] = j;
+        b->a[b->nz] = v;
+        break;
+    }
+    b->nz++;
+
+}
+
+/*
+ * Generate the off-diagonal nonzeros of tile (I,J), or of its
+ * transpose. Positions are drawn row by row with random gaps of on
+ * average 1/sparsity; of a symmetric matrix only the strictly lower
+ * triangle is kept, with values that simulate the distribution of
+ * A+A^T.
+ */
+void gentile(genblock *b, gidx I, gidx J, bool transpose) {
+
+    const genparams *g = b->g;
+    gidx i0 = I*GENTILE;
+    gidx j0 = J*GENTILE;
+    gidx nc = MIN(GENTILE, g->N - j0);
+    double size = (double)MIN(GENTILE, g->N - i0) * nc;
+    unsigned long long s = genstream(g, 2 + (unsigned long long)I*g->ntiles + J);
+    long long k = 0;
+    double pos, step, v;
+    gidx i, j;
+
+    pos = floor(ranindex(s, k++) / g->sparsity);
+    while(pos < size) {
+        i = i0 + (gidx)pos / nc;
+        j = j0 + (gidx)pos % nc;
+        if(i > j || (i < j && !g->symmetric)) {
+            v = ranindex(s, k++)*2.0 - 1.0;
+            if(g->symmetric && ranindex(s, k++) < g->sparsity)
+                v += ranindex(s, k++)*2.0 - 1.0;
+            if(transpose)
+                genemit(b, j, i, v);
+            else
+                genemit(b, i, j, v);
+        }
+        step = floor((ranindex(s, k++) + 0.5) / g->sparsity);
+        pos += MAX(step, 1.0);
+    }
+
+}
+
+/*
+ * Generate the diagonal of rows lo..hi-1 of a random matrix, with mu
+ * added to every element.
+ */
+void gendiag(genblock *b, gidx lo, gidx hi) {
+
+    unsigned long long s = genstream(b->g, 0);
+    gidx i;
+
+    for(i = lo; i < hi; i++)
+        genemit(b, i, i, ranindex(s, i)*2.0 - 1.0 + b->g->mu);
+
+}
+
+/*
+ * Generate row i of a stencil, in increasing column order. The grid
+ * point of row i is (x,y) or (x,y,z), numbered with x fastest.
+ */
+void genstencil(genblock *b, gidx i) {
+
+    const genparams *g = b->g;
+    gidx n = g->n;
+    gidx x = i % n;
+    gidx y = (i / n) % n;
+    gidx z = i / n / n;
+    double ex = (g->family == GEN_ANISO ? g->eps : 1.0);  // coupling in x
+    int dx, dy, dz;
+
+    switch(g->family) {
+    case GEN_POISSON2D:
+    case GEN_ANISO:
+        if(y > 0)   genemit(b, i, i-n, -1.0);
+        if(x > 0)   genemit(b, i, i-1, -ex);
+        genemit(b, i, i, 2.0 + 2.0*ex + g->mu);
+        if(x < n-1) genemit(b, i, i+1, -ex);
+        if(y < n-1) genemit(b, i, i+n, -1.0);
+        break;
+    case GEN_POISSON3D:
+        if(z > 0)   genemit(b, i, i-n*n, -1.0);
+        if(y > 0)   genemit(b, i, i-n, -1.0);
+        if(x > 0)   genemit(b, i, i-1, -1.0);
+        genemit(b, i, i, 6.0 + g->mu);
+        if(x < n-1) genemit(b, i, i+1, -1.0);
+        if(y < n-1) genemit(b, i, i+n, -1.0);
+        if(z < n-1) genemit(b, i, i+n*n, -1.0);
+        break;
+    default:
+        for(dz = -1; dz <= 1; dz++) {
+            if(z+dz < 0 || z+dz >= n)
+                continue;
+            for(dy = -1; dy <= 1; dy++) {
+                if(y+dy < 0 || y+dy >= n)
+                    continue;
+                for(dx = -1; dx <= 1; dx++) {
+                    if(x+dx < 0 || x+dx >= n)
+                        continue;
+                    if(dx == 0 && dy == 0 && dz == 0)
+                        genemit(b, i, i, 26.0 + g->mu);
+                    else
+                        genemit(b, i, i + (dz*n + dy)*n + dx, -1.0);
+                }
+            }
+        }
+        break;
+    }
+
+}
+
+/*
+ * The random value of a_ij, |i-j| <= w, of a banded or block matrix,
+ * in [-1,1). It only depends on the position, and for a symmetric
+ * matrix a_ji = a_ij.
+ */
+double genvalue(const genparams *g, gidx i, gidx j, gidx w) {
+
+    gidx t;
+
+    if(g->symmetric && i > j) {
+        t = i;
+        i = j;
+        j = t;
+    }
+    return ranindex(genstream(g, 2), (long long)i*(2*w+1) + (j-i+w))*2.0 - 1.0;
+
+}
+
+/*
+ * Generate row i of a banded or block tridiagonal matrix, in increasing
+ * column order. The diagonal is the sum of the absolute values of the
+ * other elements plus mu.
+ */
+void genband(genblock *b, gidx i) {
+
+    const genparams *g = b->g;
+    gidx w, lo, hi, j;
+    double sum;
+
+    if(g->family == GEN_BANDED) {
+        w = g->width;
+        lo = MAX(i - w, 0);
+        hi = MIN(i + w, g->N - 1);
+    } else {
+        // the blocks left and right of the block of i, and its own
+        w = 2*g->width;
+        lo = MAX((i / g->width - 1) * g->width, 0);
+        hi = MIN((i / g->width + 2) * g->width, g->N) - 1;
+    }
+    sum = 0.0;
+    for(j = lo; j <= hi; j++)
+        if(j != i)
+            sum += fabs(genvalue(g, i, j, w));
+    for(j = lo; j <= hi; j++) {
+        if(j == i)
+            genemit(b, i, i, sum + g->mu);
+        else
+            genemit(b, i, j, genvalue(g, i, j, w));
+    }
+
+}
+
+/*
+ * Generate all nonzeros in rows b->lo..b->hi-1. In the counting pass,
+ * set b->bad to the first row of a random matrix that is not strictly
+ * diagonally dominant, if any; b->rowsum and b->diag must then have
+ * room for hi-lo rows.
+ */
+void genrows(genblock *b) {
+
+    const genparams *g = b->g;
+    gidx I, J, i;
+
+    b->nz = 0;
+    b->len = 0;
+    b->nblen = 0;
+    b->bad = -1;
+    if(b->mode == GENCOUNT) {
+        for(i = 0; i < b->hi - b->lo; i++) {
+            b->rowsum[i] = 0.0;
+            b->diag[i] = 0.0;
+        }
+    }
+
+    if(g->family != GEN_RANDOM) {
+        for(i = b->lo; i < b->hi; i++) {
+            if(g->family == GEN_BANDED || g->family == GEN_BLOCK)
+                genband(b, i);
+            else
+                genstencil(b, i);
+        }
+        return;
+    }
+
+    for(I = b->lo / GENTILE; I*GENTILE < b->hi; I++) {
+        // the tiles up to the diagonal, or all of them if nonsymmetric
+        for(J = 0; J < (g->symmetric ? I+1 : g->ntiles); J++)
+            gentile(b, I, J, false);
+        gendiag(b, MAX(b->lo, I*GENTILE), MIN(b->hi, (I+1)*GENTILE));
+        // of a symmetric matrix, the rest is the transpose of the tiles
+        // below the diagonal
+        if(g->symmetric)
+            for(J = I; J < g->ntiles; J++)
+                gentile(b, J, I, true);
+    }
+
+    if(b->mode == GENCOUNT) {
+        for(i = b->lo; i < b->hi; i++) {
+            if(!(fabs(b->diag[i - b->lo]) > b->rowsum[i - b->lo])) {
+                b->bad = i;
+                break;
+            }
+        }
+    }
+
+}
+
+void *genwork(void *arg) {
+
+    genrows((genblock *)arg);
+    return NULL;
+
+}
+
+/*
+ * Generate blocks[0..nb-1] concurrently, one thread each.
+ */
+void genround(genblock *blocks, int nb) {
+
+    pthread_t thread[GENMAXTHREADS];
+    int started[GENMAXTHREADS];
+    int t;
+
+    for(t = 1; t < nb; t++)
+        started[t] = (pthread_create(&thread[t], NULL, genwork, &blocks[t]) == 0);
+    genwork(&blocks[0]);
+    for(t = 1; t < nb; t++) {
+        if(started[t])
+            pthread_join(thread[t], NULL);
+        else
+            genwork(&blocks[t]);
+    }
+
+}
@@ -0,0 +1,101 @@
+#ifndef __MATGEN
+#define __MATGEN
+
+#include <stdio.h>
+#include "paulbool.h"
+#include "gidx.h"
+
+/*
+ * Generation of test matrices, shared by genmat, which writes them to
+ * file, and cg, which generates its own part in memory (cg -g).
+ *
+ * The random matrix is cut into tiles of GENTILE x GENTILE. The
+ * nonzeros of a tile are drawn from their own counter-based random
+ * stream (see ranindex), so any thread or processor can generate any
+ * tile, and the matrix only depends on the seed, not on who generates
+ * it. Rows are generated from the tiles in their row and, for a
+ * symmetric matrix, the transposes of the tiles in their column.
+ *
+ * The structured families are generated row by row instead; their
+ * random values are keyed by the position (i,j), see genvalue.
+ */
+#define GENTILE (256)
+#define GENMAXTHREADS (64)
+#define GENSEED (1)          /* default seed */
+#define GENLINE (128)        /* room reserved for one output line */
+
+/* families of matrices, named in genfamilies */
+#define GEN_RANDOM    (0)    /* random, diagonally dominant */
+#define GEN_POISSON2D (1)    /* 5-point Laplacian on an n x n grid */
+#define GEN_POISSON3D (2)    /* 7-point Laplacian on an n x n x n grid */
+#define GEN_POISSON27 (3)    /* 27-point Laplacian on an n x n x n grid */
+#define GEN_ANISO     (4)    /* -eps u_xx - u_yy, 5 points on an n x n grid */
+#define GEN_BANDED    (5)    /* random band of half-width 'width' */
+#define GEN_BLOCK     (6)    /* random block tridiagonal, blocks width x width */
+#define NGENFAMILIES  (7)
+
+#define GENEPS (0.01)        /* default anisotropy */
+#define GENWIDTH (8)         /* default band half-width and block size */
+#define GENSPARSITY (0.2)    /* default density of the random matrix */
+
+/* what genemit does with a nonzero */
+#define GENCOUNT   (0)       /* count it, and check diagonal dominance */
+#define GENTEXT    (1)       /* format it for the EMM (and .nb) file */
+#define GENTRIPLES (2)       /* store it in ia, ja, a */
+
+/* the matrix to generate */
+typedef struct {
+    int family;
+    gidx n;                  /* grid points per dimension of a stencil,
+                                rows of the other families */
+    gidx N;                  /* rows, set by gencheck */
+    double sparsity;
+    double mu;               /* added to every diagonal element */
+    double eps;              /* anisotropy */
+    gidx width;              /* band half-width or block size */
+    double kappa;            /* condition number asked for, or 0 */
+    bool symmetric;
+    unsigned long long seed;
+    gidx ntiles;             /* tiles in a row of tiles */
+} genparams;
+
+/* a range of rows, generated by one thread */
+typedef struct {
+    const genparams *g;
+    gidx lo, hi;             /* rows lo..hi-1 */
+    int mode;                /* GENCOUNT, GENTEXT or GENTRIPLES */
+    bool mathematica;        /* GENTEXT: also format for the .nb file */
+    gidx nz;                 /* nonzeros in the range */
+    gidx bad;                /* GENCOUNT: a row that is not diagonally
+                                dominant, or -1 */
+    double *rowsum;          /* GENCOUNT: sum of |a_ij|, j != i, per row */
+    double *diag;            /* GENCOUNT: a_ii per row */
+    char *buf;               /* GENTEXT: EMM lines */
+    size_t len, cap;
+    char *nb;                /* GENTEXT: Mathematica rules, each preceded by ",\n" */
+    size_t nblen, nbcap;
+    gidx *ia, *ja;           /* GENTRIPLES: where the nonzeros go */
+    double *a;
+} genblock;
+
+extern const char *genfamilies[NGENFAMILIES];
+
+void   gendefaults(genparams *g, int family);
+double gendefaultmu(int family);
+int    genparse(genparams *g, const char *spec);
+int    genspectrum(const genparams *g, double *lmin, double *lmax);
+int    gencheck(genparams *g, char *msg, int len);
+void   gendescribe(FILE *fp, const genparams *g);
+unsigned long long genstream(const genparams *g, unsigned long long stream);
+void   genprintf(char **buf, size_t *len, size_t *cap, const char *fmt, ...);
+void   genemit(genblock *b, gidx i, gidx j, double v);
+void   gentile(genblock *b, gidx I, gidx J, bool transpose);
+void   gendiag(genblock *b, gidx lo, gidx hi);
+void   genstencil(genblock *b, gidx i);
+double genvalue(const genparams *g, gidx i, gidx j, gidx w);
+void   genband(genblock *b, gidx i);
+void   genrows(genblock *b);
+void  *genwork(void *arg);
+void   genround(genblock *blocks, int nb);
+
+#endif
@@ -1,97 +1,158 @@
+#include <pthread.h>
 #include "matsort.h"
-#include "vecio.h"
+#include "parse.h"
 #include "bspedupack.h"
 
-// This is from BSPedupack
+/*
+ * Stable LSD radix sort of nonzero triples by one of their indices,
+ * used by triple2icrs.
+ *
+ * The key is taken SORTBITS bits at a time, starting with the least
+ * significant digit, and every pass moves the triples between the
+ * input arrays and a scratch copy of the same size supplied by the
+ * caller, so nothing is allocated per pass. A pass in which all keys
+ * have the same digit is skipped.
+ *
+ * The nonzeros are split into equal chunks over the threads (CG_THREADS,
+ * see parse.h). In every pass each thread counts the digits of its own
+ * chunk; after a barrier, it computes from all counts where its
+ * triples with a given digit start, and scatters them there. As chunk t
+ * goes before chunk t+1 within every bin, the sort stays stable.
+ */
 
-int key(int i, int radix, int keytype){
-   /* This function computes the key of an index i
-      according to the keytype */
-   
-       if (keytype==DIV)
-           return i/radix;
-       else /* keytype=MOD */
-           return i%radix;
-           
-} /* end key */
+typedef struct {
+    int nz, nt, npass;
+    int *key[2], *other[2];     /* [0] is the input, [1] the scratch copy */
+    double *a[2];
+    int *count;                 /* count[t*SORTBINS+b]: digit b in chunk t */
+    pthread_barrier_t barrier;
+} sortstate;
 
+typedef struct {
+    sortstate *st;
+    int t;
+} sortjob;
 
+void *sortwork(void *arg){
+
+    sortjob *job;
+    sortstate *st;
+    int t, u, b, k, lo, hi, pass, shift, src, dst, d, skip, total, first;
+    int *cnt, pos[SORTBINS];
+
+    job= arg;
+    st= job->st;
+    t= job->t;
+    lo= (long)st->nz*t/st->nt;
+    hi= (long)st->nz*(t+1)/st->nt;
+    cnt= st->count + t*SORTBINS;
+
+    src= 0;
+    for (pass=0; pass<st->npass; pass++){
+        shift= pass*SORTBITS;
+        for (b=0; b<SORTBINS; b++)
+            cnt[b]= 0;
+        for (k=lo; k<hi; k++)
+            cnt[(st->key[src][k]>>shift) & (SORTBINS-1)]++;
+        pthread_barrier_wait(&st->barrier);
+
+        /* Start of my part of every bin: all triples in lower bins,
+           and those of lower chunks in the same bin. If all keys have
+           the same digit, nothing moves. */
+        total= 0; skip= 0;
+        for (b=0; b<SORTBINS; b++){
+            first= total;
+            for (u=0; u<st->nt; u++){
+                if (u==t)
+                    pos[b]= total;
+                total += st->count[u*SORTBINS+b];
+            }
+            if (total-first == st->nz)
+                skip= 1;
+        }
+
+        if (!skip){
+            dst= 1-src;
+            for (k=lo; k<hi; k++){
+                b= (st->key[src][k]>>shift) & (SORTBINS-1);
+                d= pos[b]++;
+                st->key[dst][d]= st->key[src][k];
+                st->other[dst][d]= st->other[src][k];
+                st->a[dst][d]= st->a[src][k];
+            }
+            src= dst;
+        }
+        /* Nobody may clear the counts while others still read them */
+        pthread_barrier_wait(&st->barrier);
+    }
+
+    /* After an odd number of passes, the result is in the scratch copy */
+    if (src == 1){
+        for (k=lo; k<hi; k++){
+            st->key[0][k]= st->key[1][k];
+            st->other[0][k]= st->other[1][k];
+            st->a[0][k]= st->a[1][k];
+        }
+    }
+    return NULL;
+
+} /* end sortwork */
+
+void radixsort(int n, int nz, int *key, int *other, double *a,
+               int *key1, int *other1, double *a1){
 
-void sort(int n, int nz, int *ia, int *ja, double *a,
-             int radix, int keytype){
    /* This function sorts the nonzero elements of an n by n sparse
-      matrix A stored in triple format in arrays ia, ja, a.
-      The sort is by counting. 
-      If keytype=DIV, the triples are sorted by increasing value of
-      ia[k] div radix.
-      if keytype=MOD, the triples are sorted by increasing value of
-      ia[k] mod radix.
+      matrix A, stored in triple format, by increasing value of key[k].
       The sorting is stable: ties are decided so that the original
-      precedences are maintained. For a complete sort by increasing
-      index ia[k], this function should be called twice:
-      first with keytype=MOD, then with keytype=DIV.
-      
-      Input: 
+      precedences are maintained.
+
+      Input:
       n is the global size of the matrix.
       nz is the local number of nonzeros.
-      a[k] is the numerical value of the k'th nonzero of the
-           sparse matrix A, 0 <= k < nz.
-      ia[k] is the global row index of the k'th nonzero.
-      ja[k] is the global column index of the k'th nonzero.
-      radix >= 1.
-      
-      Output: ia, ja, a in sorted order.
+      key[k] is the index to sort by of the k'th nonzero, 0 <= key[k] < n.
+      other[k] is its other index.
+      a[k] is its numerical value.
+      key1, other1, a1 are scratch arrays of length nz.
+
+      Output: key, other, a in sorted order.
    */
-   
-   int *ia1, *ja1, nbins, *startbin, *lengthbin, r, k, newk;
-   double *a1;
-   
-   ia1= vecalloci(nz);
-   ja1= vecalloci(nz); 
-   a1 = vecallocd(nz);
-   
-   /* Allocate bins */
-   if (keytype==DIV)
-       nbins= (n%radix==0 ? n/radix : n/radix+1);
-   else if (keytype==MOD)
-       nbins= radix;
-   startbin= vecalloci(nbins);
-   lengthbin= vecalloci(nbins);
-       
-   /* Count the elements in each bin */
-   for (r=0; r<nbins; r++)
-       lengthbin[r]= 0;
-   for (k=0; k<nz; k++){
-       r= key(ia[k],radix,keytype);
-       lengthbin[r]++;
-   }
-    
-   /* Compute the starting positions */
-   startbin[0]= 0;
-   for (r=1; r<nbins; r++)
-       startbin[r]= startbin[r-1] + lengthbin[r-1];
-       
-   /* Enter the elements into the bins in temporary arrays (ia1,ja1,a1) */
-   for (k=0; k<nz; k++){
-       r= key(ia[k],radix,keytype);
-       newk= startbin[r];
-       ia1[newk]= ia[k];
-       ja1[newk]= ja[k];
-       a1[newk] = a[k];
-       startbin[r]++;
-   }
-  
-   /* Copy the elements back to the orginal arrays */
-   for (k=0; k<nz; k++){
-       ia[k]= ia1[k];
-       ja[k]= ja1[k];
-       a[k] = a1[k];
+
+   sortstate st;
+   sortjob job[PARSEMAXTHREADS];
+   pthread_t thread[PARSEMAXTHREADS];
+   int t, nt, m;
+
+   st.nz= nz;
+   st.key[0]= key;   st.key[1]= key1;
+   st.other[0]= other; st.other[1]= other1;
+   st.a[0]= a;       st.a[1]= a1;
+
+   /* Enough passes to cover the largest key, n-1 */
+   st.npass= 0;
+   for (m=n-1; m>0; m >>= SORTBITS)
+       st.npass++;
+
+   nt= parsethreads();
+   if (nt > nz/SORTMINNZ)
+       nt= nz/SORTMINNZ;
+   if (nt < 1)
+       nt= 1;
+   st.nt= nt;
+   st.count= vecalloci(nt*SORTBINS);
+   pthread_barrier_init(&st.barrier,NULL,nt);
+
+   for (t=0; t<nt; t++){
+       job[t].st= &st;
+       job[t].t= t;
    }
-   
-   vecfreei(lengthbin);
-   vecfreei(startbin);
-   vecfreed(a1);
-   vecfreei(ja1);
-   vecfreei(ia1);
-   
-} /* end sort */
+   for (t=1; t<nt; t++)
+       if (pthread_create(&thread[t],NULL,sortwork,&job[t]) != 0)
+           bsp_abort("radixsort: cannot start a thread\n");
+   sortwork(&job[0]);
+   for (t=1; t<nt; t++)
+       pthread_join(thread[t],NULL);
+
+   pthread_barrier_destroy(&st.barrier);
+   vecfreei(st.count);
+
+} /* end radixsort */
@@ -1,4 +1,7 @@
 
-void sort(int n, int nz, int *ia, int *ja, double *a,
-             int radix, int keytype);
-int key(int i, int radix, int keytype);
+#define SORTBITS (8)                 /* bits per digit of the radix sort */
+#define SORTBINS (1<<SORTBITS)
+#define SORTMINNZ (1<<15)            /* fewer nonzeros per thread are sorted serially */
+
+void radixsort(int n, int nz, int *key, int *other, double *a,
+               int *key1, int *other1, double *a1);
@@ -0,0 +1,149 @@
+#include "bspedupack.h"
+#include "bspfuncs.h"
+#include "paullib.h"
+#include "cgsolver.h"
+#include "debug.h"
+
+/*
+ * Mixed precision iterative refinement.
+ *
+ * The outer loop works in double precision: it computes the true
+ * residual r = b - A.x and stops with the same test as cgsolve. Each
+ * outer step solves A.d = r approximately with an inner CG that runs
+ * entirely in single precision (float matrix, float vectors and float
+ * messages in bspmvf), after which x := x + d.
+ *
+ * The inner iterations move half the bytes of the double precision
+ * ones, both through memory and over the network, while the outer
+ * correction still gives double precision accuracy.
+ */
+
+/*
+ * Inner CG in single precision: solve A.d = r until the residual has
+ * dropped by a factor tol, or kmax iterations have been done.
+ * Returns the number of iterations.
+ */
+int innercg(cgsolver *cg, float *r, float *d, double tol, int kmax)
+{
+    int p, s, nu, nv, i, k;
+    float *pvec, *w;
+    double rho, rho0, rho_old, alpha, beta, gamma;
+
+    p = cg->p; s = cg->s;
+    nu = cg->nu; nv = cg->nv;
+
+    pvec = vecallocf(nv);
+    w    = vecallocf(nu);
+
+    for(i=0; i<nv; i++)
+        d[i] = 0.0;
+
+    k = 0;
+    rho = rho0 = bspipsamef(p,s,nu,r,r);
+    rho_old = 0;
+    while (k < kmax && sqrt(rho) > tol*sqrt(rho0)) {
+        if (k == 0) {
+            // p := r
+            copyvecf(s,nu,nv,r,pvec,cg->u2vproc,cg->u2vind);
+        } else {
+            // p := r + beta*p
+            beta = rho/rho_old;
+            for(i=0; i<nv; i++)
+                pvec[i] *= beta;
+            addvecf(nv,pvec,nu,r,cg->v2uproc,cg->v2uind);
+        }
+        // w := Ap
+        bspmvf(p,s,cg->n,cg->nz,cg->nrows,cg->ncols,cg->af,cg->inc,
+               cg->srcprocv,cg->srcindv,cg->destprocu,cg->destindu,nv,nu,pvec,w);
+
+        gamma = bspipf(p,s,nv,nu,pvec,w,cg->v2uproc,cg->v2uind);
+        alpha = rho/gamma;
+
+        // d := d + alpha*p, r := r - alpha*w
+        for(i=0; i<nv; i++)
+            d[i] += alpha*pvec[i];
+        for(i=0; i<nu; i++)
+            r[i] -= alpha*w[i];
+
+        rho_old = rho;
+        rho = bspipsamef(p,s,nu,r,r);
+        k++;
+    }
+
+    vecfreef(w); vecfreef(pvec);
+    return k;
+}
+
+/*
+ * Solve A.x = b by mixed precision iterative refinement. Parameters are
+ * the same as for cgsolve; stats->outer gets the number of refinement
+ * steps and stats->iters the total number of inner iterations.
+ */
+void cgsolve_mixed(cgsolver *cg, double *b, double *x0, double *x, cgstats *stats)
+{
+    int p, s, nu, nv, i, k, outer, done;
+    float *rf, *df;
+    double *r, *w, time0, rho;
+
+    p = cg->p; s = cg->s;
+    nu = cg->nu; nv = cg->nv;
+
+    bsp_sync();
+    time0 = bsp_time();
+
+    if (cg->af == NULL) {
+        // single precision copy of the matrix
+        cg->af = vecallocf(cg->nz+1);
+        for(i=0; i<=cg->nz; i++)
+            cg->af[i] = cg->a[i];
+    }
+
+    r  = vecallocd(nu);
+    w  = vecallocd(nu);
+    rf = vecallocf(nu);
+    df = vecallocf(nv);
+
+    if (x0 == NULL)
+        zero(nv,x);
+    else if (x != x0)
+        for(i=0; i<nv; i++)
+            x[i] = x0[i];
+
+    k = 0;
+    outer = 0;
+    while (1) {
+        // r := b - Ax, in double precision
+        bspmv(p,s,cg->n,cg->nz,cg->nrows,cg->ncols,cg->a,cg->inc,cg->srcprocv,cg->srcindv,
+              cg->destprocu,cg->destindu,nv,nu,x,w,NULL);
+        local_axpy(nu,-1.0,w,b,
+                               r);
+        rho = bspipsame(p,s,nu,r,r);
+
+        if (s==0)
+            printf("[Refinement %02d] rho  = %e (%d inner iterations)\n", outer, sqrt(rho), k);
+        done = !(sqrt(rho) > cg->eps * bspipsame(p,s,nv,x,x));
+        if (done || outer >= MIXEDOUTER || k >= cg->kmax)
+            break;
+
+        // solve A.d = r in single precision
+        for(i=0; i<nu; i++)
+            rf[i] = r[i];
+        k += innercg(cg, rf, df, MIXEDTOL, cg->kmax - k);
+
+        // x := x + d
+        for(i=0; i<nv; i++)
+            x[i] += df[i];
+        outer++;
+    }
+
+    bsp_sync();
+    stats->time = bsp_time() - time0;
+    stats->iters = k;
+    stats->outer = outer;
+    stats->converged = done;
+    stats->residual = sqrt(rho);
+
+    vecfreef(df); vecfreef(rf);
+    vecfreed(w);  vecfreed(r);
+
+} /* end cgsolve_mixed */
@@ -0,0 +1,171 @@
+#include "bspedupack.h"
+#include "bspfuncs.h"
+#include "paullib.h"
+#include "cgsolver.h"
+#include "debug.h"
+
+/*
+ * Multi-shift CG: solve (A + sigma_i I) x_i = b for many shifts at once.
+ *
+ * The Krylov space of A + sigma I does not depend on sigma, so one CG
+ * run on A itself generates it for all shifts. The residual of shifted
+ * system i is a multiple zeta_i of the base residual, and its search
+ * direction and solution follow from scalar recurrences in the base CG
+ * coefficients (Jegerlehner, hep-lat/9612014):
+ *
+ *   zeta'  = zeta zeta_old alpha_old /
+ *            (alpha_old zeta_old (1 + sigma alpha) + alpha beta_old (zeta_old - zeta))
+ *   alpha_i = alpha zeta'/zeta,  beta_i = beta (zeta'/zeta)^2
+ *   x_i := x_i + alpha_i p_i
+ *   p_i := zeta' r + beta_i p_i
+ *
+ * So every iteration costs one bspmv and two reductions, however many
+ * shifts there are, plus a few local vector updates per shift. Since
+ * r = p_new - beta p_old, the update of p_i needs no communication.
+ *
+ * All shifts start from x = 0 (they must share the starting residual),
+ * and deflation is not used.
+ */
+
+/*
+ * Solve (A + shift[i] I) x[i] = b for i = 0..nshift-1 with multi-shift CG.
+ *
+ * - b: right-hand side, in the u distribution
+ * - shift: the shifts; A + shift[i] I must be symmetric positive definite
+ * - x: x[i] gets the solution for shift[i], in the v distribution
+ * - stats: stats[i] gets the iteration count at which shift i converged,
+ *   and its final residual. The time is that of the whole solve.
+ *
+ * Shift i has converged by the same criterion as cgsolve; from then on
+ * its vectors are no longer updated. Returns the number of iterations
+ * of the base CG.
+ */
+int cgsolve_shifts(cgsolver *cg, double *b, int nshift, double *shift,
+                   double **x, cgstats *stats)
+{
+    int p, s, nu, nv, i, j, k, nactive, *active;
+    gidx n;
+    double *r, *pvec, *w, **ps, *zeta, *zeta_old, *red, time0,
+           rho, rho_old, alpha, alpha_old, beta, beta_old, gamma,
+           zeta_new, alpha_i, beta_i;
+
+    p = cg->p; s = cg->s; n = cg->n;
+    nu = cg->nu; nv = cg->nv;
+
+    bsp_sync();
+    time0 = bsp_time();
+
+    r        = vecallocd(nu);
+    pvec     = vecallocd(nv);
+    w        = vecallocd(nu);
+    ps       = matallocd(nshift, nv);
+    zeta     = vecallocd(nshift);
+    zeta_old = vecallocd(nshift);
+    red      = vecallocd(nshift+1);
+    active   = vecalloci(nshift);
+
+    // r := b, p := r, and the same for every shift
+    for(i=0; i<nu; i++)
+        r[i] = b[i];
+    copyvec(s,nu,nv,r,pvec,cg->u2vproc,cg->u2vind);
+    for(j=0; j<nshift; j++) {
+        zero(nv,x[j]);
+        for(i=0; i<nv; i++)
+            ps[j][i] = pvec[i];
+        zeta[j] = zeta_old[j] = 1.0;
+        active[j] = 1;
+        stats[j].iters = 0;
+        stats[j].outer = 0;
+        stats[j].converged = 0;
+    }
+
+    rho = bspipsame(p,s,nu,r,r);
+    alpha_old = 1.0;
+    beta_old = 0.0;
+    nactive = nshift;
+
+    k = 0;
+    while (k < cg->kmax && nactive > 0 && rho > 0.0) {
+        if(s==0)
+            printf("[Iteration %02d] rho  = %e (%d shifts left)\n", k+1, sqrt(rho), nactive);
+
+        // w := Ap
+        bspmv(p,s,n,cg->nz,cg->nrows,cg->ncols,cg->a,cg->inc,cg->srcprocv,cg->srcindv,
+              cg->destprocu,cg->destindu,nv,nu,pvec,w,NULL);
+        gamma = bspip(p,s,nv,nu,pvec,w,cg->v2uproc,cg->v2uind);
+        alpha = rho/gamma;
+
+        // r := r - alpha*w
+        local_axpy(nu,-alpha,w,r,
+                               r);
+
+        // advance the shifted solutions; x_i := x_i + alpha_i*p_i
+        for(j=0; j<nshift; j++) {
+            if (!active[j])
+                continue;
+            zeta_new = zeta[j]*zeta_old[j]*alpha_old /
+                       (alpha_old*zeta_old[j]*(1.0 + shift[j]*alpha) +
+                        alpha*beta_old*(zeta_old[j] - zeta[j]));
+            alpha_i = alpha*zeta_new/zeta[j];
+            local_axpy(nv,alpha_i,ps[j],x[j],
+                                             x[j]);
+            zeta_old[j] = zeta[j];
+            zeta[j] = zeta_new;
+        }
+
+        // rho := r.r, and x_i.x_i for the stopping tests, in one go
+        red[0] = localip(nu,r,r);
+        for(j=0; j<nshift; j++)
+            red[j+1] = (active[j] ? localip(nv,x[j],x[j]) : 0.0);
+        bspreduce(p,s,nshift+1,red);
+        rho_old = rho;
+        rho = red[0];
+        beta = rho/rho_old;
+        k++;
+
+        // p_i := beta_i*p_i - zeta_i*beta*p, before p itself moves on
+        for(j=0; j<nshift; j++) {
+            if (!active[j])
+                continue;
+            stats[j].iters = k;
+            stats[j].residual = fabs(zeta[j])*sqrt(rho);
+            if (!(stats[j].residual > cg->eps * red[j+1])) {
+                stats[j].converged = 1;
+                active[j] = 0;
+                nactive--;
+                HERE("Shift %e converged after %d iterations\n", shift[j], k);
+                continue;
+            }
+            beta_i = beta*(zeta[j]/zeta_old[j])*(zeta[j]/zeta_old[j]);
+            for(i=0; i<nv; i++)
+                ps[j][i] = beta_i*ps[j][i] - zeta[j]*beta*pvec[i];
+        }
+
+        // p := r + beta*p
+        scalevec(nv, beta, pvec);
+        addvec(nv,pvec,nu,r,cg->v2uproc,cg->v2uind);
+
+        // p_i := p_i + zeta_i*p, which makes p_i = zeta_i*r + beta_i*p_i
+        for(j=0; j<nshift; j++)
+            if (active[j])
+                local_axpy(nv,zeta[j],pvec,ps[j],
+                                                 ps[j]);
+
+        alpha_old = alpha;
+        beta_old = beta;
+    }
+
+    bsp_sync();
+    for(j=0; j<nshift; j++)
+        stats[j].time = bsp_time() - time0;
+
+    vecfreei(active);
+    vecfreed(red);
+    vecfreed(zeta_old); vecfreed(zeta);
+    matfreed(ps);
+    vecfreed(w); vecfreed(pvec);
+    vecfreed(r);
+
+    return k;
+
+} /* end cgsolve_shifts */
@@ -0,0 +1,321 @@
+#include "bspedupack.h"
+#include "bspfuncs.h"
+#include "paullib.h"
+#include "cgsolver.h"
+#include "debug.h"
+
+/*
+ * Solvers for nonsymmetric systems, built on the same distributed
+ * kernels as CG: bspmv for u := A.v, copyvec to move a vector from the
+ * u to the v distribution, and bspreduce for inner products, which are
+ * batched so that one superstep serves several of them.
+ *
+ * Residuals and Krylov vectors live in the u distribution, solutions in
+ * the v distribution, as in cgsolve. Both methods stop when
+ * ||r|| <= eps * ||b||.
+ */
+
+/*
+ * Local inner product of two vectors in the same distribution.
+ */
+double localip(int n, double *x, double *y)
+{
+    int i;
+    double ip;
+
+    ip = 0.0;
+    for(i=0; i<n; i++)
+        ip += x[i]*y[i];
+    return ip;
+}
+
+/*
+ * Solve A.x = b with BiCGStab. Parameters are the same as for cgsolve;
+ * stats->iters counts iterations, each of which does two bspmv's.
+ */
+void bicgstab(cgsolver *cg, double *b, double *x0, double *x, cgstats *stats)
+{
+    int p, s, nu, nv, i, k, done;
+    double *r, *rhat, *pu, *pv, *vu, *su, *sv, *tu, time0,
+           rho, rho_old, alpha, omega, beta, normb, normr, ip[2];
+
+    p = cg->p; s = cg->s;
+    nu = cg->nu; nv = cg->nv;
+
+    bsp_sync();
+    time0 = bsp_time();
+
+    r    = vecallocd(nu);
+    rhat = vecallocd(nu);
+    pu   = vecallocd(nu);
+    vu   = vecallocd(nu);
+    su   = vecallocd(nu);
+    tu   = vecallocd(nu);
+    pv   = vecallocd(nv);
+    sv   = vecallocd(nv);
+
+    if (x0 == NULL) {
+        zero(nv,x);
+        for(i=0; i<nu; i++)
+            r[i] = b[i];
+    } else {
+        if (x != x0)
+            for(i=0; i<nv; i++)
+                x[i] = x0[i];
+        // r := b - Ax
+        bspmv(p,s,cg->n,cg->nz,cg->nrows,cg->ncols,cg->a,cg->inc,cg->srcprocv,cg->srcindv,
+              cg->destprocu,cg->destindu,nv,nu,x,vu,NULL);
+        local_axpy(nu,-1.0,vu,b,
+                                r);
+    }
+    for(i=0; i<nu; i++) {
+        rhat[i] = r[i];
+        pu[i] = vu[i] = 0.0;
+    }
+
+    ip[0] = localip(nu,b,b);
+    bspreduce(p,s,1,ip);
+    normb = sqrt(ip[0]);
+
+    rho_old = alpha = omega = 1.0;
+    k = 0;
+    done = 0;
+    while (k < cg->kmax) {
+        // rho := rhat.r, and ||r||^2 in the same reduction
+        ip[0] = localip(nu,rhat,r);
+        ip[1] = localip(nu,r,r);
+        bspreduce(p,s,2,ip);
+        rho = ip[0];
+        normr = sqrt(ip[1]);
+
+        if (s==0)
+            printf("[Iteration %02d] ||r|| = %e\n", k+1, normr);
+        if ((done = (normr <= cg->eps * normb)))
+            break;
+        if (rho == 0.0)
+            break; // breakdown
+
+        // p := r + beta*(p - omega*v)
+        beta = (rho/rho_old)*(alpha/omega);
+        for(i=0; i<nu; i++)
+            pu[i] = r[i] + beta*(pu[i] - omega*vu[i]);
+
+        // v := A.p
+        copyvec(s,nu,nv,pu,pv,cg->u2vproc,cg->u2vind);
+        bspmv(p,s,cg->n,cg->nz,cg->nrows,cg->ncols,cg->a,cg->inc,cg->srcprocv,cg->srcindv,
+              cg->destprocu,cg->destindu,nv,nu,pv,vu,NULL);
+
+        ip[0] = localip(nu,rhat,vu);
+        bspreduce(p,s,1,ip);
+        alpha = rho/ip[0];
+
+        // s := r - alpha*v, t := A.s
+        local_axpy(nu,-alpha,vu,r,
+                                  su);
+        copyvec(s,nu,nv,su,sv,cg->u2vproc,cg->u2vind);
+        bspmv(p,s,cg->n,cg->nz,cg->nrows,cg->ncols,cg->a,cg->inc,cg->srcprocv,cg->srcindv,
+              cg->destprocu,cg->destindu,nv,nu,sv,tu,NULL);
+
+        // omega := t.s / t.t
+        ip[0] = localip(nu,tu,su);
+        ip[1] = localip(nu,tu,tu);
+        bspreduce(p,s,2,ip);
+        omega = (ip[1] == 0.0 ? 0.0 : ip[0]/ip[1]);
+
+        // x := x + alpha*p + omega*s, r := s - omega*t
+        for(i=0; i<nv; i++)
+            x[i] += alpha*pv[i] + omega*sv[i];
+        local_axpy(nu,-omega,tu,su,
+                                   r);
+
+        rho_old = rho;
+        k++;
+        if (omega == 0.0)
+            break; // breakdown
+    }
+    if (!done) {
+        // r may have changed since normr was computed
+        ip[0] = localip(nu,r,r);
+        bspreduce(p,s,1,ip);
+        normr = sqrt(ip[0]);
+    }
+
+    bsp_sync();
+    stats->time = bsp_time() - time0;
+    stats->iters = k;
+    stats->outer = 0;
+    stats->converged = done;
+    stats->residual = normr;
+
+    vecfreed(sv); vecfreed(pv);
+    vecfreed(tu); vecfreed(su);
+    vecfreed(vu); vecfreed(pu);
+    vecfreed(rhat); vecfreed(r);
+
+} /* end bicgstab */
+
+/*
+ * Solve A.x = b with restarted GMRES(m), m = cg->restart. Parameters
+ * are the same as for cgsolve; stats->iters counts Arnoldi steps (one
+ * bspmv each) and stats->outer the number of restart cycles.
+ *
+ * The Arnoldi step uses classical Gram-Schmidt, so that all inner
+ * products of the new vector w with the basis, and w.w itself, are done
+ * in a single bspreduce; the norm of the orthogonalised vector then
+ * follows from Pythagoras. Only if that loses too many digits do we
+ * spend a second reduction on computing the norm directly.
+ */
+void gmres(cgsolver *cg, double *b, double *x0, double *x, cgstats *stats)
+{
+    int p, s, nu, nv, m, i, j, l, k, outer, done;
+    double **V, **H, *vv, *w, *z, *h, *cs, *sn, *g, *y, time0,
+           normb, beta, resid, hh, t;
+
+    p = cg->p; s = cg->s;
+    nu = cg->nu; nv = cg->nv;
+    m = cg->restart;
+
+    bsp_sync();
+    time0 = bsp_time();
+
+    V  = matallocd(m+1, nu);   /* Krylov basis, u distribution */
+    H  = matallocd(m+1, m);    /* Hessenberg matrix, H[i][j] */
+    vv = vecallocd(nv);        /* basis vector in the v distribution */
+    w  = vecallocd(nu);
+    z  = vecallocd(nu);
+    h  = vecallocd(m+2);
+    cs = vecallocd(m);
+    sn = vecallocd(m);
+    g  = vecallocd(m+1);
+    y  = vecallocd(m);
+
+    if (x0 == NULL)
+        zero(nv,x);
+    else if (x != x0)
+        for(i=0; i<nv; i++)
+            x[i] = x0[i];
+
+    h[0] = localip(nu,b,b);
+    bspreduce(p,s,1,h);
+    normb = sqrt(h[0]);
+
+    k = 0;
+    outer = 0;
+    done = 0;
+    resid = normb;
+    while (k < cg->kmax) {
+        // r := b - Ax, the true residual at the start of every cycle
+        bspmv(p,s,cg->n,cg->nz,cg->nrows,cg->ncols,cg->a,cg->inc,cg->srcprocv,cg->srcindv,
+              cg->destprocu,cg->destindu,nv,nu,x,w,NULL);
+        local_axpy(nu,-1.0,w,b,
+                               V[0]);
+        h[0] = localip(nu,V[0],V[0]);
+        bspreduce(p,s,1,h);
+        beta = resid = sqrt(h[0]);
+
+        if (s==0)
+            printf("[Restart %02d] ||r|| = %e\n", outer, resid);
+        if ((done = (resid <= cg->eps * normb)))
+            break;
+
+        scalevec(nu, 1.0/beta, V[0]);
+        g[0] = beta;
+
+        for(j=0; j<m && k<cg->kmax; j++) {
+            // w := A.v_j
+            copyvec(s,nu,nv,V[j],vv,cg->u2vproc,cg->u2vind);
+            bspmv(p,s,cg->n,cg->nz,cg->nrows,cg->ncols,cg->a,cg->inc,cg->srcprocv,cg->srcindv,
+                  cg->destprocu,cg->destindu,nv,nu,vv,w,NULL);
+            k++;
+
+            // h_ij := v_i.w for i <= j, and w.w, in one reduction
+            for(i=0; i<=j; i++)
+                h[i] = localip(nu,V[i],w);
+            h[j+1] = localip(nu,w,w);
+            bspreduce(p,s,j+2,h);
+
+            // classical Gram-Schmidt
+            hh = h[j+1];
+            for(i=0; i<=j; i++) {
+                H[i][j] = h[i];
+                hh -= h[i]*h[i];
+                for(l=0; l<nu; l++)
+                    w[l] -= h[i]*V[i][l];
+            }
+            if (hh <= GMRESCANCEL*h[j+1]) {
+                // cancellation, compute the norm the honest way.
+                h[0] = localip(nu,w,w);
+                bspreduce(p,s,1,h);
+                hh = h[0];
+            }
+            H[j+1][j] = sqrt(hh > 0.0 ? hh : 0.0);
+            for(l=0; l<nu; l++)
+                V[j+1][l] = (H[j+1][j] > 0.0 ? w[l]/H[j+1][j] : 0.0);
+
+            // apply the previous Givens rotations to the new column,
+            // and make a new one to eliminate H[j+1][j]
+            for(i=0; i<j; i++) {
+                t = cs[i]*H[i][j] + sn[i]*H[i+1][j];
+                H[i+1][j] = -sn[i]*H[i][j] + cs[i]*H[i+1][j];
+                H[i][j] = t;
+            }
+            t = sqrt(H[j][j]*H[j][j] + H[j+1][j]*H[j+1][j]);
+            cs[j] = (t == 0.0 ? 1.0 : H[j][j]/t);
+            sn[j] = (t == 0.0 ? 0.0 : H[j+1][j]/t);
+            H[j][j] = t;
+            H[j+1][j] = 0.0;
+            g[j+1] = -sn[j]*g[j];
+            g[j] = cs[j]*g[j];
+
+            resid = fabs(g[j+1]);
+            if (s==0)
+                printf("[Iteration %02d] ||r|| = %e\n", k, resid);
+            if (resid <= cg->eps * normb) {
+                j++;
+                break;
+            }
+        }
+
+        // y := H^-1 g, then x := x + V y
+        for(i=j-1; i>=0; i--) {
+            y[i] = g[i];
+            for(l=i+1; l<j; l++)
+                y[i] -= H[i][l]*y[l];
+            y[i] /= H[i][i];
+        }
+        for(l=0; l<nu; l++) {
+            z[l] = 0.0;
+            for(i=0; i<j; i++)
+                z[l] += y[i]*V[i][l];
+        }
+        addvec(nv,x,nu,z,cg->v2uproc,cg->v2uind);
+        outer++;
+    }
+
+    if (!done) {
+        // kmax reached, possibly in the cycle whose estimate converged:
+        // decide on the true residual, as at the start of a cycle.
+        bspmv(p,s,cg->n,cg->nz,cg->nrows,cg->ncols,cg->a,cg->inc,cg->srcprocv,cg->srcindv,
+              cg->destprocu,cg->destindu,nv,nu,x,w,NULL);
+        local_axpy(nu,-1.0,w,b,
+                               V[0]);
+        h[0] = localip(nu,V[0],V[0]);
+        bspreduce(p,s,1,h);
+        resid = sqrt(h[0]);
+        done = (resid <= cg->eps * normb);
+    }
+
+    bsp_sync();
+    stats->time = bsp_time() - time0;
+    stats->iters = k;
+    stats->outer = outer;
+    stats->converged = done;
+    stats->residual = resid;
+
+    vecfreed(y);  vecfreed(g);
+    vecfreed(sn); vecfreed(cs);
+    vecfreed(h);  vecfreed(z);
+    vecfreed(w);  vecfreed(vv);
+    matfreed(H);  matfreed(V);
+
+} /* end gmres */
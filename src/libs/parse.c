@@ -0,0 +1,457 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "parse.h"
+
+/*
+ * Hand-written parsing of the text input files.
+ *
+ * fscanf spends most of its time interpreting the format string, taking
+ * the stream lock and consulting the locale, once for every field. Here
+ * the file is read in chunks of PARSECHUNK bytes and the fields of each
+ * line are converted directly from the buffer.
+ *
+ * Integers are plain decimal. A floating point number whose significant
+ * digits fit in 53 bits and whose decimal exponent is at most 22 in
+ * absolute value, which covers everything written with %lf or %.17g of
+ * modest magnitude, is converted with a single exactly rounded
+ * multiplication or division (Clinger's fast path), so the result is
+ * bit for bit the one fscanf gives. Anything else (more digits, large
+ * exponents, inf, nan, hexadecimal) is passed on to strtod.
+ *
+ * The lines of a chunk can be parsed by several threads: the chunk is
+ * cut into pieces at newlines, and the number of lines in each piece
+ * tells where its records go.
+ */
+
+#define PARSE_VALUES  1   /* "a" */
+#define PARSE_PAIRS   2   /* "i j" */
+#define PARSE_TRIPLES 3   /* "i j a" */
+
+const double pow10tab[23] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+typedef struct {
+    const char *c, *stop;   /* the lines to parse */
+    int kind;
+    gidx *ia, *ja;
+    double *a;
+    long nlines;            /* number of lines in [c,stop) */
+    long parsed;            /* number of lines parsed correctly */
+} parsejob;
+
+/*
+ * Number of parser threads, from the environment variable CG_THREADS.
+ */
+int parsethreads(void)
+{
+    char *env;
+    int t;
+
+    env = getenv("CG_THREADS");
+    if (env == NULL)
+        return 1;
+    t = atoi(env);
+    if (t < 1)
+        t = 1;
+    if (t > PARSEMAXTHREADS)
+        t = PARSEMAXTHREADS;
+    return t;
+}
+
+/*
+ * Convert the decimal integer at c. *end is set after it, or to c itself
+ * if there is no integer there or it does not fit in a gidx.
+ */
+gidx fastatog(const char *c, const char **end)
+{
+    const char *c0;
+    uint64_t v;
+    int neg;
+
+    c0 = c;
+    neg = 0;
+    if (*c == '-' || *c == '+') {
+        neg = (*c == '-');
+        c++;
+    }
+    if (*c < '0' || *c > '9') {
+        *end = c0;
+        return 0;
+    }
+    v = 0;
+    for (; *c >= '0' && *c <= '9'; c++) {
+        v = 10*v + (*c - '0');
+        if (v > GIDXMAX) {
+            *end = c0;
+            return 0;
+        }
+    }
+    *end = c;
+    return (neg ? -(gidx)v : (gidx)v);
+}
+
+/*
+ * strtod for what fastatof cannot do. The buffers we parse are not
+ * NUL-terminated, and strtod would skip newlines and read on past the
+ * end, so the number, which ends at the first blank, is copied first.
+ */
+double slowatof(const char *c, const char **end)
+{
+    char tok[PARSETOKEN], *e;
+    int len;
+    double v;
+
+    len = 0;
+    while (len < PARSETOKEN-1 && c[len] != ' ' && c[len] != '\t' &&
+           c[len] != '\r' && c[len] != '\n' && c[len] != '\0')
+        len++;
+    memcpy(tok, c, len);
+    tok[len] = '\0';
+    v = strtod(tok, &e);
+    *end = c + (e - tok);
+    return v;
+}
+
+/*
+ * Convert the floating point number at c, like strtod in the C locale.
+ * *end is set after it, or to c itself if there is no number there.
+ */
+double fastatof(const char *c, const char **end)
+{
+    const char *c0, *ce;
+    uint64_t m;
+    int neg, any, exact, nd, d, e10, esign, ex;
+    double v;
+
+    c0 = c;
+    neg = 0;
+    if (*c == '-' || *c == '+') {
+        neg = (*c == '-');
+        c++;
+    }
+
+    // significant digits go into m, as long as they fit
+    m = 0; nd = 0; e10 = 0;
+    any = 0; exact = 1;
+    for (; *c >= '0' && *c <= '9'; c++) {
+        any = 1;
+        d = *c - '0';
+        if (nd < 19) {
+            m = 10*m + d;
+            if (m > 0)
+                nd++;
+        } else {
+            e10++;
+            if (d)
+                exact = 0;
+        }
+    }
+    if (*c == '.') {
+        c++;
+        for (; *c >= '0' && *c <= '9'; c++) {
+            any = 1;
+            d = *c - '0';
+            if (nd < 19) {
+                m = 10*m + d;
+                if (m > 0)
+                    nd++;
+                e10--;
+            } else if (d) {
+                exact = 0;
+            }
+        }
+    }
+    if (*c == 'e' || *c == 'E') {
+        ce = c + 1;
+        esign = 1;
+        if (*ce == '-' || *ce == '+') {
+            esign = (*ce == '-' ? -1 : 1);
+            ce++;
+        }
+        if (*ce >= '0' && *ce <= '9') {
+            ex = 0;
+            for (; *ce >= '0' && *ce <= '9'; ce++)
+                if (ex < 100000)
+                    ex = 10*ex + (*ce - '0');
+            e10 += esign*ex;
+            c = ce;
+        }
+    }
+
+    // inf, nan, hexadecimal and the like: leave it to the library
+    if (!any || ((*c | 32) >= 'a' && (*c | 32) <= 'z'))
+        return slowatof(c0, end);
+
+    if (m == 0) {
+        v = 0.0;
+    } else if (exact && m <= ((uint64_t)1 << 53) && e10 >= -22 && e10 <= 22) {
+        v = (double)m;
+        v = (e10 < 0 ? v / pow10tab[-e10] : v * pow10tab[e10]);
+    } else {
+        return slowatof(c0, end);
+    }
+    *end = c;
+    return (neg ? -v : v);
+}
+
+/*
+ * Parse the lines [c,stop), each ending in a newline, into the arrays.
+ * Returns the number of lines parsed before the first bad one.
+ */
+long parselines(const char *c, const char *stop, int kind,
+                gidx *ia, gidx *ja, double *a)
+{
+    const char *e;
+    long k;
+
+    k = 0;
+    while (c < stop) {
+        while (*c == ' ' || *c == '\t')
+            c++;
+        if (kind != PARSE_VALUES) {
+            ia[k] = fastatog(c, &e);
+            if (e == c)
+                return k;
+            c = e;
+            while (*c == ' ' || *c == '\t')
+                c++;
+            ja[k] = fastatog(c, &e);
+            if (e == c)
+                return k;
+            c = e;
+            while (*c == ' ' || *c == '\t')
+                c++;
+        }
+        if (kind != PARSE_PAIRS) {
+            a[k] = fastatof(c, &e);
+            if (e == c)
+                return k;
+            c = e;
+        }
+        while (*c == ' ' || *c == '\t' || *c == '\r')
+            c++;
+        if (*c != '\n')
+            return k;
+        c++;
+        k++;
+    }
+    return k;
+}
+
+void *parsework(void *arg)
+{
+    parsejob *job;
+
+    job = arg;
+    job->parsed = parselines(job->c, job->stop, job->kind, job->ia, job->ja, job->a);
+    return NULL;
+}
+
+/*
+ * Number of newlines in [c,stop).
+ */
+long countlines(const char *c, const char *stop)
+{
+    const char *nl;
+    long n;
+
+    n = 0;
+    while (c < stop && (nl = memchr(c, '\n', stop - c)) != NULL) {
+        c = nl + 1;
+        n++;
+    }
+    return n;
+}
+
+/*
+ * Parse the nlines lines [c,stop), with several threads if there are
+ * enough of them. Returns the number of lines parsed before the first
+ * bad one.
+ */
+long parsechunk(fastreader *r, const char *c, const char *stop, long nlines,
+                int kind, gidx *ia, gidx *ja, double *a)
+{
+    parsejob job[PARSEMAXTHREADS];
+    pthread_t thread[PARSEMAXTHREADS];
+    int started[PARSEMAXTHREADS];
+    int nt, t;
+    const char *cut, *nl;
+    long first;
+
+    nt = r->nthreads;
+    if (nt > nlines / PARSEMINLINES)
+        nt = nlines / PARSEMINLINES;
+    if (nt <= 1)
+        return parselines(c, stop, kind, ia, ja, a);
+
+    // cut into nt pieces of about equal size, at line boundaries
+    first = 0;
+    for (t = 0; t < nt; t++) {
+        job[t].c = (t == 0 ? c : job[t-1].stop);
+        if (t == nt-1) {
+            cut = stop;
+        } else {
+            cut = c + (stop - c) / nt * (t+1);
+            if (cut < job[t].c)
+                cut = job[t].c;
+            nl = memchr(cut, '\n', stop - cut);
+            cut = (nl == NULL ? stop : nl + 1);
+        }
+        job[t].stop = cut;
+        job[t].kind = kind;
+        job[t].nlines = countlines(job[t].c, job[t].stop);
+        job[t].ia = (ia == NULL ? NULL : ia + first);
+        job[t].ja = (ja == NULL ? NULL : ja + first);
+        job[t].a  = (a  == NULL ? NULL : a  + first);
+        first += job[t].nlines;
+    }
+
+    for (t = 1; t < nt; t++)
+        started[t] = (pthread_create(&thread[t], NULL, parsework, &job[t]) == 0);
+    parsework(&job[0]);
+    for (t = 1; t < nt; t++) {
+        if (started[t])
+            pthread_join(thread[t], NULL);
+        else
+            parsework(&job[t]);
+    }
+
+    first = 0;
+    for (t = 0; t < nt; t++) {
+        if (job[t].parsed < job[t].nlines)
+            return first + job[t].parsed;
+        first += job[t].nlines;
+    }
+    return first;
+}
+
+/*
+ * Start reading fp with a fastreader, from its current position.
+ * Returns 0, or -1 if there is not enough memory.
+ */
+int fastopen(fastreader *r, FILE *fp)
+{
+    r->fp = fp;
+    r->cap = PARSECHUNK;
+    // one spare byte for a newline after an unterminated last line
+    r->buf = malloc(r->cap + 1);
+    r->start = r->end = 0;
+    r->eof = 0;
+    r->nthreads = parsethreads();
+    return (r->buf == NULL ? -1 : 0);
+}
+
+/*
+ * Stop reading with a fastreader. The file itself stays open; its
+ * position is undefined, as the reader reads ahead.
+ */
+void fastclose(fastreader *r)
+{
+    free(r->buf);
+    r->buf = NULL;
+}
+
+/*
+ * Move the unparsed data to the front of the buffer and read more after
+ * it, growing the buffer if a single line does not fit. Returns -1 if
+ * there is not enough memory.
+ */
+int fastfill(fastreader *r)
+{
+    size_t len, got;
+    char *buf;
+
+    len = r->end - r->start;
+    if (r->start > 0)
+        memmove(r->buf, r->buf + r->start, len);
+    r->start = 0;
+    r->end = len;
+    if (len == r->cap) {
+        buf = realloc(r->buf, 2*r->cap + 1);
+        if (buf == NULL)
+            return -1;
+        r->buf = buf;
+        r->cap *= 2;
+    }
+
+    got = fread(r->buf + r->end, 1, r->cap - r->end, r->fp);
+    r->end += got;
+    if (got == 0) {
+        r->eof = 1;
+        if (r->end > 0 && r->buf[r->end-1] != '\n')
+            r->buf[r->end++] = '\n';
+    }
+    return 0;
+}
+
+/*
+ * Read count lines of the given kind. Returns the number of records
+ * read, which is less than count if the input ends early or has a bad
+ * line.
+ */
+long fastlines(fastreader *r, long count, int kind, gidx *ia, gidx *ja, double *a)
+{
+    const char *c, *stop, *nl;
+    long done, nlines, parsed;
+
+    done = 0;
+    while (done < count) {
+        if (!r->eof && r->end - r->start < r->cap/2 && fastfill(r) < 0)
+            return done;
+
+        // the complete lines in the buffer, as many as are needed
+        c = r->buf + r->start;
+        stop = c;
+        nlines = 0;
+        while (nlines < count - done &&
+               (nl = memchr(stop, '\n', r->buf + r->end - stop)) != NULL) {
+            stop = nl + 1;
+            nlines++;
+        }
+        if (nlines == 0) {
+            // no complete line: read on, or give up at the end
+            if (r->eof || fastfill(r) < 0)
+                return done;
+            continue;
+        }
+
+        parsed = parsechunk(r, c, stop, nlines, kind,
+                            (ia == NULL ? NULL : ia + done),
+                            (ja == NULL ? NULL : ja + done),
+                            (a  == NULL ? NULL : a  + done));
+        done += parsed;
+        if (parsed < nlines)
+            return done;
+        r->start = stop - r->buf;
+    }
+    return done;
+}
+
+/*
+ * Read count lines "i j a" into ia, ja and a. Returns the number read.
+ */
+long fasttriples(fastreader *r, long count, gidx *ia, gidx *ja, double *a)
+{
+    return fastlines(r, count, PARSE_TRIPLES, ia, ja, a);
+}
+
+/*
+ * Read count lines "i j" into ia and ja. Returns the number read.
+ */
+long fastpairs(fastreader *r, long count, gidx *ia, gidx *ja)
+{
+    return fastlines(r, count, PARSE_PAIRS, ia, ja, NULL);
+}
+
+/*
+ * Read count lines with a single value into a. Returns the number read.
+ */
+long fastvalues(fastreader *r, long count, double *a)
+{
+    return fastlines(r, count, PARSE_VALUES, NULL, NULL, a);
+}
@@ -0,0 +1,46 @@
+#ifndef __PARSE
+#define __PARSE
+
+#include <stdio.h>
+#include "gidx.h"
+
+/*
+ * Fast, locale-free parsing of the line-oriented text files we read:
+ * matrix triples "i j a" and distribution lines "i proc".
+ *
+ * A fastreader takes over an open file at its current position (so a
+ * header can be read with fscanf first) and reads it in large chunks.
+ * Lines are parsed by hand instead of with fscanf; with more than one
+ * thread, a chunk is split at line boundaries and the pieces are parsed
+ * concurrently. The number of threads is taken from the environment
+ * variable CG_THREADS, default 1.
+ *
+ * Every line holds one record; the last line need not end in a newline.
+ */
+
+#define PARSECHUNK (1<<22)       /* bytes read at a time */
+#define PARSEMINLINES (1<<14)    /* fewer lines than this are parsed serially */
+#define PARSEMAXTHREADS (64)
+#define PARSEBATCH (1<<18)       /* records the readers parse at a time */
+#define PARSETOKEN (64)          /* longest number passed on to strtod */
+
+typedef struct {
+    FILE *fp;
+    char *buf;
+    size_t start, end;   /* unparsed data is buf[start..end) */
+    size_t cap;
+    int eof;
+    int nthreads;
+} fastreader;
+
+int fastopen(fastreader *r, FILE *fp);
+void fastclose(fastreader *r);
+long fasttriples(fastreader *r, long count, gidx *ia, gidx *ja, double *a);
+long fastpairs(fastreader *r, long count, gidx *ia, gidx *ja);
+long fastvalues(fastreader *r, long count, double *a);
+int parsethreads(void);
+gidx fastatog(const char *c, const char **end);
+double fastatof(const char *c, const char **end);
+double slowatof(const char *c, const char **end);
+
+#endif
@@ -0,0 +1,1168 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include "partition.h"
+#include "bspedupack.h"
+#include "bspfuncs.h"
+#include "vecio.h"
+#include "paullib.h"
+#include "debug.h"
+
+const char *partnames[NPARTMETHODS] = {"block", "cyclic", "graph"};
+
+/*
+ * Parse a partitioning method, "block", "cyclic" or "graph", optionally
+ * followed by ",2d" (or ",1d", the default). Returns 0 on success and
+ * -1 if spec is not understood.
+ */
+int partbyname(const char *spec, int *method, int *twod)
+{
+    int m;
+    size_t len;
+    const char *comma;
+
+    comma = strchr(spec, ',');
+    len = (comma != NULL ? (size_t)(comma - spec) : strlen(spec));
+    *twod = 0;
+    if (comma != NULL) {
+        if (strcmp(comma+1, "2d") == 0)
+            *twod = 1;
+        else if (strcmp(comma+1, "1d") != 0)
+            return -1;
+    }
+    for (m = 0; m < NPARTMETHODS; m++) {
+        if (strlen(partnames[m]) == len && strncmp(spec, partnames[m], len) == 0) {
+            *method = m;
+            return 0;
+        }
+    }
+    return -1;
+
+} /* end partbyname */
+
+/*
+ * The processor grid of a 2D distribution: pr x pc = p with pr the
+ * largest divisor of p not above its square root. For a prime p this is
+ * 1 x p, a distribution by columns.
+ */
+void partgrid(int p, int *pr, int *pc)
+{
+    int r;
+
+    for (r = 1; (r+1)*(r+1) <= p; r++)
+        ;
+    while (p % r != 0)
+        r--;
+    *pr = r;
+    *pc = p / r;
+
+} /* end partgrid */
+
+/*
+ * First index of block q of n indices cut into p blocks, the first n%p
+ * of them one larger; the same blocks as cgsetupgen uses.
+ */
+gidx partblockstart(int p, gidx n, int q)
+{
+    return q*(n/p) + (q < n%p ? q : n%p);
+
+} /* end partblockstart */
+
+/*
+ * The block that index i is in, see partblockstart.
+ */
+int partblock(int p, gidx n, gidx i)
+{
+    gidx b, r;
+
+    b = n/p;
+    r = n%p;
+    if (i < r*(b+1))
+        return (int)(i/(b+1));
+    return (int)(r + (i - r*(b+1))/b);
+
+} /* end partblock */
+
+/*
+ * The part of index i for the methods that need no graph.
+ */
+int partof(int method, int p, gidx n, gidx i)
+{
+    if (method == PART_CYCLIC)
+        return (int)(i % p);
+    return partblock(p, n, i);
+
+} /* end partof */
+
+/*
+ * The processor that owns vertex i of a distributed graph.
+ */
+int partowner(int p, gidx *vtxdist, gidx i)
+{
+    int lo, hi, mid;
+
+    lo = 0;
+    hi = p-1;
+    while (lo < hi) {
+        mid = (lo+hi+1)/2;
+        if (vtxdist[mid] <= i)
+            lo = mid;
+        else
+            hi = mid-1;
+    }
+    return lo;
+
+} /* end partowner */
+
+/*
+ * Send item k of items, each size bytes, to processor dest[k], and
+ * receive the items sent to us in *pout, their number in *pm. They come
+ * in order of the sending processor, and per sender in their original
+ * order. A single superstep does it: every processor puts the number of
+ * items it sends into an array of the destination, so the receiver
+ * knows where the message of each sender goes, and sends them as one
+ * message per destination.
+ */
+void partexchange(int p, int s, int n, int *dest, size_t size,
+                  void *items, int *pm, void **pout)
+{
+    int q, k, nmsg, status, tag, *cnt, *start, *incnt, *inoff;
+    long total;
+    char *buf, *out;
+
+#ifdef __GNUC__
+    size_t tagsz, nbytes;
+#else
+    int tagsz, nbytes;
+#endif
+
+    cnt = vecalloci(p);
+    start = vecalloci(p+1);
+    incnt = vecalloci(p);
+    inoff = vecalloci(p);
+    for (q = 0; q < p; q++)
+        cnt[q] = incnt[q] = 0;
+    for (k = 0; k < n; k++)
+        cnt[dest[k]]++;
+    start[0] = 0;
+    for (q = 0; q < p; q++)
+        start[q+1] = start[q] + cnt[q];
+
+    /* sort the items by destination */
+    buf = malloc((size_t)n*size + 1);
+    if (buf == NULL)
+        bsp_abort("partexchange: not enough memory");
+    for (q = 0; q < p; q++)
+        inoff[q] = start[q];
+    for (k = 0; k < n; k++)
+        memcpy(buf + (size_t)(inoff[dest[k]]++)*size, (char *)items + (size_t)k*size, size);
+
+    bsp_push_reg(incnt, p*SZINT);
+    tagsz = SZINT;
+    bsp_set_tagsize(&tagsz);
+    bsp_sync();
+
+    for (q = 0; q < p; q++) {
+        if (cnt[q] == 0)
+            continue;
+        bsp_put(q, &cnt[q], incnt, s*SZINT, SZINT);
+        bsp_send(q, &s, buf + (size_t)start[q]*size, (size_t)cnt[q]*size);
+    }
+    bsp_sync();
+
+    total = 0;
+    for (q = 0; q < p; q++) {
+        inoff[q] = (int)total;
+        total += incnt[q];
+    }
+    if (total > INT_MAX)
+        bsp_abort("Error: processor %d receives more than %d items\n", s, INT_MAX);
+    out = malloc((size_t)total*size + 1);
+    if (out == NULL)
+        bsp_abort("partexchange: not enough memory");
+    bsp_qsize(&nmsg, &nbytes);
+    for (k = 0; k < nmsg; k++) {
+        // the tag tells us who sent it, and so where it goes
+        bsp_get_tag(&status, &tag);
+        bsp_move(out + (size_t)inoff[tag]*size, status);
+    }
+    bsp_pop_reg(incnt);
+
+    free(buf);
+    vecfreei(inoff); vecfreei(incnt);
+    vecfreei(start); vecfreei(cnt);
+    *pm = (int)total;
+    *pout = out;
+
+} /* end partexchange */
+
+/*
+ * Order edges by neighbour, for qsort.
+ */
+int partcmpedge(const void *x, const void *y)
+{
+    gidx a = ((const partedge *)x)->v, b = ((const partedge *)y)->v;
+
+    return (a > b) - (a < b);
+
+} /* end partcmpedge */
+
+/*
+ * Make the adjacency lists of G from the edges e[xadj[v]..end[v]-1] of
+ * each local vertex v: sorted, with the weights of edges to the same
+ * neighbour added up. e and xadj are overwritten.
+ */
+void partmerge(partgraph *G, int *xadj, int *end, partedge *e)
+{
+    int v, k, ne;
+
+    ne = 0;
+    for (v = 0; v < G->nvtx; v++) {
+        qsort(&e[xadj[v]], end[v]-xadj[v], sizeof(partedge), partcmpedge);
+        k = xadj[v];
+        xadj[v] = ne;
+        for (; k < end[v]; k++) {
+            if (ne > xadj[v] && e[ne-1].v == e[k].v)
+                e[ne-1].w += e[k].w;
+            else
+                e[ne++] = e[k];
+        }
+    }
+    xadj[G->nvtx] = ne;
+
+    G->xadj = vecalloci(G->nvtx+1);
+    G->adj = vecallocg(ne);
+    G->adjwgt = vecalloci(ne);
+    G->adjl = vecalloci(ne);
+    for (v = 0; v <= G->nvtx; v++)
+        G->xadj[v] = xadj[v];
+    for (k = 0; k < ne; k++) {
+        G->adj[k] = e[k].v;
+        G->adjwgt[k] = e[k].w;
+    }
+    G->cmap = NULL;
+
+} /* end partmerge */
+
+/*
+ * Find the neighbours of my vertices that are on other processors, and
+ * number all neighbours locally, see partgraph. Allocates the parts.
+ */
+void partghosts(partgraph *G, int s)
+{
+    int k, nr, ne;
+    gidx lo, hi, *remote;
+    indexmap m;
+
+    lo = G->vtxdist[s];
+    hi = G->vtxdist[s+1];
+    ne = G->xadj[G->nvtx];
+    remote = vecallocg(ne);
+    nr = 0;
+    for (k = 0; k < ne; k++)
+        if (G->adj[k] < lo || G->adj[k] >= hi)
+            remote[nr++] = G->adj[k];
+    mapinit(&m, nr, remote);
+    G->nghost = m.count;
+    G->ghost = vecallocg(m.count);
+    maplist(&m, G->ghost);
+    for (k = 0; k < ne; k++) {
+        if (G->adj[k] < lo || G->adj[k] >= hi)
+            G->adjl[k] = G->nvtx + maprank(&m, G->adj[k]);
+        else
+            G->adjl[k] = (int)(G->adj[k] - lo);
+    }
+    mapfree(&m);
+    vecfreeg(remote);
+    G->part = vecalloci(G->nvtx + G->nghost);
+
+} /* end partghosts */
+
+/*
+ * Build the graph of A+A^T from the nonzeros of my block of rows, see
+ * partblockstart: a vertex per row, weighted by its nonzeros, and an
+ * edge between i and j for a_ij or a_ji nonzero, weighted by how many of
+ * the two are. Edge j-i of a nonzero a_ij goes to the owner of row j.
+ */
+void partbuild(int p, int s, gidx n, int nz, gidx *ia, gidx *ja, partgraph *G)
+{
+    int q, k, v, m, nrev, *dest, *xadj, *fill;
+    gidx lo;
+    parttriple *rev, *in;
+    partedge *e;
+
+    G->vtxdist = vecallocg(p+1);
+    for (q = 0; q <= p; q++)
+        G->vtxdist[q] = partblockstart(p, n, q);
+    lo = G->vtxdist[s];
+    G->nvtx = (int)(G->vtxdist[s+1] - lo);
+
+    nrev = 0;
+    for (k = 0; k < nz; k++)
+        if (ia[k] != ja[k])
+            nrev++;
+    rev = malloc((size_t)nrev*sizeof(parttriple) + 1);
+    dest = vecalloci(nrev);
+    if (rev == NULL)
+        bsp_abort("partbuild: not enough memory");
+    nrev = 0;
+    for (k = 0; k < nz; k++) {
+        if (ia[k] == ja[k])
+            continue;
+        rev[nrev].i = ja[k];
+        rev[nrev].j = ia[k];
+        dest[nrev++] = partblock(p, n, ja[k]);
+    }
+    partexchange(p, s, nrev, dest, sizeof(parttriple), rev, &m, (void **)&in);
+    free(rev);
+    vecfreei(dest);
+
+    G->vwgt = vecallocg(G->nvtx);
+    xadj = vecalloci(G->nvtx+1);
+    for (v = 0; v <= G->nvtx; v++)
+        xadj[v] = 0;
+    for (v = 0; v < G->nvtx; v++)
+        G->vwgt[v] = 0;
+    for (k = 0; k < nz; k++) {
+        G->vwgt[ia[k]-lo]++;
+        if (ia[k] != ja[k])
+            xadj[ia[k]-lo+1]++;
+    }
+    for (k = 0; k < m; k++)
+        xadj[in[k].i-lo+1]++;
+    for (v = 0; v < G->nvtx; v++) {
+        xadj[v+1] += xadj[v];
+        if (G->vwgt[v] == 0)
+            G->vwgt[v] = 1;
+    }
+
+    e = malloc((size_t)xadj[G->nvtx]*sizeof(partedge) + 1);
+    if (e == NULL)
+        bsp_abort("partbuild: not enough memory");
+    fill = vecalloci(G->nvtx);
+    for (v = 0; v < G->nvtx; v++)
+        fill[v] = xadj[v];
+    for (k = 0; k < nz; k++) {
+        if (ia[k] == ja[k])
+            continue;
+        v = (int)(ia[k]-lo);
+        e[fill[v]].v = ja[k];
+        e[fill[v]++].w = 1;
+    }
+    for (k = 0; k < m; k++) {
+        v = (int)(in[k].i-lo);
+        e[fill[v]].v = in[k].j;
+        e[fill[v]++].w = 1;
+    }
+    free(in);
+    partmerge(G, xadj, fill, e);
+    free(e);
+    vecfreei(fill);
+    vecfreei(xadj);
+    partghosts(G, s);
+
+} /* end partbuild */
+
+/*
+ * Coarsen G into C by heavy edge matching: every vertex is matched to
+ * the unmatched neighbour on the same processor with the heaviest edge,
+ * as long as the pair weighs at most maxvwgt, and each pair or unmatched
+ * vertex becomes a vertex of C. Matching only local pairs means no
+ * processor has to agree with another; the numbers in C of the ghosts
+ * are fetched from their owners afterwards.
+ */
+void partcoarsen(int p, int s, partgraph *G, gidx maxvwgt, partgraph *C)
+{
+    int nv, v, u, k, q, g, cn, best, bw, *match, *cmapl, *gcmapl, *xadj, *fill;
+    gidx t, self, *counts;
+    partedge *e;
+
+    nv = G->nvtx;
+    match = vecalloci(nv);
+    cmapl = vecalloci(nv);
+    for (v = 0; v < nv; v++)
+        match[v] = -1;
+    for (v = 0; v < nv; v++) {
+        if (match[v] >= 0)
+            continue;
+        best = v;
+        bw = 0;
+        for (k = G->xadj[v]; k < G->xadj[v+1]; k++) {
+            u = G->adjl[k];
+            if (u < nv && u != v && match[u] < 0 && G->adjwgt[k] > bw &&
+                G->vwgt[v] + G->vwgt[u] <= maxvwgt) {
+                best = u;
+                bw = G->adjwgt[k];
+            }
+        }
+        match[v] = best;
+        match[best] = v;
+    }
+    cn = 0;
+    for (v = 0; v < nv; v++) {
+        if (match[v] >= v) {
+            cmapl[v] = cmapl[match[v]] = cn;
+            cn++;
+        }
+    }
+
+    /* everybody learns the coarse vertex counts, and the local coarse
+       numbers of its ghosts */
+    counts = vecallocg(p);
+    gcmapl = vecalloci(G->nghost);
+    bsp_push_reg(counts, p*SZGIDX);
+    bsp_push_reg(cmapl, nv*SZINT);
+    bsp_sync();
+    t = cn;
+    for (q = 0; q < p; q++)
+        bsp_put(q, &t, counts, s*SZGIDX, SZGIDX);
+    for (g = 0; g < G->nghost; g++) {
+        q = partowner(p, G->vtxdist, G->ghost[g]);
+        bsp_get(q, cmapl, (G->ghost[g] - G->vtxdist[q])*SZINT, &gcmapl[g], SZINT);
+    }
+    bsp_sync();
+    bsp_pop_reg(cmapl);
+    bsp_pop_reg(counts);
+
+    C->vtxdist = vecallocg(p+1);
+    C->vtxdist[0] = 0;
+    for (q = 0; q < p; q++)
+        C->vtxdist[q+1] = C->vtxdist[q] + counts[q];
+    C->nvtx = cn;
+    self = C->vtxdist[s];
+    G->cmap = vecallocg(nv);
+    for (v = 0; v < nv; v++)
+        G->cmap[v] = self + cmapl[v];
+
+    C->vwgt = vecallocg(cn);
+    xadj = vecalloci(cn+1);
+    for (v = 0; v < cn; v++)
+        C->vwgt[v] = 0;
+    for (v = 0; v <= cn; v++)
+        xadj[v] = 0;
+    for (v = 0; v < nv; v++) {
+        C->vwgt[cmapl[v]] += G->vwgt[v];
+        xadj[cmapl[v]+1] += G->xadj[v+1] - G->xadj[v];
+    }
+    for (v = 0; v < cn; v++)
+        xadj[v+1] += xadj[v];
+
+    /* the edges of the members of each coarse vertex, without the one
+       between them */
+    e = malloc((size_t)xadj[cn]*sizeof(partedge) + 1);
+    if (e == NULL)
+        bsp_abort("partcoarsen: not enough memory");
+    fill = vecalloci(cn);
+    for (v = 0; v < cn; v++)
+        fill[v] = xadj[v];
+    for (v = 0; v < nv; v++) {
+        for (k = G->xadj[v]; k < G->xadj[v+1]; k++) {
+            u = G->adjl[k];
+            if (u < nv) {
+                t = self + cmapl[u];
+            } else {
+                g = u - nv;
+                q = partowner(p, G->vtxdist, G->ghost[g]);
+                t = C->vtxdist[q] + gcmapl[g];
+            }
+            if (t == G->cmap[v])
+                continue;
+            e[fill[cmapl[v]]].v = t;
+            e[fill[cmapl[v]]++].w = G->adjwgt[k];
+        }
+    }
+    partmerge(C, xadj, fill, e);
+
+    free(e);
+    vecfreei(fill);
+    vecfreei(xadj);
+    vecfreei(gcmapl);
+    vecfreeg(counts);
+    vecfreei(cmapl);
+    vecfreei(match);
+    partghosts(C, s);
+
+} /* end partcoarsen */
+
+/*
+ * Split the vertices v with where[v] == lo of a small sequential graph
+ * into parts lo..lo+k-1, by recursive bisection. Each bisection grows
+ * the first half breadth first until it has its share of the weight,
+ * and then refines the cut. list is scratch space of n ints, queue of
+ * 2n.
+ */
+void partbisect(int n, int *xadj, int *adj, int *adjw, gidx *vw, int *where,
+                int lo, int k, unsigned long long seed, int *list, int *queue)
+{
+    int k0, side0, side1, ns, i, v, u, e, m, head, tail, next, pass, me;
+    int cur, best, nbest, *gain;
+    double W, w0, target0, bestdev, max0, max1;
+
+    if (k <= 1)
+        return;
+    gain = queue + n;
+    k0 = k/2;
+    side0 = lo;
+    side1 = lo + k0;
+
+    ns = 0;
+    W = 0.0;
+    for (v = 0; v < n; v++) {
+        if (where[v] == lo) {
+            list[ns++] = v;
+            W += vw[v];
+        }
+    }
+    if (ns == 0)
+        return;
+    for (i = 0; i < ns; i++)
+        where[list[i]] = side1;
+    target0 = W*k0/k;
+    max0 = (1.0+PARTIMBAL)*target0;
+    max1 = (1.0+PARTIMBAL)*(W-target0);
+
+    /* start from the far end of a breadth first search from a random
+       vertex, which finds the rim of a mesh rather than its middle */
+    v = list[(int)(ranindex(seed, lo)*ns)];
+    where[v] = -1;
+    head = tail = 0;
+    queue[tail++] = v;
+    while (head < tail) {
+        v = queue[head++];
+        for (e = xadj[v]; e < xadj[v+1]; e++) {
+            if (where[adj[e]] == side1) {
+                where[adj[e]] = -1;
+                queue[tail++] = adj[e];
+            }
+        }
+    }
+    for (i = 0; i < tail; i++)
+        where[queue[i]] = side1;
+
+    /* grow side 0, jumping to a new component when one runs out */
+    where[v] = side0;
+    w0 = vw[v];
+    head = tail = next = 0;
+    queue[tail++] = v;
+    while (w0 < target0) {
+        if (head == tail) {
+            while (next < ns && where[list[next]] != side1)
+                next++;
+            if (next == ns)
+                break;
+            v = list[next];
+            where[v] = side0;
+            w0 += vw[v];
+            queue[tail++] = v;
+            continue;
+        }
+        v = queue[head++];
+        for (e = xadj[v]; e < xadj[v+1] && w0 < target0; e++) {
+            u = adj[e];
+            if (where[u] == side1) {
+                where[u] = side0;
+                w0 += vw[u];
+                queue[tail++] = u;
+            }
+        }
+    }
+
+    /* refine by Fiduccia-Mattheyses: move the best vertex that keeps
+       the balance, even if that makes the cut worse, lock it, and in
+       the end go back to the best balanced state seen. Vertices outside
+       the subset have labels outside lo..lo+k-1. */
+    for (pass = 0; pass < PARTPASSES; pass++) {
+        for (i = 0; i < ns; i++) {
+            v = list[i];
+            gain[v] = 0;
+            for (e = xadj[v]; e < xadj[v+1]; e++) {
+                if (where[adj[e]] == side0 + side1 - where[v])
+                    gain[v] += adjw[e];
+                else if (where[adj[e]] == where[v])
+                    gain[v] -= adjw[e];
+            }
+        }
+        cur = 0;
+        best = (w0 <= max0 && W-w0 <= max1 ? 0 : INT_MIN);
+        bestdev = fabs(w0 - target0);
+        nbest = 0;
+        for (m = 0; m < ns && m - nbest < PARTSTALL; m++) {
+            v = -1;
+            for (i = 0; i < ns; i++) {
+                u = list[i];
+                if (gain[u] == INT_MIN || (v >= 0 && gain[u] <= gain[v]))
+                    continue;
+                if (where[u] == side0 ? (W-w0 + vw[u] <= max1 || w0 > max0)
+                                      : (w0 + vw[u] <= max0 || W-w0 > max1))
+                    v = u;
+            }
+            if (v < 0)
+                break;
+            me = where[v];
+            where[v] = side0 + side1 - me;
+            w0 += (me == side0 ? -vw[v] : vw[v]);
+            cur += gain[v];
+            gain[v] = INT_MIN;
+            queue[m] = v;
+            for (e = xadj[v]; e < xadj[v+1]; e++) {
+                u = adj[e];
+                if (gain[u] == INT_MIN || (where[u] != side0 && where[u] != side1))
+                    continue;
+                gain[u] += (where[u] == me ? 2 : -2)*adjw[e];
+            }
+            if (w0 <= max0 && W-w0 <= max1 &&
+                (cur > best || (cur == best && fabs(w0 - target0) < bestdev))) {
+                best = cur;
+                bestdev = fabs(w0 - target0);
+                nbest = m+1;
+            }
+        }
+        for (i = m-1; i >= nbest; i--) {
+            v = queue[i];
+            me = where[v];
+            where[v] = side0 + side1 - me;
+            w0 += (me == side0 ? -vw[v] : vw[v]);
+        }
+        if (nbest == 0)
+            break;
+    }
+
+    partbisect(n, xadj, adj, adjw, vw, where, side0, k0, seed, list, queue);
+    partbisect(n, xadj, adj, adjw, vw, where, side1, k-k0, seed, list, queue);
+
+} /* end partbisect */
+
+/*
+ * Partition the coarsest graph G into p parts. Every processor gathers
+ * the whole graph, bisects it recursively PARTTRIALS times with seeds of
+ * its own, and the partition with the smallest cut among the balanced
+ * ones wins; every
+ * processor then fetches the parts of its own vertices from the winner.
+ */
+void partinitial(int p, int s, partgraph *G)
+{
+    int q, k, v, e, t, nmsg, status, tag, N, nv, ne, best, *xadj, *adj, *adjw;
+    int *where, *trial, *list, *queue, *deg;
+    gidx *vw;
+    double W, cut, maxpw, limit, score, bestscore, *vals, *pw;
+    char *msg, **in;
+    size_t off;
+
+#ifdef __GNUC__
+    size_t tagsz, nbytes;
+#else
+    int tagsz, nbytes;
+#endif
+
+    if (G->vtxdist[p] > INT_MAX)
+        bsp_abort("Error: the coarsest graph has %" GIDX " vertices\n", G->vtxdist[p]);
+    N = (int)G->vtxdist[p];
+
+    /* my part of the graph: weights, degrees, neighbours, edge weights */
+    nv = G->nvtx;
+    ne = G->xadj[nv];
+    off = (size_t)nv*(SZGIDX+SZINT) + (size_t)ne*(SZGIDX+SZINT);
+    msg = malloc(off + 1);
+    if (msg == NULL)
+        bsp_abort("partinitial: not enough memory");
+    memcpy(msg, G->vwgt, nv*SZGIDX);
+    deg = (int *)(msg + nv*SZGIDX);
+    for (v = 0; v < nv; v++)
+        deg[v] = G->xadj[v+1] - G->xadj[v];
+    memcpy(msg + nv*(SZGIDX+SZINT), G->adj, ne*SZGIDX);
+    memcpy(msg + nv*(SZGIDX+SZINT) + ne*SZGIDX, G->adjwgt, ne*SZINT);
+
+    tagsz = SZINT;
+    bsp_set_tagsize(&tagsz);
+    bsp_sync();
+    for (q = 0; q < p; q++)
+        bsp_send(q, &s, msg, off);
+    bsp_sync();
+    free(msg);
+
+    in = malloc(p*sizeof(char *));
+    if (in == NULL)
+        bsp_abort("partinitial: not enough memory");
+    bsp_qsize(&nmsg, &nbytes);
+    for (k = 0; k < nmsg; k++) {
+        bsp_get_tag(&status, &tag);
+        in[tag] = malloc(status + 1);
+        if (in[tag] == NULL)
+            bsp_abort("partinitial: not enough memory");
+        bsp_move(in[tag], status);
+    }
+
+    /* assemble the whole graph, numbered as it is globally */
+    vw = vecallocg(N);
+    xadj = vecalloci(N+1);
+    xadj[0] = 0;
+    for (q = 0; q < p; q++) {
+        nv = (int)(G->vtxdist[q+1] - G->vtxdist[q]);
+        memcpy(&vw[G->vtxdist[q]], in[q], nv*SZGIDX);
+        deg = (int *)(in[q] + nv*SZGIDX);
+        for (v = 0; v < nv; v++)
+            xadj[G->vtxdist[q]+v+1] = xadj[G->vtxdist[q]+v] + deg[v];
+    }
+    adj = vecalloci(xadj[N]);
+    adjw = vecalloci(xadj[N]);
+    for (q = 0; q < p; q++) {
+        nv = (int)(G->vtxdist[q+1] - G->vtxdist[q]);
+        e = xadj[G->vtxdist[q]];
+        ne = xadj[G->vtxdist[q+1]] - e;
+        for (k = 0; k < ne; k++) {
+            gidx t;
+
+            memcpy(&t, in[q] + nv*(SZGIDX+SZINT) + k*SZGIDX, SZGIDX);
+            adj[e+k] = (int)t;
+        }
+        memcpy(&adjw[e], in[q] + nv*(SZGIDX+SZINT) + ne*SZGIDX, ne*SZINT);
+        free(in[q]);
+    }
+    free(in);
+
+    /* my trials, keeping the best in where */
+    where = vecalloci(N);
+    trial = vecalloci(N);
+    list = vecalloci(N);
+    queue = vecalloci(2*N);
+    pw = vecallocd(p);
+    vals = vecallocd(2*p);
+    W = 0.0;
+    for (v = 0; v < N; v++)
+        W += vw[v];
+    limit = (1.0+PARTIMBAL)*W/p;
+    bestscore = 0.0;
+    for (t = 0; t < PARTTRIALS; t++) {
+        for (v = 0; v < N; v++)
+            trial[v] = 0;
+        partbisect(N, xadj, adj, adjw, vw, trial, 0, p,
+                   (unsigned long long)s*PARTTRIALS + t + 1, list, queue);
+        for (q = 0; q < p; q++)
+            pw[q] = 0.0;
+        cut = 0.0;
+        for (v = 0; v < N; v++) {
+            pw[trial[v]] += vw[v];
+            for (e = xadj[v]; e < xadj[v+1]; e++)
+                if (trial[adj[e]] != trial[v])
+                    cut += adjw[e];
+        }
+        maxpw = 0.0;
+        for (q = 0; q < p; q++)
+            if (pw[q] > maxpw)
+                maxpw = pw[q];
+        score = (maxpw > limit ? maxpw - limit : 0.0)*W + cut/2;
+        if (t == 0 || score < bestscore) {
+            bestscore = score;
+            vals[2*s] = cut/2;
+            vals[2*s+1] = maxpw;
+            for (v = 0; v < N; v++)
+                where[v] = trial[v];
+        }
+    }
+    for (q = 0; q < p; q++)
+        if (q != s)
+            vals[2*q] = vals[2*q+1] = 0.0;
+    bspreduce(p, s, 2*p, vals);
+
+    /* the smallest cut, among those within the allowed imbalance */
+    best = 0;
+    bestscore = 0.0;
+    for (q = 0; q < p; q++) {
+        score = (vals[2*q+1] > limit ? vals[2*q+1] - limit : 0.0)*W + vals[2*q];
+        if (q == 0 || score < bestscore) {
+            best = q;
+            bestscore = score;
+        }
+    }
+    if (s==0)
+        HERE("Initial partition of %d vertices from processor %d, cut %.0f\n",
+                 N, best, vals[2*best]);
+
+    bsp_push_reg(where, N*SZINT);
+    bsp_sync();
+    if (G->nvtx > 0)
+        bsp_get(best, where, G->vtxdist[s]*SZINT, G->part, G->nvtx*SZINT);
+    bsp_sync();
+    bsp_pop_reg(where);
+
+    vecfreed(vals); vecfreed(pw);
+    vecfreei(queue); vecfreei(list); vecfreei(trial); vecfreei(where);
+    vecfreei(adjw); vecfreei(adj); vecfreei(xadj); vecfreeg(vw);
+
+} /* end partinitial */
+
+/*
+ * Improve the partition of G by moving boundary vertices to the part
+ * they have the most edges to, if that part has room. All processors
+ * move their own vertices at the same time, knowing the parts of their
+ * ghosts only from the start of the pass; so that two neighbours do not
+ * swap places, a pass only moves vertices to higher parts, the next one
+ * only to lower ones. The room left in a part is shared equally among
+ * the processors for a pass. Each pass ends with one superstep, which
+ * brings the changes in part weights and the new parts of the ghosts.
+ */
+void partrefine(int p, int s, partgraph *G)
+{
+    int nv, v, k, b, q, g, pass, quiet, from, best, nt, *part, *conn, *touched;
+    double W, maxpw, moves, *pw, *delta, *room, *all;
+
+    nv = G->nvtx;
+    part = G->part;
+    pw = vecallocd(p);
+    delta = vecallocd(p+1);
+    room = vecallocd(p);
+    all = vecallocd(p*(p+1));
+    conn = vecalloci(p);
+    touched = vecalloci(p);
+    for (b = 0; b < p; b++)
+        pw[b] = delta[b] = 0.0;
+    for (b = 0; b < p; b++)
+        conn[b] = 0;
+    delta[p] = 0.0;
+
+    /* the first superstep sums my weights into pw */
+    for (v = 0; v < nv; v++)
+        delta[part[v]] += G->vwgt[v];
+    bsp_push_reg(part, nv*SZINT);
+    bsp_push_reg(all, p*(p+1)*SZDBL);
+    bsp_sync();
+
+    W = maxpw = 0.0;
+    quiet = 0;
+    for (pass = 0; ; pass++) {
+        for (q = 0; q < p; q++)
+            bsp_put(q, delta, all, s*(p+1)*SZDBL, (p+1)*SZDBL);
+        for (g = 0; g < G->nghost; g++) {
+            q = partowner(p, G->vtxdist, G->ghost[g]);
+            bsp_get(q, part, (G->ghost[g] - G->vtxdist[q])*SZINT, &part[nv+g], SZINT);
+        }
+        bsp_sync();
+
+        moves = 0.0;
+        for (q = 0; q < p; q++) {
+            for (b = 0; b < p; b++)
+                pw[b] += all[q*(p+1)+b];
+            moves += all[q*(p+1)+p];
+        }
+        if (pass == 0) {
+            for (b = 0; b < p; b++)
+                W += pw[b];
+            maxpw = (1.0+PARTIMBAL)*W/p;
+        } else {
+            /* stop when neither direction moves anything */
+            quiet = (moves == 0.0 ? quiet+1 : 0);
+            if (quiet == 2 || pass == 2*PARTPASSES)
+                break;
+        }
+
+        for (b = 0; b < p; b++)
+            room[b] = (maxpw - pw[b])/p;
+        for (b = 0; b <= p; b++)
+            delta[b] = 0.0;
+        for (v = 0; v < nv; v++) {
+            from = part[v];
+            nt = 0;
+            for (k = G->xadj[v]; k < G->xadj[v+1]; k++) {
+                b = part[G->adjl[k]];
+                if (conn[b] == 0)
+                    touched[nt++] = b;
+                conn[b] += G->adjwgt[k];
+            }
+            best = -1;
+            for (k = 0; k < nt; k++) {
+                b = touched[k];
+                if (b == from || (pass % 2 == 0 ? b < from : b > from) ||
+                    G->vwgt[v] > room[b])
+                    continue;
+                if (conn[b] > conn[from] || pw[from] > maxpw ||
+                    (conn[b] == conn[from] && pw[b] + G->vwgt[v] < pw[from])) {
+                    if (best < 0 || conn[b] > conn[best] ||
+                        (conn[b] == conn[best] && pw[b] < pw[best]))
+                        best = b;
+                }
+            }
+            for (k = 0; k < nt; k++)
+                conn[touched[k]] = 0;
+            if (best < 0)
+                continue;
+            part[v] = best;
+            room[best] -= G->vwgt[v];
+            delta[best] += G->vwgt[v];
+            delta[from] -= G->vwgt[v];
+            delta[p] += 1.0;
+        }
+    }
+
+    bsp_pop_reg(all);
+    bsp_pop_reg(part);
+    vecfreei(touched); vecfreei(conn);
+    vecfreed(all); vecfreed(room); vecfreed(delta); vecfreed(pw);
+
+} /* end partrefine */
+
+/*
+ * Free one level of the graph.
+ */
+void partfree(partgraph *G)
+{
+    vecfreei(G->part);
+    vecfreeg(G->cmap);
+    vecfreeg(G->ghost);
+    vecfreeg(G->vwgt);
+    vecfreei(G->adjl);
+    vecfreei(G->adjwgt);
+    vecfreeg(G->adj);
+    vecfreei(G->xadj);
+    vecfreeg(G->vtxdist);
+
+} /* end partfree */
+
+/*
+ * Partition the rows of the matrix into p parts with the multilevel
+ * graph method, see partition.h. The nonzeros must be in blocks of
+ * rows, see partblockstart; part[r] is set to the part of my r'th row.
+ */
+void bsppartgraph(int p, int s, gidx n, int nz, gidx *ia, gidx *ja, int *part)
+{
+    int nl, l, v, k;
+    gidx maxvwgt, coarsest;
+    double W, *vals;
+    partgraph L[PARTLEVELS];
+
+    if (p == 1) {
+        for (v = 0; v < n; v++)
+            part[v] = 0;
+        return;
+    }
+    partbuild(p, s, n, nz, ia, ja, &L[0]);
+
+    /* a coarse vertex may weigh a fraction of a part, so the coarsest
+       graph can still be balanced */
+    vals = vecallocd(p+1);
+    vals[0] = 0.0;
+    for (v = 0; v < L[0].nvtx; v++)
+        vals[0] += L[0].vwgt[v];
+    bspreduce(p, s, 1, vals);
+    W = vals[0];
+    maxvwgt = (gidx)(1.5*W/((double)PARTCOARSE*p));
+    if (maxvwgt < 2)
+        maxvwgt = 2;
+
+    nl = 1;
+    while (nl < PARTLEVELS && L[nl-1].vtxdist[p] > (gidx)PARTCOARSE*p) {
+        partcoarsen(p, s, &L[nl-1], maxvwgt, &L[nl]);
+        nl++;
+        if (L[nl-1].vtxdist[p] > PARTSHRINK*L[nl-2].vtxdist[p])
+            break;
+    }
+
+    coarsest = L[nl-1].vtxdist[p];
+    partinitial(p, s, &L[nl-1]);
+    for (l = nl-1; l >= 0; l--) {
+        partrefine(p, s, &L[l]);
+        if (l > 0) {
+            for (v = 0; v < L[l-1].nvtx; v++)
+                L[l-1].part[v] = L[l].part[L[l-1].cmap[v] - L[l].vtxdist[s]];
+            partfree(&L[l]);
+        }
+    }
+    for (v = 0; v < L[0].nvtx; v++)
+        part[v] = L[0].part[v];
+
+    /* report the cut in nonzeros, counting a_ij and a_ji separately */
+    for (k = 0; k <= p; k++)
+        vals[k] = 0.0;
+    for (v = 0; v < L[0].nvtx; v++) {
+        vals[part[v]] += L[0].vwgt[v];
+        for (k = L[0].xadj[v]; k < L[0].xadj[v+1]; k++)
+            if (L[0].part[L[0].adjl[k]] != part[v])
+                vals[p] += L[0].adjwgt[k];
+    }
+    bspreduce(p, s, p+1, vals);
+    if (s==0) {
+        for (k = 1; k < p; k++)
+            if (vals[k] > vals[0])
+                vals[0] = vals[k];
+        printf("Graph partitioning: %d levels, coarsest graph %" GIDX " vertices,\n",
+               nl, coarsest);
+        printf("   cut %.0f nonzeros, imbalance %.3f\n", vals[p], vals[0]*p/W - 1.0);
+    }
+    partfree(&L[0]);
+    vecfreed(vals);
+
+} /* end bsppartgraph */
+
+/*
+ * Distribute the matrix with a built-in partitioner: method PART_BLOCK,
+ * PART_CYCLIC or PART_GRAPH, in 1D or, if twod, 2D; see partition.h.
+ * On input, the nonzeros may be distributed in any way, e.g. in the
+ * chunks bspinput2triple reads from a plain matrix file; on output,
+ * *pnz, *pia, *pja and *pa hold my nonzeros, and *pvindex the *pnv
+ * indices of my part of the vectors u and v, in increasing order.
+ */
+void bsppartition(int p, int s, gidx n, int method, int twod,
+                  int *pnz, gidx **pia, gidx **pja, double **pa,
+                  int *pnv, gidx **pvindex)
+{
+    int nz, k, q, pr, pc, nrows, pi, pj, nv, *dest, *rowpart, *colpart;
+    gidx lo, i, *ia, *ja, *cols, *vindex, *rows;
+    double *a;
+    parttriple *t, *in;
+    indexmap map;
+
+    nz = *pnz; ia = *pia; ja = *pja; a = *pa;
+    if (twod) {
+        partgrid(p, &pr, &pc);
+    } else {
+        pr = p;
+        pc = 1;
+    }
+
+    t = malloc((size_t)nz*sizeof(parttriple) + 1);
+    if (t == NULL)
+        bsp_abort("bsppartition: not enough memory");
+    for (k = 0; k < nz; k++) {
+        t[k].i = ia[k];
+        t[k].j = ja[k];
+        t[k].a = a[k];
+    }
+    vecfreed(a); vecfreeg(ja); vecfreeg(ia);
+
+    /* the graph method needs the rows in blocks first */
+    lo = partblockstart(p, n, s);
+    nrows = (int)(partblockstart(p, n, s+1) - lo);
+    rowpart = colpart = NULL;
+    if (method == PART_GRAPH) {
+        dest = vecalloci(nz);
+        for (k = 0; k < nz; k++)
+            dest[k] = partblock(p, n, t[k].i);
+        partexchange(p, s, nz, dest, sizeof(parttriple), t, &nz, (void **)&in);
+        vecfreei(dest);
+        free(t);
+        t = in;
+
+        ia = vecallocg(nz);
+        ja = vecallocg(nz);
+        for (k = 0; k < nz; k++) {
+            ia[k] = t[k].i;
+            ja[k] = t[k].j;
+        }
+        rowpart = vecalloci(nrows);
+        bsppartgraph(p, s, n, nz, ia, ja, rowpart);
+        vecfreeg(ia);
+
+        /* in 2D we also need the parts of the columns */
+        if (twod) {
+            mapinit(&map, nz, ja);
+            cols = vecallocg(map.count);
+            colpart = vecalloci(map.count);
+            maplist(&map, cols);
+            bsp_push_reg(rowpart, nrows*SZINT);
+            bsp_sync();
+            for (k = 0; k < map.count; k++) {
+                q = partblock(p, n, cols[k]);
+                bsp_get(q, rowpart, (cols[k] - partblockstart(p, n, q))*SZINT,
+                        &colpart[k], SZINT);
+            }
+            bsp_sync();
+            bsp_pop_reg(rowpart);
+            vecfreeg(cols);
+        }
+        vecfreeg(ja);
+    }
+
+    /* send every nonzero to its processor */
+    dest = vecalloci(nz);
+    for (k = 0; k < nz; k++) {
+        pi = (method == PART_GRAPH ? rowpart[t[k].i - lo] : partof(method, p, n, t[k].i));
+        if (twod) {
+            pj = (method == PART_GRAPH ? colpart[maprank(&map, t[k].j)]
+                                       : partof(method, p, n, t[k].j));
+            dest[k] = (pi/pc)*pc + pj%pc;
+        } else {
+            dest[k] = pi;
+        }
+    }
+    if (method == PART_GRAPH && twod) {
+        mapfree(&map);
+        vecfreei(colpart);
+    }
+    partexchange(p, s, nz, dest, sizeof(parttriple), t, &nz, (void **)&in);
+    vecfreei(dest);
+    free(t);
+
+    ia = vecallocg(nz+1);
+    ja = vecallocg(nz+1);
+    a = vecallocd(nz+1);
+    for (k = 0; k < nz; k++) {
+        ia[k] = in[k].i;
+        ja[k] = in[k].j;
+        a[k] = in[k].a;
+    }
+    free(in);
+
+    /* and every vector index to the processor of its part */
+    if (method == PART_GRAPH) {
+        rows = vecallocg(nrows);
+        for (k = 0; k < nrows; k++)
+            rows[k] = lo + k;
+        partexchange(p, s, nrows, rowpart, SZGIDX, rows, &nv, (void **)&vindex);
+        vecfreeg(rows);
+        vecfreei(rowpart);
+    } else if (method == PART_CYCLIC) {
+        nv = (int)((n - s + p - 1)/p);
+        vindex = vecallocg(nv);
+        for (k = 0, i = s; i < n; i += p)
+            vindex[k++] = i;
+    } else {
+        nv = nrows;
+        vindex = vecallocg(nv);
+        for (k = 0; k < nv; k++)
+            vindex[k] = lo + k;
+    }
+
+    if (s==0) {
+        if (twod)
+            printf("Distributed the matrix with method %s on a %d x %d grid\n",
+                   partnames[method], pr, pc);
+        else
+            printf("Distributed the matrix with method %s by rows\n", partnames[method]);
+    }
+    *pnz = nz; *pia = ia; *pja = ja; *pa = a;
+    *pnv = nv; *pvindex = vindex;
+
+} /* end bsppartition */
+
+/*
+ * The communication volume of a multiplication u := A.v set up by
+ * bspmv_init: the components of v each processor gets from others in
+ * the fanout, and the partial sums of u it sends to others in the
+ * fanin. Returns the total, and the largest share of one processor.
+ */
+void partvolume(int p, int s, int nrows, int ncols, int *srcprocv,
+                int *destprocu, gidx *pvol, gidx *pmax)
+{
+    int q, k;
+    double *vals;
+
+    vals = vecallocd(p);
+    for (q = 0; q < p; q++)
+        vals[q] = 0.0;
+    for (k = 0; k < ncols; k++)
+        if (srcprocv[k] != s)
+            vals[s] += 1.0;
+    for (k = 0; k < nrows; k++)
+        if (destprocu[k] != s)
+            vals[s] += 1.0;
+    bspreduce(p, s, p, vals);
+
+    *pvol = *pmax = 0;
+    for (q = 0; q < p; q++) {
+        *pvol += (gidx)vals[q];
+        if ((gidx)vals[q] > *pmax)
+            *pmax = (gidx)vals[q];
+    }
+    vecfreed(vals);
+
+} /* end partvolume */
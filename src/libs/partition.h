@@ -0,0 +1,94 @@
+#ifndef __PARTITION
+#define __PARTITION
+
+#include "gidx.h"
+
+/*
+ * Built-in partitioners, so cg can distribute a plain matrix itself
+ * instead of reading the -P, -u and -v files of Mondriaan.
+ *
+ * Every method first assigns each index i to a part 0..p-1. In 1D,
+ * nonzero a_ij goes to the part of its row i. In 2D the processors form
+ * a pr x pc grid, and a_ij goes to processor row part(i)/pc, processor
+ * column part(j)%pc, so a processor talks to at most pr+pc-2 others in a
+ * multiplication. Both u_i and v_i go to processor part(i), which also
+ * owns a_ii, so the distributions are the same and moving a vector
+ * between them is free.
+ *
+ * The graph method is multilevel: the graph of A+A^T, one vertex per
+ * row weighted by its nonzeros, is coarsened by matching vertices on
+ * the same processor, the coarsest graph is partitioned on every
+ * processor with a different seed and the best cut kept, and that
+ * partition is refined back up, level by level, by moving boundary
+ * vertices to the part they are most connected to.
+ */
+
+#define PART_BLOCK  (0)      /* blocks of about n/p consecutive rows */
+#define PART_CYCLIC (1)      /* row i to processor i mod p */
+#define PART_GRAPH  (2)      /* multilevel partitioning of the graph */
+#define NPARTMETHODS (3)
+
+#define PARTCOARSE (64)      /* coarsen to about this many vertices per part */
+#define PARTSHRINK (0.95)    /* and stop when a level shrinks less than this */
+#define PARTLEVELS (64)      /* at most this many levels */
+#define PARTIMBAL (0.03)     /* allowed imbalance of the part weights */
+#define PARTPASSES (4)       /* refinement passes per level */
+#define PARTTRIALS (4)       /* initial partitions tried per processor */
+#define PARTSTALL (64)       /* moves without improvement before FM gives up */
+
+/* one level of the distributed graph */
+typedef struct {
+    gidx *vtxdist;           /* processor q has vertices vtxdist[q]..vtxdist[q+1]-1 */
+    int nvtx;                /* my vertices */
+    int *xadj;               /* neighbours of v are adj[xadj[v]..xadj[v+1]-1] */
+    gidx *adj;               /* their global numbers */
+    int *adjwgt;             /* edge weights */
+    int *adjl;               /* local number of each neighbour: < nvtx if mine,
+                                else nvtx + its number in ghost */
+    gidx *vwgt;              /* vertex weights */
+    int nghost;              /* neighbours on other processors */
+    gidx *ghost;             /* their global numbers, increasing */
+    gidx *cmap;              /* global number of each vertex in the coarser graph */
+    int *part;               /* part of each vertex and ghost, nvtx+nghost long */
+} partgraph;
+
+/* an edge to neighbour v, before the lists are merged */
+typedef struct {
+    gidx v;
+    int w;
+} partedge;
+
+/* a nonzero on the move */
+typedef struct {
+    gidx i, j;
+    double a;
+} parttriple;
+
+extern const char *partnames[NPARTMETHODS];
+
+int   partbyname(const char *spec, int *method, int *twod);
+void  partgrid(int p, int *pr, int *pc);
+gidx  partblockstart(int p, gidx n, int q);
+int   partblock(int p, gidx n, gidx i);
+int   partof(int method, int p, gidx n, gidx i);
+int   partowner(int p, gidx *vtxdist, gidx i);
+void  partexchange(int p, int s, int n, int *dest, size_t size,
+                   void *items, int *pm, void **pout);
+int   partcmpedge(const void *x, const void *y);
+void  partmerge(partgraph *G, int *xadj, int *end, partedge *e);
+void  partbuild(int p, int s, gidx n, int nz, gidx *ia, gidx *ja, partgraph *G);
+void  partghosts(partgraph *G, int s);
+void  partcoarsen(int p, int s, partgraph *G, gidx maxvwgt, partgraph *C);
+void  partbisect(int n, int *xadj, int *adj, int *adjw, gidx *vw, int *where,
+                 int lo, int k, unsigned long long seed, int *list, int *queue);
+void  partinitial(int p, int s, partgraph *G);
+void  partrefine(int p, int s, partgraph *G);
+void  partfree(partgraph *G);
+void  bsppartgraph(int p, int s, gidx n, int nz, gidx *ia, gidx *ja, int *part);
+void  bsppartition(int p, int s, gidx n, int method, int twod,
+                   int *pnz, gidx **pia, gidx **pja, double **pa,
+                   int *pnv, gidx **pvindex);
+void  partvolume(int p, int s, int nrows, int ncols, int *srcprocv,
+                 int *destprocu, gidx *pvol, gidx *pmax);
+
+#endif
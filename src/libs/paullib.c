@@ -21,6 +21,24 @@ double ran() {
 
 }
 
+/*
+ * return a random double in the interval [0,1) that depends only on
+ * seed and k: the k'th number of a counter-based stream. Any processor
+ * can draw any element without drawing the ones before it. The mixing
+ * function is that of splitmix64.
+ */
+double ranindex(unsigned long long seed, long long k) {
+
+    unsigned long long z;
+
+    z = seed*0x9E3779B97F4A7C15ULL + (unsigned long long)(k+1)*0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z = z ^ (z >> 31);
+    return (double)(z >> 11) * (1.0/9007199254740992.0);
+
+}
+
 
 /*
  * useful function to stat a file for existence
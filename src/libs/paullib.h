@@ -9,3 +9,6 @@ void zero(int nv, double* v);
 void one(int nv, double* v);
 
 double ran();
+double ranindex(unsigned long long seed, long long k);
+
+#define VECSEED (123)  /* seed of the random values of u and v */
@@ -1,18 +1,94 @@
 #include "vecio.h"
 #include <stdio.h>
+#include <string.h>
 #include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "bspedupack.h"
 #include "bspfuncs.h"
 #include "matsort.h"
 #include "paullib.h"
+#include "zio.h"
 #include <time.h>
 
 #include "debug.h"
 
+void *readblock(void *arg){
+
+    /* Parse the next blk->count nonzeros into a block; run by the
+       reader thread of bspinput2triple. */
+
+    tripleblock *blk;
+
+    blk= arg;
+    blk->got= fasttriples(blk->fr,blk->count,blk->ia,blk->ja,blk->a);
+    return NULL;
+
+} /* end readblock */
+
 // This is from BSPedupack
 
-void bspinput2triple(char*filename, int p, int s, int *pnA, int *pnz, 
-                     int **pia, int **pja, double **pa){
+void readmatheader(FILE *fp, const char *filename, int p, gidx *pnA,
+                   gidx *pnzA, gidx *Pstart){
+
+    /* This function reads the header of a matrix file for
+       bspinput2triple: the banner line, any comment lines,
+       then either m n nz p and Pstart[0..p] of the distributed
+       format, or m n nz of a plain Matrix Market file, for which
+       Pstart cuts the nonzeros into p nearly equal parts. */
+
+    char line[STRLEN];
+    int pA, q, items;
+    gidx mA, nA, nzA;
+
+    // get rid of first line, the Mondriaan header:
+    int c;
+    while ((c= fgetc(fp)) != '\n' && c != EOF)
+        ;
+    while (1){
+        if (fgets(line,STRLEN,fp) == NULL)
+            bsp_abort("Error: cannot read the header of %s\n",filename);
+        if (strchr(line,'\n') == NULL)
+            while ((c= fgetc(fp)) != '\n' && c != EOF)
+                ;   // the rest of a long comment
+        if (line[0] != '%')
+            break;
+    }
+
+    /* A is an mA by nA matrix with nzA nonzeros
+       distributed over pA processors. */
+    items= sscanf(line,"%" SCNGIDX " %" SCNGIDX " %" SCNGIDX " %d",
+                  &mA, &nA, &nzA, &pA);
+    if (items < 3)
+        bsp_abort("Error: cannot read the header of %s\n",filename);
+    printf("Matrix has %" GIDX " nonzeros.\n",nzA);
+    if(items==4 && pA!=p)
+        bsp_abort("Error: p not equal to p(A)\n");
+    if(mA!=nA)
+        bsp_abort("Error: matrix is not square");
+
+    if (items==4){
+        for (q=0; q<=p; q++)
+            if (fscanf(fp,"%" SCNGIDX "\n", &Pstart[q]) != 1)
+                bsp_abort("Error: cannot read Pstart of %s\n",filename);
+    } else {
+        for (q=0; q<=p; q++)
+            Pstart[q]= (gidx)((long long)nzA*q/p);
+    }
+    for (q=0; q<p; q++)
+        if (Pstart[q+1]-Pstart[q] > NZLOCMAX)
+            bsp_abort("Error: processor %d has more than %d nonzeros\n",q,NZLOCMAX);
+
+    *pnA= nA;
+    *pnzA= nzA;
+
+} /* end readmatheader */
+
+void bspinput2triple(char*filename, int p, int s, gidx *pnA, int *pnz, 
+                     gidx **pia, gidx **pja, double **pa){
   
     /* This function reads a sparse matrix in distributed
        Matrix Market format without the banner line
@@ -30,10 +106,14 @@ void bspinput2triple(char*filename, int p, int s, int *pnA, int *pnz,
        numbered Pstart[q]..Pstart[q+1]-1.
        This is followed by nz lines in the format
            i j a     (row index, column index, numerical value).
+       A plain Matrix Market file, with just m n nz on the line
+       after the banner (and maybe comment lines), is read as well;
+       its nonzeros are then cut into p parts of consecutive
+       nonzeros, to be distributed by bsppartition.
        The input indices are assumed by Matrix Market to start
        counting at one, but they are converted to start from zero.
        The triples are stored into three arrays ia, ja, a,
-       in arbitrary order.
+       in the order of the file.
        
        Input:
        p is the number of processors.
@@ -46,92 +126,118 @@ void bspinput2triple(char*filename, int p, int s, int *pnA, int *pnz,
             0 <= k < nz.
        ia[k] is the global row index of the  k'th local nonzero.
        ja[k] is the global column index.
+
+       The global size and number of nonzeros, and the indices, are
+       of type gidx (see gidx.h); the local number of nonzeros is an int.
     */
 
-    int pA, mA, nA, nzA, nz, q, nzq, k, status, *Pstart, *ia, *ja;
-#ifdef __GNUC__
-    size_t tagsz;
-#else
-    int tagsz;
-#endif
-    double value, *a;
-    indexpair t;
+    int nz, q, nzq, nb, cur, i;
+    gidx nA, nzA, k, lo, hi, *Pstart, *ia, *ja;
+    double *a;
     FILE *fp;
-    
-    Pstart= vecalloci(p+1);
-    bsp_push_reg(&nA,SZINT);
+    zfile zf;
+    fastreader fr;
+    tripleblock blk[2];
+    pthread_t reader;
+    int reading;
+
+    Pstart= vecallocg(p+1);
+    bsp_push_reg(&nA,SZGIDX);
+    bsp_push_reg(&nzA,SZGIDX);
     bsp_push_reg(&nz,SZINT);
-    tagsz= sizeof(indexpair);
-    bsp_set_tagsize(&tagsz);
     bsp_sync();
 
+    fp= NULL;
     if (s==0){
         /* Open the matrix file and read the header */
-        fp=fopen(filename,"r");
-
-        // get rid of first line, the Mondriaan header:
-        char sillyChar;
-        sillyChar = 0;
-        while (sillyChar != '\n'){
-            sillyChar = fgetc(fp);
-        }
-
+        fp=zopen(&zf,filename);
+        if (fp==NULL)
+            bsp_abort("Error: cannot open matrix file %s\n",filename);
 
-        /* A is an mA by nA matrix with nzA nonzeros
-           distributed over pA processors. */
-        fscanf(fp,"%d %d %d %d\n", &mA, &nA, &nzA, &pA);
-        printf("Matrix has %d nonzeros.\n",nzA);
-        if(pA!=p)
-            bsp_abort("Error: p not equal to p(A)\n"); 
-        if(mA!=nA)
-            bsp_abort("Error: matrix is not square");
-
-        for (q=0; q<=p; q++)
-            fscanf(fp,"%d\n", &Pstart[q]);
+        readmatheader(fp,filename,p,&nA,&nzA,Pstart);
         for (q=0; q<p; q++){
-            bsp_put(q,&nA,&nA,0,SZINT);
-            nzq= Pstart[q+1]-Pstart[q];
+            bsp_put(q,&nA,&nA,0,SZGIDX);
+            bsp_put(q,&nzA,&nzA,0,SZGIDX);
+            nzq= (int)(Pstart[q+1]-Pstart[q]);
             bsp_put(q,&nzq,&nz,0,SZINT);
         }
     }
     bsp_sync();
 
+    /* The nonzeros are put straight into their final place, so the
+       arrays must be registered. */
+    a= vecallocd(nz+1);
+    ia= vecallocg(nz+1);  
+    ja= vecallocg(nz+1);
+    bsp_push_reg(a,nz*SZDBL);
+    bsp_push_reg(ia,nz*SZGIDX);
+    bsp_push_reg(ja,nz*SZGIDX);
+    bsp_sync();
 
-    /* Handle the processors one at a time.
-       This saves buffer memory, at the expense of p-1 extra syncs.
-       Buffer memory needed for communication is at most the maximum
-       amount of memory a processor needs to store its vector components. */
+    /* Processor 0 reads the nonzeros in blocks of PARSEBATCH, in the
+       order of the file, and puts each part of a block as one
+       contiguous piece into the arrays of its processor. A block can
+       span several processors, and a processor several blocks.
 
-    a= vecallocd(nz+1);
-    ia= vecalloci(nz+1);  
-    ja= vecalloci(nz+1);
+       The reading is pipelined: while block b is delivered in the
+       sync, a second thread on processor 0 already parses block b+1
+       into the other buffer. This needs one superstep per block and
+       two blocks of buffer memory on processor 0. */
 
-    for (q=0; q<p; q++){      
+    reading= 0;
+    if (s==0){
+        if (fastopen(&fr,fp) < 0)
+            bsp_abort("bspinput2triple: not enough memory");
+        for (cur=0; cur<2; cur++){
+            blk[cur].fr= &fr;
+            blk[cur].a= vecallocd(PARSEBATCH);
+            blk[cur].ia= vecallocg(PARSEBATCH);
+            blk[cur].ja= vecallocg(PARSEBATCH);
+        }
+        blk[0].count= (nzA < PARSEBATCH ? nzA : PARSEBATCH);
+        readblock(&blk[0]);
+    }
+
+    cur= 0;
+    for (k=0; k<nzA; k += PARSEBATCH){
         if (s==0){
-            /* Read the nonzeros from the matrix file and
-               send them to their destination */
-            for (k=Pstart[q]; k<Pstart[q+1]; k++){
-                fscanf(fp,"%d %d %lf\n", &t.i, &t.j, &value);
-                /* Convert indices to range 0..n-1, 
-                   assuming it was 1..n */
-                t.i--;
-                t.j--;
-                /* Send a triple to P(q). Tag is a pair (i,j).
-                   Payload is a numerical value */
-                bsp_send(q,&t,&value,SZDBL);
+            if (reading){
+                pthread_join(reader,NULL);
+                reading= 0;
             }
-        }
-        bsp_sync();
-        
-        if (s==q){
-            /* Store the received nonzeros */
-            for(k=0; k<nz; k++){
-                bsp_get_tag(&status,&t);
-                ia[k]= t.i;
-                ja[k]= t.j;
-                bsp_move(&a[k],SZDBL);
+            nb= blk[cur].count;
+            if (blk[cur].got != nb)
+                bsp_abort("Error: cannot read nonzero %" GIDX " of %s\n",
+                          k+(gidx)blk[cur].got,filename);
+
+            /* Start on the next block */
+            if (k+nb < nzA){
+                blk[1-cur].count= (nzA-k-nb < PARSEBATCH ? nzA-k-nb : PARSEBATCH);
+                if (pthread_create(&reader,NULL,readblock,&blk[1-cur]) == 0)
+                    reading= 1;
+                else
+                    readblock(&blk[1-cur]);
             }
+
+            /* Send the parts of this block to their processors */
+            for (q=0; q<p; q++){
+                lo= (Pstart[q] > k ? Pstart[q] : k);
+                hi= (Pstart[q+1] < k+nb ? Pstart[q+1] : k+nb);
+                if (lo >= hi)
+                    continue;
+                bsp_put(q,&blk[cur].a[lo-k],a,(lo-Pstart[q])*SZDBL,(hi-lo)*SZDBL);
+                bsp_put(q,&blk[cur].ia[lo-k],ia,(lo-Pstart[q])*SZGIDX,(hi-lo)*SZGIDX);
+                bsp_put(q,&blk[cur].ja[lo-k],ja,(lo-Pstart[q])*SZGIDX,(hi-lo)*SZGIDX);
+            }
+            cur= 1-cur;
         }
+        bsp_sync();
+    }
+
+    /* Convert indices to range 0..n-1, assuming it was 1..n */
+    for (i=0; i<nz; i++){
+        ia[i]--;
+        ja[i]--;
     }
 
     *pnA= nA;
@@ -139,24 +245,380 @@ void bspinput2triple(char*filename, int p, int s, int *pnA, int *pnz,
     *pa= a;
     *pia= ia;
     *pja= ja;
-    if (s==0)
-        fclose(fp);
+    if (s==0){
+        fastclose(&fr);
+        if (zclose(&zf) != 0)
+            bsp_abort("Error: cannot decompress matrix file %s\n",filename);
+        for (cur=0; cur<2; cur++){
+            vecfreed(blk[cur].a);
+            vecfreeg(blk[cur].ia);
+            vecfreeg(blk[cur].ja);
+        }
+    }
+    bsp_pop_reg(ja);
+    bsp_pop_reg(ia);
+    bsp_pop_reg(a);
     bsp_pop_reg(&nz);
+    bsp_pop_reg(&nzA);
     bsp_pop_reg(&nA);
     bsp_sync();
+    vecfreeg(Pstart);
     
 } /* end bspinput2triple */
-void triple2icrs(int n, int nz, int *ia,  int *ja, double *a,
+
+int findoffsets(FILE *fp, off_t start, int p, gidx *Pstart, off_t *offset){
+
+    /* This function finds the byte offsets of the processor parts
+       of a distributed matrix file, by counting lines. It is a quick
+       pre-pass: no numbers are parsed.
+
+       Input:
+       fp is the open matrix file.
+       start is the offset of the line of nonzero number Pstart[0].
+       Pstart[q] is the number of the first nonzero of processor q,
+                 0 <= q <= p.
+
+       Output:
+       offset[q] is the offset of the line of nonzero Pstart[q].
+       Returns 0 on success, -1 if the file has too few lines.
+    */
+
+    int q;
+    gidx line;
+    size_t len;
+    char *buf, *c, *end;
+    off_t pos;
+
+    buf= malloc(IOBUFSIZE);
+    if (buf==NULL)
+        bsp_abort("findoffsets: not enough memory");
+
+    fseeko(fp,start,SEEK_SET);
+    pos= start;
+    line= Pstart[0];
+    q= 0;
+    while (q<=p && Pstart[q]==line)
+        offset[q++]= pos;
+
+    while (q<=p && (len= fread(buf,1,IOBUFSIZE,fp)) > 0){
+        end= buf+len;
+        for (c=buf; q<=p && (c= memchr(c,'\n',end-c)) != NULL; ){
+            c++;
+            line++;
+            while (q<=p && Pstart[q]==line)
+                offset[q++]= pos + (c-buf);
+        }
+        pos += len;
+    }
+    free(buf);
+
+    /* the last part may end without a newline */
+    if (q==p && Pstart[p]==line+1){
+        fseeko(fp,0,SEEK_END);
+        offset[p]= ftello(fp);
+        q++;
+    }
+    return (q>p ? 0 : -1);
+
+} /* end findoffsets */
+
+int readindex(const char *filename, int p, off_t *offset){
+
+    /* This function reads the sidecar index filename.idx written by
+       writeindex, if it exists and belongs to the current version of
+       the matrix file. Returns 0 on success, -1 otherwise. */
+
+    char name[2*STRLEN];
+    struct stat st;
+    long long size, mtime, off;
+    int q, pidx;
+    FILE *fp;
+
+    if (stat(filename,&st) != 0)
+        return -1;
+    snprintf(name,2*STRLEN,"%s.idx",filename);
+    if ((fp= fopen(name,"r")) == NULL)
+        return -1;
+    if (fscanf(fp,"%%%%bsp-cg index %lld %lld %d\n",&size,&mtime,&pidx) != 3 ||
+            size != (long long)st.st_size || mtime != (long long)st.st_mtime ||
+            pidx != p){
+        fclose(fp);
+        return -1;
+    }
+    for (q=0; q<=p; q++){
+        if (fscanf(fp,"%lld\n",&off) != 1){
+            fclose(fp);
+            return -1;
+        }
+        offset[q]= off;
+    }
+    fclose(fp);
+    return 0;
+
+} /* end readindex */
+
+void writeindex(const char *filename, int p, off_t *offset){
+
+    /* This function writes the byte offsets of the processor parts of
+       a matrix file to the sidecar index filename.idx, together with
+       the size and modification time of the matrix file, so that a
+       stale index is recognised. Failure is not an error: we simply
+       do the pre-pass again next time. */
+
+    char name[2*STRLEN];
+    struct stat st;
+    int q;
+    FILE *fp;
+
+    if (stat(filename,&st) != 0)
+        return;
+    snprintf(name,2*STRLEN,"%s.idx",filename);
+    if ((fp= fopen(name,"w")) == NULL)
+        return;
+    fprintf(fp,"%%%%bsp-cg index %lld %lld %d\n",
+            (long long)st.st_size,(long long)st.st_mtime,p);
+    for (q=0; q<=p; q++)
+        fprintf(fp,"%lld\n",(long long)offset[q]);
+    fclose(fp);
+
+} /* end writeindex */
+
+void bspinput2triple_par(char*filename, int p, int s, gidx *pnA, int *pnz,
+                         gidx **pia, gidx **pja, double **pa){
+
+    /* This function reads a sparse matrix in the same distributed
+       Matrix Market format as bspinput2triple, but in parallel: every
+       processor reads its own nonzeros from the file, so all
+       processors must be able to open it.
+
+       Processor 0 reads the header and the byte offset of each
+       processor part, from the sidecar index filename.idx if it is up
+       to date, or else by a quick line counting pass over the file,
+       after which it writes the index for next time. It broadcasts the
+       offsets in a single superstep; after that, no communication is
+       needed.
+
+       Input and output are as for bspinput2triple; the triples are
+       stored in the order of the file.
+    */
+
+    int nz, q, k;
+    gidx nA, nzA, *Pstart;
+    double *a;
+    gidx *ia, *ja;
+    off_t start, *offset;
+    FILE *fp;
+    fastreader fr;
+
+    Pstart= vecallocg(p+1);
+    offset= malloc((p+1)*sizeof(off_t));
+    if (offset==NULL)
+        bsp_abort("bspinput2triple_par: not enough memory");
+    bsp_push_reg(&nA,SZGIDX);
+    bsp_push_reg(Pstart,(p+1)*SZGIDX);
+    bsp_push_reg(offset,(p+1)*sizeof(off_t));
+    bsp_sync();
+
+    if (s==0){
+        fp=fopen(filename,"r");
+        if (fp==NULL)
+            bsp_abort("Error: cannot open matrix file %s\n",filename);
+
+        readmatheader(fp,filename,p,&nA,&nzA,Pstart);
+
+        if (readindex(filename,p,offset) == 0){
+            HERE("Using the index of %s\n",filename);
+        } else {
+            start= ftello(fp);
+            if (findoffsets(fp,start,p,Pstart,offset) < 0)
+                bsp_abort("Error: matrix file %s has fewer than %" GIDX " nonzeros\n",
+                          filename,Pstart[p]);
+            writeindex(filename,p,offset);
+        }
+        fclose(fp);
+
+        for (q=1; q<p; q++){
+            bsp_put(q,&nA,&nA,0,SZGIDX);
+            bsp_put(q,Pstart,Pstart,0,(p+1)*SZGIDX);
+            bsp_put(q,offset,offset,0,(p+1)*sizeof(off_t));
+        }
+    }
+    bsp_sync();
+
+    /* Now every processor reads its own part */
+    nz= (int)(Pstart[s+1]-Pstart[s]);
+    a= vecallocd(nz+1);
+    ia= vecallocg(nz+1);
+    ja= vecallocg(nz+1);
+
+    fp=fopen(filename,"r");
+    if (fp==NULL)
+        bsp_abort("Error: processor %d cannot open matrix file %s\n",s,filename);
+    fseeko(fp,offset[s],SEEK_SET);
+    if (fastopen(&fr,fp) < 0)
+        bsp_abort("bspinput2triple_par: not enough memory");
+    k= fasttriples(&fr,nz,ia,ja,a);
+    if (k != nz)
+        bsp_abort("Error: processor %d cannot read nonzero %" GIDX " of %s\n",
+                  s,Pstart[s]+k,filename);
+    for (k=0; k<nz; k++){
+        /* Convert indices to range 0..n-1, assuming it was 1..n */
+        ia[k]--;
+        ja[k]--;
+    }
+    fastclose(&fr);
+    fclose(fp);
+
+    *pnA= nA;
+    *pnz= nz;
+    *pa= a;
+    *pia= ia;
+    *pja= ja;
+    bsp_pop_reg(offset);
+    bsp_pop_reg(Pstart);
+    bsp_pop_reg(&nA);
+    bsp_sync();
+    free(offset);
+    vecfreeg(Pstart);
+
+} /* end bspinput2triple_par */
+int popcount64(uint64_t x){
+
+    /* Number of bits set in x */
+
+#ifdef __GNUC__
+    return __builtin_popcountll(x);
+#else
+    int c;
+
+    for (c=0; x; c++)
+        x &= x-1;
+    return c;
+#endif
+
+} /* end popcount64 */
+
+void mapinit(indexmap *m, int nz, gidx *index){
+
+    /* This function marks the distinct values of index[0..nz-1] in a
+       bitmap covering only their range lo..hi, and counts for every
+       64-bit word of the bitmap the marked values before it. The rank
+       of a value, its position among the distinct values in increasing
+       order, then takes O(1) time, see maprank. Memory is about
+       (hi-lo)/5 bytes. */
+
+    int k, w;
+    gidx lo, hi;
+
+    lo= hi= 0;
+    for (k=0; k<nz; k++){
+        if (k==0 || index[k] < lo)
+            lo= index[k];
+        if (k==0 || index[k] > hi)
+            hi= index[k];
+    }
+    m->lo= lo;
+    m->nwords= (nz==0 ? 0 : (int)((hi-lo)/64 + 1));
+    m->bits= calloc(m->nwords > 0 ? m->nwords : 1, sizeof(uint64_t));
+    if (m->bits==NULL)
+        bsp_abort("mapinit: not enough memory");
+    m->rank= vecalloci(m->nwords);
+
+    for (k=0; k<nz; k++)
+        m->bits[(index[k]-lo)>>6] |= (uint64_t)1 << ((index[k]-lo) & 63);
+
+    m->count= 0;
+    for (w=0; w<m->nwords; w++){
+        m->rank[w]= m->count;
+        m->count += popcount64(m->bits[w]);
+    }
+
+} /* end mapinit */
+
+int maprank(indexmap *m, gidx i){
+
+    /* Rank of the marked value i */
+
+    int w;
+
+    i -= m->lo;
+    w= (int)(i>>6);
+    return m->rank[w] + popcount64(m->bits[w] & (((uint64_t)1 << (i & 63)) - 1));
+
+} /* end maprank */
+
+void maplist(indexmap *m, gidx *list){
+
+    /* Write the marked values in increasing order into list,
+       which has room for m->count values */
+
+    int w, b, r;
+    uint64_t bits;
+
+    r= 0;
+    for (w=0; w<m->nwords; w++){
+        for (bits= m->bits[w]; bits; bits &= bits-1){
+#ifdef __GNUC__
+            b= __builtin_ctzll(bits);
+#else
+            for (b=0; !((bits>>b) & 1); b++)
+                ;
+#endif
+            list[r++]= m->lo + (gidx)64*w + b;
+        }
+    }
+
+} /* end maplist */
+
+void mapfree(indexmap *m){
+
+    free(m->bits);
+    vecfreei(m->rank);
+
+} /* end mapfree */
+
+void sortrow(int ncols, int len, int *ja, double *a, int *scratch, double *ascratch){
+
+    /* Sort the nonzeros of one row by local column index, stably.
+       Short rows are sorted by insertion; scratch has room for 3*len
+       ints and ascratch for len doubles, for longer rows. */
+
+    int k, l, j;
+    double v;
+
+    if (len <= SORTROWMIN){
+        for (k=1; k<len; k++){
+            j= ja[k]; v= a[k];
+            for (l=k; l>0 && ja[l-1] > j; l--){
+                ja[l]= ja[l-1];
+                a[l]= a[l-1];
+            }
+            ja[l]= j; a[l]= v;
+        }
+        return;
+    }
+    for (k=0; k<len; k++)
+        scratch[k]= 0;
+    radixsort(ncols,len,ja,scratch,a,scratch+len,scratch+2*len,ascratch);
+
+} /* end sortrow */
+
+void triple2icrs(gidx n, int nz, gidx *ia, gidx *ja, double *a, int sortcols,
                  int *pnrows, int *pncols,
-                 int **prowindex, int **pcolindex){
+                 gidx **prowindex, gidx **pcolindex, int **pinc){
     /* This function converts a sparse matrix A given in triple
        format with global indices into a sparse matrix in
        incremental compressed row storage (ICRS) format with 
        local indices.
 
-       The conversion needs time and memory O(nz + sqrt(n))
-       on each processor, which is O(nz(A)/p + n/p + p).
-       
+       The local rows and columns are numbered in increasing order
+       of their global index, by marking the indices present in a
+       bitmap over the local range (see mapinit). The nonzeros are
+       then counted per row and scattered directly into row order,
+       so instead of sorting the conversion takes a few linear
+       passes. Besides the bitmaps, it needs a scratch array of nz
+       doubles and O(nrows) memory on each processor.
+
        Input:
        n is the global size of the matrix.
        nz is the local number of nonzeros.
@@ -164,6 +626,9 @@ void triple2icrs(int n, int nz, int *ia,  int *ja, double *a,
             of the sparse matrix A, 0 <= k <nz.
        ia[k] is the global row index of the k'th nonzero.
        ja[k] is the global column index of the k'th nonzero.
+       sortcols is nonzero to sort the nonzeros within each row by
+            column index. Otherwise they keep their input order,
+            which saves time but changes the order of summation.
   
        Output:
        nrows is the number of local nonempty rows
@@ -174,107 +639,125 @@ void triple2icrs(int n, int nz, int *ia,  int *ja, double *a,
                    local column, 0 <= j < ncols.
        a[k] is the numerical value of the k'th local nonzero of the
             sparse matrix A, 0 <= k < nz. The array is sorted by
-            row index, ties being decided by column index.
-       ia[k] = inc[k] is the increment in the local column index of the
+            row index, and if sortcols is set, ties are decided by
+            column index; equal indices keep their input order.
+       inc[k] is the increment in the local column index of the
               k'th local nonzero, compared to the column index of the
               (k-1)th nonzero, if this nonzero is in the same row;
               otherwise, ncols is added to the difference.
               By convention, the column index of the -1'th nonzero is 0.
+              The increments are local, so inc is an int array; it
+              takes over the memory of ja. ia is overwritten, and
+              can be freed by the caller.
    */
     
-   int radix, i, iglob, iglob_last, j, jglob, jglob_last, k, inck,
-       nrows, ncols, *rowindex, *colindex;
-   
-   /* radix is the smallest power of two >= sqrt(n)
-      The div and mod operations are cheap for powers of two.
-      A radix of about sqrt(n) minimizes memory and time. */
+   int i, k, len, maxlen, inck, col, prev, nrows, ncols,
+       *rowstart, *next, *scratch, *inc, *newinc;
+   gidx *rowindex, *colindex, *gtmp;
+   double *tmp, *ascratch;
+   indexmap rows, cols;
 
-   for (radix=1; radix*radix<n; radix *= 2)
-       ;
-   
-   /* Sort nonzeros by column index */
-   sort(n,nz,ja,ia,a,radix,MOD);
-   sort(n,nz,ja,ia,a,radix,DIV);
-   
-   /* Count the number of local columns */
-   ncols= 0;
-   jglob_last= -1;
-   for(k=0; k<nz; k++){
-       jglob= ja[k];
-       if(jglob!=jglob_last)
-           /* new column index */
-           ncols++;
-       jglob_last= jglob;
+   /* Number the local rows and columns */
+   mapinit(&rows,nz,ia);
+   mapinit(&cols,nz,ja);
+   nrows= rows.count;
+   ncols= cols.count;
+   rowindex= vecallocg(nrows);
+   colindex= vecallocg(ncols);
+   maplist(&rows,rowindex);
+   maplist(&cols,colindex);
+
+   /* Convert to local indices, and count the nonzeros per row */
+   rowstart= vecalloci(nrows+1);
+   for (i=0; i<=nrows; i++)
+       rowstart[i]= 0;
+   for (k=0; k<nz; k++){
+       ia[k]= maprank(&rows,ia[k]);
+       ja[k]= maprank(&cols,ja[k]);
+       rowstart[ia[k]+1]++;
    }
-   colindex= vecalloci(ncols);
-   
-   /* Convert global column indices to local ones.
-      Initialize colindex */
-   j= 0;
-   jglob_last= -1;
-   for(k=0; k<nz; k++){
-       jglob= ja[k];
-       if(jglob!=jglob_last){
-           colindex[j]= jglob;
-           j++;
+   mapfree(&rows);
+   mapfree(&cols);
+   for (i=0; i<nrows; i++)
+       rowstart[i+1] += rowstart[i];
+
+   /* ia[k] becomes the new position of the k'th nonzero */
+   next= vecalloci(nrows);
+   for (i=0; i<nrows; i++)
+       next[i]= rowstart[i];
+   for (k=0; k<nz; k++)
+       ia[k]= next[ia[k]]++;
+   vecfreei(next);
+
+   /* Move the nonzeros to their new positions through a scratch
+      array of nz doubles, which holds first the values and then
+      the column indices. The local column indices go back into the
+      memory of ja as ints, which is where inc will be. */
+   tmp= vecallocd(nz);
+   for (k=0; k<nz; k++)
+       tmp[ia[k]]= a[k];
+   for (k=0; k<nz; k++)
+       a[k]= tmp[k];
+   gtmp= (gidx *)tmp;
+   for (k=0; k<nz; k++)
+       gtmp[ia[k]]= ja[k];
+   inc= (int *)ja;
+   for (k=0; k<nz; k++)
+       inc[k]= (int)gtmp[k];
+   vecfreed(tmp);
+
+   if (sortcols){
+       maxlen= 0;
+       for (i=0; i<nrows; i++)
+           if (rowstart[i+1]-rowstart[i] > maxlen)
+               maxlen= rowstart[i+1]-rowstart[i];
+       scratch= NULL; ascratch= NULL;
+       if (maxlen > SORTROWMIN){
+           scratch= vecalloci(3*maxlen);
+           ascratch= vecallocd(maxlen);
        }
-       ja[k]= j-1; /* local index of last registered column */
-       jglob_last= jglob;
-   }
-   
-   /* Sort nonzeros by row index using radix-sort */
-   sort(n,nz,ia,ja,a,radix,MOD);
-   sort(n,nz,ia,ja,a,radix,DIV);
-
-   /* Count the number of local rows */
-   nrows= 0;
-   iglob_last= -1;
-   for(k=0; k<nz; k++){
-       iglob= ia[k];
-       if(iglob!=iglob_last)
-           /* new row index */
-           nrows++;
-       iglob_last= iglob;
+       for (i=0; i<nrows; i++){
+           len= rowstart[i+1]-rowstart[i];
+           sortrow(ncols,len,inc+rowstart[i],a+rowstart[i],scratch,ascratch);
+       }
+       vecfreei(scratch);
+       vecfreed(ascratch);
    }
-   rowindex= vecalloci(nrows);
                               
-   /* Convert global row indices to local ones.
-      Initialize rowindex and inc */
-   i= 0;
-   iglob_last= -1;
-   for(k=0; k<nz; k++){
-       if (k==0)
-           inck= ja[k];
-       else
-           inck= ja[k] - ja[k-1];
-       iglob= ia[k]; 
-       if(iglob!=iglob_last){
-           rowindex[i]= iglob;
-           i++;
-           if(k>0)
+   /* Compute inc, in place of the column indices */
+   prev= 0;
+   for (i=0; i<nrows; i++){
+       for (k=rowstart[i]; k<rowstart[i+1]; k++){
+           col= inc[k];
+           inck= col - prev;
+           if (k==rowstart[i] && k>0)
                inck += ncols;
-       } 
-       ia[k]= inck; /* ia is used to store inc */
-       iglob_last= iglob;
+           inc[k]= inck;
+           prev= col;
+       }
    }
-   if (nz==0)
-       ia[nz]= 0;
-   else 
-       ia[nz]= ncols - ja[nz-1];
-   ja[nz]= 0;                                                  
+   vecfreei(rowstart);
+   inc[nz]= ncols - prev;
    a[nz]= 0.0;     
+
+   /* With 64-bit global indices, ja had room for twice as many ints */
+   if (SZGIDX > SZINT){
+       newinc= realloc(inc,(nz+1)*SZINT);
+       if (newinc != NULL)
+           inc= newinc;
+   }
    
    *pncols= ncols;
    *pnrows= nrows;
    *prowindex= rowindex;
    *pcolindex= colindex;
+   *pinc= inc;
    
 } /* end triple2icrs */
 
 void bspinputvec(int p, int s, const char *filename,
-                 int *pn, int *pnv, int **pvindex,
-                 double **pvalues,
-                 int **owner, int **owneridx){
+                 gidx *pn, int *pnv, gidx **pvindex,
+                 double **pvalues){
   
     /* This function reads the distribution of a dense vector v
        from the input file and initializes the corresponding local
@@ -284,6 +767,10 @@ void bspinputvec(int p, int s, const char *filename,
        followed by n lines in the format
            i proc (index, processor number),
        where i=1,2,...,n.
+
+       Memory use is O(n/p) per processor, apart from the read buffer
+       of n/p components on processor 0. Where other processors store
+       their components can be found with bspvecmap.
        
        Input:
        p is the number of processors.
@@ -295,31 +782,37 @@ void bspinputvec(int p, int s, const char *filename,
        nv is the local length.
        vindex[i] is the global index corresponding to
                  the local index i, 0 <= i < nv.
+       values[i] is a random value for component i, which only
+                 depends on its global index, see ranindex.
     */
 
-    int n, pv, q, np, b, i, k, globk, proc, ind, nv,
-        *tmpproc, *tmpind, *Nv, *vindex;
+    int pv, q, np, kb, nb, proc, ind, nv, *tmpproc, *tmpind, *Nv;
+    gidx n, b, i, k, globk, *vindex, *ib, *procb;
+    double *values;
     FILE *fp;
+    zfile zf;
+    fastreader fr;
 
-    // somewhere to store the vector reals
-    double *allVals;
-
-    bsp_push_reg(&n,SZINT);
+    n= 0; // only processor 0 reads it, and puts it in the others
+    bsp_push_reg(&n,SZGIDX);
     bsp_push_reg(&nv,SZINT);
     bsp_sync();
 
+    fp= NULL;
     if (s==0){
         /* Open the file and read the header */
 
-        fp=fopen(filename,"r");
-        fscanf(fp,"%d %d\n", &n, &pv);
+        fp=zopen(&zf,filename);
+        if (fp==NULL)
+            bsp_abort("Error: cannot open vector file %s\n",filename);
+        if (fscanf(fp,"%" SCNGIDX " %d\n", &n, &pv) != 2)
+            bsp_abort("Error: cannot read the header of %s\n",filename);
         if(pv!=p)
             bsp_abort("Error: p not equal to p(vec)\n"); 
         for (q=0; q<p; q++)
-            bsp_put(q,&n,&n,0,SZINT);
+            bsp_put(q,&n,&n,0,SZGIDX);
     }
     bsp_sync();
-    allVals = vecallocd(n);  // place to temporarily store all vector reals. 
 
     /* The owner of the global index i and its local index
        are stored in temporary arrays which are distributed
@@ -331,42 +824,43 @@ void bspinputvec(int p, int s, const char *filename,
     bsp_push_reg(tmpind,np*SZINT);
     bsp_sync();
 
+    /* block size for vector read */
+    b= (n%p==0 ? n/p : n/p+1);
+    Nv= NULL; ib= procb= NULL;
     if (s==0){
         /* Allocate component counters */
         Nv= vecalloci(p);
         for (q=0; q<p; q++)
             Nv[q]= 0;
+        if (fastopen(&fr,fp) < 0)
+            bsp_abort("bspinputvec: not enough memory");
+        ib= vecallocg(b);
+        procb= vecallocg(b);
     }
 
-    // seed the random generator.
-    srandom((unsigned)123);
-    //srandom((unsigned)time(NULL));
-
-    /* block size for vector read */
-    b= (n%p==0 ? n/p : n/p+1);
     for (q=0; q<p; q++){
         if(s==0){
             /* Read the vector components from file and
                put their owner and local index into their
                temporary location. This is done n/p components
                at a time to save memory  */
+            nb= (int)(n-q*b < b ? n-q*b : b);
+            if (nb > 0 && fastpairs(&fr,nb,ib,procb) != nb)
+                bsp_abort("Error: cannot read the distribution in %s\n",filename);
             for(k=q*b; k<(q+1)*b && k<n; k++){
-                // we're going to generate a random value here, because
-                // Mondriaan doesn't preserve nonzero values of vectors.
-                fscanf(fp,"%d %d\n", &i, &proc);
-                // generate a random vector nonzero.
-                allVals[k]=ran();
+                kb= k-q*b;
                 /* Convert index and processor number to ranges
                    0..n-1 and 0..p-1, assuming they were
                    1..n and 1..p */
-
-                i--;
-                proc--;
-                ind= Nv[proc];
+                i= ib[kb]-1;
+                proc= (int)(procb[kb]-1);
                 // the following ensures that vectors are sensibly-
                 // ordered
                 if(i!=k)
                     bsp_abort("Error: i not equal to index \n");
+                if(proc<0 || proc>=p)
+                    bsp_abort("Error: component %" GIDX " has no valid owner\n",i+1);
+                ind= Nv[proc];
 
                 bsp_put(i%p,&proc,tmpproc,(i/p)*SZINT,SZINT);
                 bsp_put(i%p,&ind,tmpind,(i/p)*SZINT,SZINT);
@@ -380,68 +874,525 @@ void bspinputvec(int p, int s, const char *filename,
         for (q=0; q<p; q++)
             bsp_put(q,&Nv[q],&nv,0,SZINT);
         vecfreei(Nv);
+        vecfreeg(procb); vecfreeg(ib);
+        fastclose(&fr);
+        if (zclose(&zf) != 0)
+            bsp_abort("Error: cannot decompress vector file %s\n",filename);
     }
     bsp_sync();
     /* Store the components at their final destination */
-    vindex= vecalloci(nv);
-    bsp_push_reg(vindex,nv*SZINT);
+    vindex= vecallocg(nv);
+    bsp_push_reg(vindex,nv*SZGIDX);
     bsp_sync();
 
-    for(k=0; k<np; k++){
-        globk= k*p+s;
-        bsp_put(tmpproc[k],&globk,vindex,tmpind[k]*SZINT,SZINT);
+    for(kb=0; kb<np; kb++){
+        globk= (gidx)kb*p+s;
+        bsp_put(tmpproc[kb],&globk,vindex,tmpind[kb]*SZGIDX,SZGIDX);
     }
     bsp_sync();
 
     bsp_pop_reg(vindex);
-
-    // we want:
-    // all procs know that proc %d owns (local) idx %d (=global vindex(..)),
-    // and stores it in remote idx (or, array offset) %d
-
+    bsp_pop_reg(tmpind);
+    bsp_pop_reg(tmpproc);
+    bsp_pop_reg(&nv);
+    bsp_pop_reg(&n);
+    bsp_sync();
     vecfreei(tmpind);
     vecfreei(tmpproc);
 
-    /* grab reals from P0 */
+    /* We generate random values, because Mondriaan doesn't preserve
+       the values of vectors. They are drawn by every processor for
+       its own components, and do not depend on the distribution. */
+    values= vecallocd(nv);
+    for(kb=0; kb<nv; kb++)
+        values[kb]= ranindex(VECSEED,vindex[kb]);
+
+    *pn= n;
+    *pnv= nv;
+    *pvindex= vindex;
+    *pvalues= values;
+
+} /* end bspinputvec */
+
+/*
+ * Skip the banner and comment lines at the top of a dense vector file,
+ * and read its length. Returns -1 if the file cannot be read.
+ */
+gidx readdenseheader(FILE *fp){
+
+    int c;
+    gidx n;
+
+    while ((c= fgetc(fp)) == '%'){
+        while (c != '\n' && c != EOF)
+            c= fgetc(fp);
+    }
+    if (c == EOF)
+        return -1;
+    ungetc(c,fp);
+
+    if (fscanf(fp,"%" SCNGIDX "\n", &n) != 1)
+        return -1;
+    return n;
+
+} /* end readdenseheader */
+
+int pwriteall(int fd, const char *buf, size_t len, off_t offset){
+
+    /* Write len bytes at offset, however many calls that takes.
+       Returns 0, or -1 on error. */
+
+    ssize_t done;
+
+    while (len > 0){
+        done= pwrite(fd,buf,len,offset);
+        if (done <= 0)
+            return -1;
+        buf += done; len -= done; offset += done;
+    }
+    return 0;
+
+} /* end pwriteall */
+
+int preadall(int fd, char *buf, size_t len, off_t offset){
+
+    /* Read len bytes at offset. Returns 0, or -1 on error or if
+       the file ends first. */
+
+    ssize_t done;
+
+    while (len > 0){
+        done= pread(fd,buf,len,offset);
+        if (done <= 0)
+            return -1;
+        buf += done; len -= done; offset += done;
+    }
+    return 0;
+
+} /* end preadall */
+
+int denseheader(char *hdr, gidx n, int format){
+
+    /* Write the header of a dense vector file in the given format
+       into hdr, which has room for DENSEHDRLEN bytes. Returns its
+       length, which is where the values start. */
+
+    int64_t n64;
+
+    if (format == DENSE_BINARY){
+        memcpy(hdr,DENSEMAGIC,8);
+        n64= n;
+        memcpy(hdr+8,&n64,sizeof(int64_t));
+        return 8+sizeof(int64_t);
+    }
+    return sprintf(hdr,"%s %d\n%" GIDX "\n",DENSETAG,DENSEWIDTH,n);
+
+} /* end denseheader */
+
+gidx densefileinfo(const char *filename, int *pformat, off_t *pstart){
+
+    /* Find the length of the dense vector in a file, and whether the
+       file was written by bspoutputdense, so that its values can be
+       read directly at fixed offsets.
+
+       Output:
+       format is DENSE_BINARY or DENSE_TEXT for such a file, and -1
+              for any other vector file, which has to be parsed
+              from the start.
+       start is where the values start, for DENSE_BINARY and DENSE_TEXT.
+
+       Returns the length, or -1 if the file cannot be read.
+    */
+
+    FILE *fp;
+    zfile zf;
+    char hdr[DENSEHDRLEN+1];
+    size_t len, taglen;
+    int64_t n64;
+    int width, used;
+    gidx n;
+
+    *pformat= -1;
+    *pstart= 0;
+    fp= fopen(filename,"rb");
+    if (fp==NULL)
+        return -1;
+    len= fread(hdr,1,DENSEHDRLEN,fp);
+    fclose(fp);
+    hdr[len]= '\0';
+
+    if (len >= 8+sizeof(int64_t) && memcmp(hdr,DENSEMAGIC,8) == 0){
+        memcpy(&n64,hdr+8,sizeof(int64_t));
+        if (n64 < 0 || n64 > GIDXMAX)
+            return -1;
+        *pformat= DENSE_BINARY;
+        *pstart= 8+sizeof(int64_t);
+        return (gidx)n64;
+    }
+
+    taglen= strlen(DENSETAG);
+    if (len > taglen && strncmp(hdr,DENSETAG,taglen) == 0 &&
+            sscanf(hdr+taglen," %d %" SCNGIDX "%n",&width,&n,&used) == 2 &&
+            width == DENSEWIDTH && hdr[taglen+used] == '\n'){
+        *pformat= DENSE_TEXT;
+        *pstart= taglen+used+1;
+        return n;
+    }
+
+    /* Any other vector file, possibly compressed */
+    fp= zopen(&zf,filename);
+    if (fp==NULL)
+        return -1;
+    n= readdenseheader(fp);
+    zclose(&zf);
+    return n;
+
+} /* end densefileinfo */
+
+void bspreaddenseblocks(int p, int s, const char *filename, gidx n, int nv,
+                        gidx *vindex, double *values, int format, off_t start){
+
+    /* This function reads a dense vector from a file written by
+       bspoutputdense, in parallel. The file holds fixed size records,
+       so processor s reads the block of components s*b..(s+1)*b-1
+       itself, where b = ceil(n/p), and every processor then gets its
+       own components from the block owners. All processors must be
+       able to open the file.
+
+       Input and output are as for bspinputdense; format and start are
+       as found by densefileinfo.
+    */
+
+    int b, nb, fd, k;
+    gidx lo;
+    size_t w;
+    char *buf;
+    const char *c, *e;
+    double *blk;
+
+    b= (int)(n%p==0 ? n/p : n/p+1);
+    lo= (gidx)s*b;
+    nb= (int)(n-lo < b ? n-lo : b);
+    if (nb < 0)
+        nb= 0;
+    blk= vecallocd(b);
+    bsp_push_reg(blk,b*SZDBL);
+
+    w= (format == DENSE_BINARY ? SZDBL : DENSEWIDTH);
+    if (nb > 0){
+        fd= open(filename,O_RDONLY);
+        if (fd < 0)
+            bsp_abort("Error: processor %d cannot open vector file %s\n",s,filename);
+        buf= (format == DENSE_BINARY ? (char*)blk : malloc((size_t)nb*w));
+        if (buf==NULL)
+            bsp_abort("bspreaddenseblocks: not enough memory");
+        if (preadall(fd,buf,nb*w,start+(off_t)lo*w) < 0)
+            bsp_abort("Error: vector file %s ends early\n",filename);
+        close(fd);
+
+        if (format == DENSE_TEXT){
+            for (k=0; k<nb; k++){
+                // the newline at the end of the record stops every scan
+                c= e= buf+k*w;
+                if (buf[k*w+w-1] == '\n'){
+                    while (*c == ' ')
+                        c++;
+                    blk[k]= fastatof(c,&e);
+                }
+                if (e == c)
+                    bsp_abort("Error: bad value %" GIDX " in vector file %s\n",lo+k+1,filename);
+            }
+            free(buf);
+        }
+    }
+    bsp_sync();
+
+    for(k=0; k<nv; k++)
+        bsp_get((int)(vindex[k]/b),blk,(vindex[k]%b)*SZDBL,&values[k],SZDBL);
+    bsp_sync();
+
+    bsp_pop_reg(blk);
+    bsp_sync();
+    vecfreed(blk);
+
+} /* end bspreaddenseblocks */
+
+void bspinputdense(int p, int s, const char *filename, gidx n, int nv,
+                   gidx *vindex, double *values){
+
+    /* This function reads the values of a dense vector from file, and
+       stores them on their owners according to an existing distribution.
+       The input consists of optional comment lines starting with %,
+       one line
+           n      (number of components)
+       followed by n lines with one value each, in order of the
+       global index.
+
+       Processor 0 puts the values into a cyclically distributed
+       directory, from which every processor then gets its own
+       components, so no processor needs to know the whole
+       distribution. Files written by bspoutputdense are instead read
+       by all processors in parallel, see bspreaddenseblocks.
 
-    // and also tell each other who owns what, and where.
-    // these metadata arrays facilitate this.
-    int* allowners = vecalloci(n);
-    int* alllocalindices = vecalloci(n);
+       Input:
+       p is the number of processors.
+       s is the processor number, 0 <= s < p.
+       n is the global length of the vector.
+       nv is the local length.
+       vindex[k] is the global index of the k'th local component,
+                 as returned by bspinputvec.
 
-    bsp_push_reg(allVals, n*SZDBL);
-    bsp_push_reg(allowners, n*SZINT);
-    bsp_push_reg(alllocalindices, n*SZINT);
+       Output:
+       values[k] is the value of the k'th local component, 0 <= k < nv.
+    */
+
+    int q, b, k, nb, np, format;
+    gidx nfile, kg;
+    long long info[2];
+    off_t start;
+    double *buf, *dir;
+    FILE *fp;
+    zfile zf;
+    fastreader fr;
+
+    /* Processor 0 finds out the format of the file */
+    info[0]= -1; info[1]= 0;
+    bsp_push_reg(info,2*sizeof(long long));
     bsp_sync();
-    double *values = vecallocd(nv);
-
-    for ( k = 0; k< nv; k++)
-    {
-        bsp_get(0, allVals, vindex[k]*SZDBL, &values[k], SZDBL);
-        for(i = 0; i<p; i++) {
-            // tell everyone about ownership of this value
-            bsp_put(i, &s, allowners, vindex[k]*SZINT, SZINT);
-            // and also mention where this processor stored that value
-            bsp_put(i, &k, alllocalindices, vindex[k]*SZINT, SZINT);
+    if (s==0){
+        nfile= densefileinfo(filename,&format,&start);
+        if (nfile < 0)
+            bsp_abort("Error: cannot read vector file %s\n",filename);
+        if (nfile!=n)
+            bsp_abort("Error: vector length %" GIDX " does not match n=%" GIDX "\n",nfile,n);
+        info[0]= format;
+        info[1]= start;
+        for (q=0; q<p; q++)
+            bsp_put(q,info,info,0,2*sizeof(long long));
+    }
+    bsp_sync();
+    bsp_pop_reg(info);
+    if (info[0] >= 0){
+        bspreaddenseblocks(p,s,filename,n,nv,vindex,values,(int)info[0],(off_t)info[1]);
+        return;
+    }
+
+    np= nloc(p,s,n);
+    dir= vecallocd(np);
+    bsp_push_reg(dir,np*SZDBL);
+    bsp_sync();
+
+    /* Handle n/p components at a time to save buffer memory */
+    b= (int)(n%p==0 ? n/p : n/p+1);
+
+    fp= NULL; buf= NULL;
+    if (s==0){
+        fp=zopen(&zf,filename);
+        if (fp==NULL)
+            bsp_abort("Error: cannot open vector file %s\n",filename);
+        nfile= readdenseheader(fp);
+        if (nfile!=n)
+            bsp_abort("Error: vector length %" GIDX " does not match n=%" GIDX "\n",nfile,n);
+        if (fastopen(&fr,fp) < 0)
+            bsp_abort("bspinputdense: not enough memory");
+        buf= vecallocd(b);
+    }
+
+    for (q=0; q<p; q++){
+        if (s==0){
+            nb= (int)(n-(gidx)q*b < b ? n-(gidx)q*b : b);
+            if (nb > 0 && fastvalues(&fr,nb,buf) != nb)
+                bsp_abort("Error: vector file %s ends early\n",filename);
+            for(k=0; k<nb; k++){
+                kg= (gidx)q*b+k;
+                bsp_put(kg%p,&buf[k],dir,(kg/p)*SZDBL,SZDBL);
+            }
         }
+        bsp_sync();
     }
+
+    for(k=0; k<nv; k++)
+        bsp_get((int)(vindex[k]%p),dir,(vindex[k]/p)*SZDBL,&values[k],SZDBL);
     bsp_sync();
-    bsp_pop_reg(allVals);
-    bsp_pop_reg(allowners);
-    bsp_pop_reg(alllocalindices);
+
+    if (s==0){
+        fastclose(&fr);
+        if (zclose(&zf) != 0)
+            bsp_abort("Error: cannot decompress vector file %s\n",filename);
+        vecfreed(buf);
+    }
+    bsp_pop_reg(dir);
     bsp_sync();
+    vecfreed(dir);
 
-    vecfreed(allVals);
+} /* end bspinputdense */
 
-    /* end value grabbing */
+void bspoutputdense(int p, int s, const char *filename, gidx n, int nv,
+                    gidx *vindex, double *values, int format){
 
-    *pn= n;
-    *pnv= nv;
-    *pvindex= vindex;
-    *pvalues= values;
+    /* This function writes a distributed dense vector to file, in
+       parallel. The components are first sent to a block distribution,
+       where processor q holds q*b..(q+1)*b-1 with b = ceil(n/p), so no
+       processor needs more than O(n/p) memory. Processor 0 creates the
+       file and writes the header, after which every processor writes
+       its own block at its offset. All processors must be able to open
+       the file.
 
-    // and the new stuff:
-    *owner= allowners;
-    *owneridx= alllocalindices;
+       format is DENSE_TEXT for a file in the format read by
+       bspinputdense, with every value in a record of DENSEWIDTH
+       characters so that the offsets are known, or DENSE_BINARY for
+       the raw doubles after a header (see denseheader). Either is read
+       back in parallel by bspinputdense.
 
-} /* end bspinputvec */
+       vindex[k] is the global index of the k'th local component,
+                 0 <= k < nv.
+       values[k] is its value.
+    */
+
+    int b, nb, fd, k;
+    gidx lo;
+    off_t start;
+    size_t w;
+    char hdr[DENSEHDRLEN], *buf;
+    double *blk;
+
+    b= (int)(n%p==0 ? n/p : n/p+1);
+    lo= (gidx)s*b;
+    nb= (int)(n-lo < b ? n-lo : b);
+    if (nb < 0)
+        nb= 0;
+    blk= vecallocd(b);
+    bsp_push_reg(blk,b*SZDBL);
+    bsp_sync();
+
+    for(k=0; k<nv; k++)
+        bsp_put((int)(vindex[k]/b),&values[k],blk,(vindex[k]%b)*SZDBL,SZDBL);
+
+    start= denseheader(hdr,n,format);
+    w= (format == DENSE_BINARY ? SZDBL : DENSEWIDTH);
+    if (s==0){
+        fd= open(filename,O_WRONLY|O_CREAT|O_TRUNC,0666);
+        if (fd < 0 || pwriteall(fd,hdr,start,0) < 0 ||
+                ftruncate(fd,start+(off_t)n*w) < 0)
+            bsp_abort("Error: cannot write vector file %s\n",filename);
+        close(fd);
+    }
+    bsp_sync();
+
+    if (nb > 0){
+        fd= open(filename,O_WRONLY);
+        if (fd < 0)
+            bsp_abort("Error: processor %d cannot open vector file %s\n",s,filename);
+        if (format == DENSE_BINARY){
+            buf= (char*)blk;
+        } else {
+            buf= malloc((size_t)nb*w+1);
+            if (buf==NULL)
+                bsp_abort("bspoutputdense: not enough memory");
+            for (k=0; k<nb; k++)
+                sprintf(buf+k*w,"%24.16e\n",blk[k]);
+        }
+        if (pwriteall(fd,buf,nb*w,start+(off_t)lo*w) < 0 || close(fd) < 0)
+            bsp_abort("Error: cannot write vector file %s\n",filename);
+        if (format != DENSE_BINARY)
+            free(buf);
+    }
+
+    bsp_pop_reg(blk);
+    bsp_sync();
+    vecfreed(blk);
+
+} /* end bspoutputdense */
+
+void bspinputvalues(int p, int s, const char *filename, int nz,
+                    double *values){
+
+    /* This function reads new numerical values for the nonzeros of a
+       matrix distributed by bspinput2triple, and gives every processor
+       the values of its own nonzeros, in the order they were read.
+       The input is in the format read by bspinputdense: optional
+       comment lines starting with %, one line
+           nzA    (total number of nonzeros)
+       followed by nzA lines with one value each, in the order of the
+       nonzeros in the matrix file that was read (for a distributed
+       file that is its own order, not that of the matrix before
+       partitioning).
+
+       Processor s simply gets the nz values after those of processors
+       0..s-1, which are Pstart[s]..Pstart[s+1]-1 of the file. This
+       relies on bspinput2triple, bspinput2triple_par and
+       bininput2triple giving every processor its nonzeros in file
+       order, which they do by putting each block at its offset. Do
+       not distribute them with bsp_send instead: BSPlib does not keep
+       messages in order, and the values would land on the wrong
+       nonzeros without any error.
+
+       Input:
+       p is the number of processors.
+       s is the processor number, 0 <= s < p.
+       nz is the local number of nonzeros.
+
+       Output:
+       values[k] is the new value of the k'th local nonzero, 0 <= k < nz,
+                 where k counts in the order of bspinput2triple.
+    */
+
+    int q, nzmax, *nzq;
+    gidx nzA, nfile;
+    double *buf;
+    FILE *fp;
+    zfile zf;
+    fastreader fr;
+
+    nzq= vecalloci(p);
+    bsp_push_reg(nzq,p*SZINT);
+    bsp_push_reg(values,nz*SZDBL);
+    bsp_sync();
+
+    bsp_put(0,&nz,nzq,s*SZINT,SZINT);
+    bsp_sync();
+
+    fp= NULL; buf= NULL;
+    if (s==0){
+        nzA= nzmax= 0;
+        for (q=0; q<p; q++){
+            nzA += nzq[q];
+            if (nzq[q] > nzmax)
+                nzmax= nzq[q];
+        }
+        fp=zopen(&zf,filename);
+        if (fp==NULL)
+            bsp_abort("Error: cannot open value file %s\n",filename);
+        nfile= readdenseheader(fp);
+        if (nfile!=nzA)
+            bsp_abort("Error: %" GIDX " values do not match nz=%" GIDX "\n",nfile,nzA);
+        if (fastopen(&fr,fp) < 0)
+            bsp_abort("bspinputvalues: not enough memory");
+        buf= vecallocd(nzmax);
+    }
+
+    /* Processor parts are stored one after the other, so each
+       processor gets a single contiguous block. One processor
+       at a time, to save buffer memory. */
+    for (q=0; q<p; q++){
+        if (s==0){
+            if (fastvalues(&fr,nzq[q],buf) != nzq[q])
+                bsp_abort("Error: value file %s ends early\n",filename);
+            if (nzq[q] > 0)
+                bsp_put(q,buf,values,0,nzq[q]*SZDBL);
+        }
+        bsp_sync();
+    }
+
+    if (s==0){
+        fastclose(&fr);
+        if (zclose(&zf) != 0)
+            bsp_abort("Error: cannot decompress value file %s\n",filename);
+        vecfreed(buf);
+    }
+    bsp_pop_reg(values);
+    bsp_pop_reg(nzq);
+    bsp_sync();
+    vecfreei(nzq);
+
+} /* end bspinputvalues */
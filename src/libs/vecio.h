@@ -1,15 +1,79 @@
+#include <stdio.h>
+#include <sys/types.h>
+#include <stdint.h>
+#include "parse.h"
+
+/* the distinct indices of the local nonzeros, see mapinit */
+typedef struct {
+    gidx lo;             /* smallest index */
+    int nwords;          /* words in the bitmap */
+    int count;           /* number of distinct indices */
+    uint64_t *bits;      /* bit i-lo is set for every index i present */
+    int *rank;           /* number of indices before each word */
+} indexmap;
+
+#define SORTROWMIN (32)  /* shorter rows are sorted by insertion */
+
 void bspinputvec(int p, int s, const char *filename,
-                 int *pn, int *pnv, int **pvindex,
-                 double **pvalues,
-                 int** owner, int **owneridx);
-void triple2icrs(int n, int nz, int *ia,  int *ja, double *a,
+                 gidx *pn, int *pnv, gidx **pvindex,
+                 double **pvalues);
+int popcount64(uint64_t x);
+void mapinit(indexmap *m, int nz, gidx *index);
+int maprank(indexmap *m, gidx i);
+void maplist(indexmap *m, gidx *list);
+void mapfree(indexmap *m);
+void sortrow(int ncols, int len, int *ja, double *a, int *scratch, double *ascratch);
+void triple2icrs(gidx n, int nz, gidx *ia, gidx *ja, double *a, int sortcols,
                  int *pnrows, int *pncols,
-                 int **prowindex, int **pcolindex);
-void bspinput2triple(char*filename, int p, int s, int *pnA, int *pnz, 
-                     int **pia, int **pja, double **pa);
+                 gidx **prowindex, gidx **pcolindex, int **pinc);
+void *readblock(void *arg);
+void readmatheader(FILE *fp, const char *filename, int p, gidx *pnA,
+                   gidx *pnzA, gidx *Pstart);
+void bspinput2triple(char*filename, int p, int s, gidx *pnA, int *pnz, 
+                     gidx **pia, gidx **pja, double **pa);
+int findoffsets(FILE *fp, off_t start, int p, gidx *Pstart, off_t *offset);
+int readindex(const char *filename, int p, off_t *offset);
+void writeindex(const char *filename, int p, off_t *offset);
+void bspinput2triple_par(char*filename, int p, int s, gidx *pnA, int *pnz,
+                         gidx **pia, gidx **pja, double **pa);
+gidx readdenseheader(FILE *fp);
+int pwriteall(int fd, const char *buf, size_t len, off_t offset);
+int preadall(int fd, char *buf, size_t len, off_t offset);
+int denseheader(char *hdr, gidx n, int format);
+gidx densefileinfo(const char *filename, int *pformat, off_t *pstart);
+void bspreaddenseblocks(int p, int s, const char *filename, gidx n, int nv,
+                        gidx *vindex, double *values, int format, off_t start);
+void bspinputdense(int p, int s, const char *filename, gidx n, int nv,
+                   gidx *vindex, double *values);
+void bspoutputdense(int p, int s, const char *filename, gidx n, int nv,
+                    gidx *vindex, double *values, int format);
+void bspinputvalues(int p, int s, const char *filename, int nz,
+                    double *values);
 
 typedef struct {int i,j;} indexpair;
 
+/* a block of nonzeros being read by bspinput2triple */
+typedef struct {
+    fastreader *fr;
+    long count, got;   /* nonzeros wanted, and read */
+    gidx *ia, *ja;
+    double *a;
+} tripleblock;
+
 #define STRLEN 100
-#define DIV 0
-#define MOD 1
+
+#define IOBUFSIZE (1<<20)  /* buffer size for scanning files */
+
+/* dense vector files written by bspoutputdense */
+#define DENSE_TEXT (0)     /* one value per line, in records of DENSEWIDTH bytes */
+#define DENSE_BINARY (1)   /* DENSEMAGIC, n as int64, then n doubles */
+#define DENSEWIDTH (25)    /* "%24.16e\n" */
+#define DENSETAG "% dense vector, fixed width"
+#define DENSEMAGIC "CGVECTOR"
+#define DENSEHDRLEN (128)
+
+/* how cgsetup reads the matrix */
+#define INPUT_SERIAL (0)   /* processor 0 reads, see bspinput2triple */
+#define INPUT_PARALLEL (1) /* every processor reads, see bspinput2triple_par */
+#define INPUT_BINARY (2)   /* binary container, see binio.h and cgsetupbin */
+#define INPUT_GENERATED (3) /* generated in memory, see matgen.h and cgsetupgen */
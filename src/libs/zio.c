@@ -0,0 +1,407 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "zio.h"
+
+/*
+ * Compressed file streams, see zio.h.
+ *
+ * The (de)compression thread and the caller are connected by a Unix
+ * socket pair rather than a pipe, so the thread can write with
+ * MSG_NOSIGNAL: a reader that closes its stream before the end of the
+ * file (bspinput2triple stops after the last nonzero) simply ends the
+ * thread, instead of killing the program with SIGPIPE.
+ */
+
+/*
+ * Kind of compression of an existing file, by its magic number.
+ * Returns -1 if the file cannot be opened.
+ */
+int zkind(const char *filename)
+{
+    unsigned char magic[4];
+    FILE *fp;
+    size_t n;
+
+    if ((fp = fopen(filename, "rb")) == NULL)
+        return -1;
+    n = fread(magic, 1, 4, fp);
+    fclose(fp);
+    if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+        return ZIO_GZIP;
+    if (n == 4 && magic[0] == 0x28 && magic[1] == 0xb5 &&
+            magic[2] == 0x2f && magic[3] == 0xfd)
+        return ZIO_ZSTD;
+    return ZIO_PLAIN;
+}
+
+/*
+ * Kind of compression for a new file, by its extension.
+ */
+int zkindname(const char *filename)
+{
+    size_t len;
+
+    len = strlen(filename);
+    if (len > 3 && strcmp(filename + len - 3, ".gz") == 0)
+        return ZIO_GZIP;
+    if (len > 4 && strcmp(filename + len - 4, ".zst") == 0)
+        return ZIO_ZSTD;
+    return ZIO_PLAIN;
+}
+
+/*
+ * Send n bytes to the socket. Returns -1 if the other end has gone.
+ */
+int zsendall(int fd, const char *buf, size_t n)
+{
+    ssize_t sent;
+
+    while (n > 0) {
+        sent = send(fd, buf, n, MSG_NOSIGNAL);
+        if (sent <= 0)
+            return -1;
+        buf += sent;
+        n -= sent;
+    }
+    return 0;
+}
+
+/*
+ * Decompression thread for gzip files.
+ */
+void *zgunzip(void *arg)
+{
+    zfile *z;
+    gzFile gz;
+    char *buf;
+    int n, gzerr;
+
+    z = arg;
+    buf = malloc(ZIOCHUNK);
+    gz = gzopen(z->filename, "rb");
+    if (buf == NULL || gz == NULL) {
+        z->error = 1;
+    } else {
+        gzbuffer(gz, ZIOCHUNK);
+        while ((n = gzread(gz, buf, ZIOCHUNK)) > 0)
+            if (zsendall(z->fd, buf, n) < 0)
+                break;   // the reader has stopped
+        // a truncated file only shows in gzerror
+        gzerror(gz, &gzerr);
+        if (n < 0 || (n == 0 && gzerr != Z_OK))
+            z->error = 1;
+    }
+    if (gz != NULL)
+        gzclose(gz);
+    free(buf);
+    close(z->fd);
+    return NULL;
+}
+
+/*
+ * Compression thread for gzip files. After an error the input is still
+ * drained, so the writer never blocks.
+ */
+void *zgzip(void *arg)
+{
+    zfile *z;
+    gzFile gz;
+    char *buf, mode[8];
+    ssize_t n;
+
+    z = arg;
+    snprintf(mode, sizeof(mode), "wb%d", z->level);
+    buf = malloc(ZIOCHUNK);
+    gz = gzopen(z->filename, mode);
+    if (buf == NULL || gz == NULL)
+        z->error = 1;
+    while (buf != NULL && (n = read(z->fd, buf, ZIOCHUNK)) > 0)
+        if (!z->error && gzwrite(gz, buf, n) != n)
+            z->error = 1;
+    if (gz != NULL && gzclose(gz) != Z_OK)
+        z->error = 1;
+    free(buf);
+    close(z->fd);
+    return NULL;
+}
+
+#ifdef HAVE_ZSTD
+
+/*
+ * Decompression thread for zstd files.
+ */
+void *zunzstd(void *arg)
+{
+    zfile *z;
+    FILE *in;
+    ZSTD_DStream *ds;
+    ZSTD_inBuffer ib;
+    ZSTD_outBuffer ob;
+    char *ibuf, *obuf;
+    size_t n, ret, isize, osize;
+    int gone;
+
+    z = arg;
+    isize = ZSTD_DStreamInSize();
+    osize = ZSTD_DStreamOutSize();
+    ibuf = malloc(isize);
+    obuf = malloc(osize);
+    in = fopen(z->filename, "rb");
+    ds = ZSTD_createDStream();
+    ret = 0;
+    gone = 0;
+    if (ibuf == NULL || obuf == NULL || in == NULL || ds == NULL) {
+        z->error = 1;
+    } else {
+        ZSTD_initDStream(ds);
+        while (!gone && !z->error && (n = fread(ibuf, 1, isize, in)) > 0) {
+            ib.src = ibuf; ib.size = n; ib.pos = 0;
+            while (ib.pos < ib.size) {
+                ob.dst = obuf; ob.size = osize; ob.pos = 0;
+                ret = ZSTD_decompressStream(ds, &ob, &ib);
+                if (ZSTD_isError(ret)) {
+                    z->error = 1;
+                    break;
+                }
+                if (zsendall(z->fd, obuf, ob.pos) < 0) {
+                    gone = 1;
+                    break;
+                }
+            }
+        }
+        // a complete frame ends with ret == 0
+        if (!gone && ret != 0)
+            z->error = 1;
+    }
+    if (ds != NULL)
+        ZSTD_freeDStream(ds);
+    if (in != NULL)
+        fclose(in);
+    free(ibuf);
+    free(obuf);
+    close(z->fd);
+    return NULL;
+}
+
+/*
+ * Compression thread for zstd files.
+ */
+void *zzstd(void *arg)
+{
+    zfile *z;
+    FILE *out;
+    ZSTD_CStream *cs;
+    ZSTD_inBuffer ib;
+    ZSTD_outBuffer ob;
+    char *ibuf, *obuf;
+    size_t ret, osize;
+    ssize_t n;
+
+    z = arg;
+    osize = ZSTD_CStreamOutSize();
+    ibuf = malloc(ZIOCHUNK);
+    obuf = malloc(osize);
+    out = fopen(z->filename, "wb");
+    cs = ZSTD_createCStream();
+    if (ibuf == NULL || obuf == NULL || out == NULL || cs == NULL ||
+            ZSTD_isError(ZSTD_initCStream(cs, z->level)))
+        z->error = 1;
+
+    while (ibuf != NULL && (n = read(z->fd, ibuf, ZIOCHUNK)) > 0) {
+        if (z->error)
+            continue;
+        ib.src = ibuf; ib.size = n; ib.pos = 0;
+        while (ib.pos < ib.size) {
+            ob.dst = obuf; ob.size = osize; ob.pos = 0;
+            ret = ZSTD_compressStream(cs, &ob, &ib);
+            if (ZSTD_isError(ret) || fwrite(obuf, 1, ob.pos, out) != ob.pos) {
+                z->error = 1;
+                break;
+            }
+        }
+    }
+    if (!z->error) {
+        do {
+            ob.dst = obuf; ob.size = osize; ob.pos = 0;
+            ret = ZSTD_endStream(cs, &ob);
+            if (ZSTD_isError(ret) || fwrite(obuf, 1, ob.pos, out) != ob.pos) {
+                z->error = 1;
+                break;
+            }
+        } while (ret > 0);
+    }
+    if (out != NULL && fclose(out) != 0)
+        z->error = 1;
+    if (cs != NULL)
+        ZSTD_freeCStream(cs);
+    free(ibuf);
+    free(obuf);
+    close(z->fd);
+    return NULL;
+}
+
+#else
+
+/*
+ * Without libzstd, run the zstd program with the file name quoted for
+ * the shell. When writing, first make sure the program is there, as
+ * writing to a pipe without a reader would raise SIGPIPE.
+ */
+FILE *zstdpipe(const char *filename, int writing, int level)
+{
+    char *cmd, *c;
+    const char *f;
+    FILE *fp;
+
+    if (writing && system("zstd -V >/dev/null 2>&1") != 0)
+        return NULL;
+    cmd = malloc(4*strlen(filename) + 64);
+    if (cmd == NULL)
+        return NULL;
+    if (writing)
+        c = cmd + sprintf(cmd, "zstd -q -f -%d - -o '", level);
+    else
+        c = cmd + sprintf(cmd, "zstd -dcq -- '");
+    for (f = filename; *f; f++) {
+        if (*f == '\'') {
+            strcpy(c, "'\\''");
+            c += 4;
+        } else {
+            *c++ = *f;
+        }
+    }
+    strcpy(c, "'");
+    fp = popen(cmd, writing ? "w" : "r");
+    free(cmd);
+    return fp;
+}
+
+#endif
+
+/*
+ * Start the thread of a compressed stream, connected to fp by a
+ * socket pair. Returns fp, or NULL on failure.
+ */
+FILE *zstart(zfile *z, void *(*work)(void *))
+{
+    int sv[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+        return NULL;
+    z->fd = sv[1];
+    z->fp = fdopen(sv[0], z->writing ? "w" : "r");
+    if (z->fp == NULL) {
+        close(sv[0]);
+        close(sv[1]);
+        return NULL;
+    }
+    if (pthread_create(&z->thread, NULL, work, z) != 0) {
+        fclose(z->fp);
+        close(sv[1]);
+        z->fp = NULL;
+        return NULL;
+    }
+    z->running = 1;
+    return z->fp;
+}
+
+/*
+ * Open a file for reading as plain text, whether it is compressed or
+ * not. Returns NULL if it cannot be opened.
+ */
+FILE *zopen(zfile *z, const char *filename)
+{
+    memset(z, 0, sizeof(zfile));
+    z->kind = zkind(filename);
+    if (z->kind < 0)
+        return NULL;
+    if (z->kind == ZIO_PLAIN) {
+        z->fp = fopen(filename, "r");
+        return z->fp;
+    }
+
+    z->filename = strdup(filename);
+    if (z->filename == NULL)
+        return NULL;
+#ifdef HAVE_ZSTD
+    return zstart(z, z->kind == ZIO_GZIP ? zgunzip : zunzstd);
+#else
+    if (z->kind == ZIO_ZSTD) {
+        z->piped = 1;
+        z->fp = zstdpipe(filename, 0, 0);
+        return z->fp;
+    }
+    return zstart(z, zgunzip);
+#endif
+}
+
+/*
+ * Create a file for writing plain text, compressed if its name ends in
+ * .gz or .zst. Returns NULL if it cannot be created.
+ */
+FILE *zcreate(zfile *z, const char *filename, int level)
+{
+    memset(z, 0, sizeof(zfile));
+    z->writing = 1;
+    z->level = level;
+    z->kind = zkindname(filename);
+    if (z->kind == ZIO_PLAIN) {
+        z->fp = fopen(filename, "w");
+        return z->fp;
+    }
+
+    z->filename = strdup(filename);
+    if (z->filename == NULL)
+        return NULL;
+#ifdef HAVE_ZSTD
+    return zstart(z, z->kind == ZIO_GZIP ? zgzip : zzstd);
+#else
+    if (z->kind == ZIO_ZSTD) {
+        z->piped = 1;
+        z->fp = zstdpipe(filename, 1, level);
+        return z->fp;
+    }
+    return zstart(z, zgzip);
+#endif
+}
+
+/*
+ * Close a stream from zopen or zcreate, and wait for its thread.
+ * Returns 0, or -1 if anything went wrong, including (for a written
+ * file) compression.
+ */
+int zclose(zfile *z)
+{
+    int err, status, ended;
+
+    if (z->fp == NULL)
+        return -1;
+    err = 0;
+    if (z->piped) {
+        // a reader that stops early makes zstd fail on a broken pipe
+        ended = feof(z->fp);
+        status = pclose(z->fp);
+        if ((z->writing || ended) && status != 0)
+            err = 1;
+    } else {
+        if (fclose(z->fp) != 0)
+            err = 1;
+    }
+    if (z->running) {
+        pthread_join(z->thread, NULL);
+        z->running = 0;
+    }
+    if (z->error)
+        err = 1;
+    free(z->filename);
+    z->filename = NULL;
+    z->fp = NULL;
+    return (err ? -1 : 0);
+}
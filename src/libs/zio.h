@@ -0,0 +1,48 @@
+#ifndef __ZIO
+#define __ZIO
+
+#include <stdio.h>
+#include <pthread.h>
+
+/*
+ * Transparent reading and writing of compressed text files.
+ *
+ * zopen opens a file for reading and recognises gzip and zstd files by
+ * their magic number. For a compressed file it starts a thread that
+ * decompresses into one end of a socket pair, and returns a FILE on the
+ * other end, so the readers (fscanf, fastreader) see plain text and the
+ * decompression overlaps with parsing. zcreate does the same the other
+ * way around, compressing according to the extension .gz or .zst.
+ *
+ * gzip uses zlib. zstd uses libzstd if compiled with -DHAVE_ZSTD, or
+ * otherwise the zstd program, which then runs as a separate process.
+ */
+
+#define ZIO_PLAIN (0)
+#define ZIO_GZIP  (1)
+#define ZIO_ZSTD  (2)
+
+#define ZIOCHUNK (1<<17)   /* bytes (de)compressed at a time */
+#define ZIOLEVEL (6)       /* default compression level */
+
+typedef struct {
+    FILE *fp;            /* the plain text stream */
+    int kind;            /* ZIO_PLAIN, ZIO_GZIP or ZIO_ZSTD */
+    int writing;
+    int level;           /* compression level, when writing */
+    char *filename;      /* the compressed file */
+    int fd;              /* the thread's end of the socket pair */
+    int piped;           /* is fp a pipe to or from the zstd program? */
+    pthread_t thread;
+    int running;
+    int error;           /* did (de)compression fail? */
+} zfile;
+
+int zkind(const char *filename);
+int zkindname(const char *filename);
+int zsendall(int fd, const char *buf, size_t n);
+FILE *zopen(zfile *z, const char *filename);
+FILE *zcreate(zfile *z, const char *filename, int level);
+int zclose(zfile *z);
+
+#endif
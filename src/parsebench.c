@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "libs/parse.h"
+
+/*
+ * Measure how fast the nonzeros of a distributed matrix in EMM format
+ * (as written by Mondriaan, and read by cg) are parsed: with fscanf, as
+ * cg used to, and with the parser of libs/parse.c on one and on several
+ * threads. The results of both parsers are compared bit for bit.
+ *
+ * Usage: parsebench matrix-P [threads]
+ */
+
+void die(const char *msg, const char *filename) {
+    fprintf(stderr, "parsebench: %s %s\n", msg, filename);
+    exit(2);
+}
+
+double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+/*
+ * Parse the nonzeros with the fast parser on nthreads threads.
+ * Returns the time taken.
+ */
+double timefast(FILE *fp, off_t start, int nthreads, long nz,
+                gidx *ia, gidx *ja, double *a, const char *filename) {
+    fastreader fr;
+    double t0;
+
+    fseeko(fp, start, SEEK_SET);
+    t0 = now();
+    if (fastopen(&fr, fp) < 0)
+        die("out of memory reading", filename);
+    fr.nthreads = nthreads;
+    if (fasttriples(&fr, nz, ia, ja, a) != nz)
+        die("cannot read all nonzeros from", filename);
+    fastclose(&fr);
+    return now() - t0;
+}
+
+int main(int argc, char **argv) {
+
+    FILE *fp;
+    struct stat st;
+    off_t start;
+    long nz, k;
+    int p, q, c, nthreads;
+    gidx m, n, nzA, pstart, *ia, *ja, *ia2, *ja2;
+    double *a, *a2, mb, t, t1, tn;
+    char *buf;
+
+    if (argc < 2 || argc > 3) {
+        printf("Usage: %s matrix-P [threads]\n", argv[0]);
+        printf("\tcompares the speed of fscanf and of the fast parser on the nonzeros\n");
+        printf("\tof a distributed matrix. The number of threads defaults to\n");
+        printf("\tCG_THREADS, or else to the number of processors.\n");
+        exit(-1);
+    }
+    if (argc == 3)
+        nthreads = atoi(argv[2]);
+    else if (getenv("CG_THREADS") != NULL)
+        nthreads = parsethreads();
+    else
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads < 1)
+        nthreads = 1;
+    if (nthreads > PARSEMAXTHREADS)
+        nthreads = PARSEMAXTHREADS;
+
+    if ((fp = fopen(argv[1], "r")) == NULL)
+        die("cannot open", argv[1]);
+    while ((c = fgetc(fp)) != '\n' && c != EOF)
+        ;
+    if (fscanf(fp, "%" SCNGIDX " %" SCNGIDX " %" SCNGIDX " %d\n", &m, &n, &nzA, &p) != 4)
+        die("cannot read the header of", argv[1]);
+    for (q = 0; q <= p; q++)
+        if (fscanf(fp, "%" SCNGIDX "\n", &pstart) != 1)
+            die("cannot read Pstart from", argv[1]);
+    nz = nzA;
+    start = ftello(fp);
+    fstat(fileno(fp), &st);
+    mb = (st.st_size - start) / 1e6;
+
+    ia = malloc(nz*SZGIDX); ja = malloc(nz*SZGIDX);
+    ia2 = malloc(nz*SZGIDX); ja2 = malloc(nz*SZGIDX);
+    a = malloc(nz*sizeof(double)); a2 = malloc(nz*sizeof(double));
+    buf = malloc(PARSECHUNK);
+    if (ia == NULL || ja == NULL || ia2 == NULL || ja2 == NULL ||
+            a == NULL || a2 == NULL || buf == NULL)
+        die("out of memory reading", argv[1]);
+
+    // read the file once, so that all timings see it in the page cache
+    fseeko(fp, start, SEEK_SET);
+    while (fread(buf, 1, PARSECHUNK, fp) > 0)
+        ;
+    free(buf);
+
+    fseeko(fp, start, SEEK_SET);
+    t = now();
+    for (k = 0; k < nz; k++)
+        if (fscanf(fp, "%" SCNGIDX " %" SCNGIDX " %lf\n", &ia[k], &ja[k], &a[k]) != 3)
+            die("cannot read all nonzeros from", argv[1]);
+    t = now() - t;
+
+    t1 = timefast(fp, start, 1, nz, ia2, ja2, a2, argv[1]);
+    if (memcmp(ia, ia2, nz*SZGIDX) != 0 || memcmp(ja, ja2, nz*SZGIDX) != 0 ||
+            memcmp(a, a2, nz*sizeof(double)) != 0)
+        die("the parsers disagree on", argv[1]);
+    tn = timefast(fp, start, nthreads, nz, ia2, ja2, a2, argv[1]);
+    if (memcmp(ia, ia2, nz*SZGIDX) != 0 || memcmp(ja, ja2, nz*SZGIDX) != 0 ||
+            memcmp(a, a2, nz*sizeof(double)) != 0)
+        die("the threaded parser disagrees on", argv[1]);
+    fclose(fp);
+
+    printf("%s: %ld nonzeros, %.1f MB\n", argv[1], nz, mb);
+    printf("fscanf             %8.3f s %9.1f MB/s\n", t, mb/t);
+    printf("fast, 1 thread     %8.3f s %9.1f MB/s  (%.1fx)\n", t1, mb/t1, t/t1);
+    printf("fast, %2d threads   %8.3f s %9.1f MB/s  (%.1fx)\n", nthreads, tn, mb/tn, t/tn);
+
+    free(ia); free(ja); free(a);
+    free(ia2); free(ja2); free(a2);
+    return 0;
+}
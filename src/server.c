@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "libs/bspedupack.h"
+#include "libs/vecio.h"
+#include "libs/paullib.h"
+#include "libs/parse.h"
+#include "libs/zio.h"
+#include "libs/bspfuncs.h"
+#include "libs/debug.h"
+#include "server.h"
+
+/*
+ * Resident solver: the matrix is read and distributed once, after
+ * which solve requests are taken from a Unix domain socket until a
+ * client asks us to quit.
+ *
+ * Requests are lines of text, one reply line is written per request:
+ *
+ *   solve RHSFILE SOLFILE [GUESSFILE]
+ *                     -> ok ITERS SOLVETIME TOTALTIME RESIDUAL
+ *   update VALFILE    -> ok TOTALTIME
+ *   quit              -> bye
+ *
+ * RHSFILE, SOLFILE and GUESSFILE are dense vector files as read by
+ * bspinputdense. SOLFILE is written by all processors in parallel, so
+ * like GUESSFILE it must be reachable by all of them.
+ * The optional GUESSFILE is used as starting vector, so the previous
+ * solution of a slowly changing sequence of systems can be passed back
+ * in.
+ *
+ * VALFILE holds new values for all nonzeros of the matrix, in the order
+ * of the original matrix file (see bspinputvalues). The sparsity pattern
+ * and distribution stay the same, so none of the setup is redone. The
+ * request is refused when that order is not known: for a generated or
+ * partitioned matrix, and once rows have been moved by -b or -a.
+ *
+ * Only processor 0 talks to the socket; it broadcasts every request to
+ * the other processors, which then take part in the solve.
+ *
+ * Example client:
+ *
+ * $ echo "solve rhs.vec sol.vec" | nc -U /tmp/cg.sock
+ */
+
+/*
+ * Create a listening socket bound to the given path.
+ */
+int opensocket(const char *socketname)
+{
+    int fd;
+    struct sockaddr_un addr;
+
+    if (strlen(socketname) >= sizeof(addr.sun_path))
+        return -1;
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socketname);
+    unlink(socketname);
+
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+            listen(fd, 4) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Processor 0 only: wait for the next request line, accepting a new
+ * client connection whenever the current one has been closed.
+ */
+void nextrequest(int lsock, int *conn, FILE **in, char *line)
+{
+    char *nl;
+
+    while (1) {
+        if (*in == NULL) {
+            if ((*conn = accept(lsock, NULL, NULL)) < 0) {
+                strcpy(line, "quit");
+                return;
+            }
+            *in = fdopen(*conn, "r");
+        }
+        if (fgets(line, REQLEN, *in) != NULL) {
+            if ((nl = strchr(line, '\n')) != NULL)
+                *nl = '\0';
+            return;
+        }
+        // client hung up, wait for the next one.
+        fclose(*in);
+        *in = NULL;
+        *conn = -1;
+    }
+}
+
+/*
+ * Processor 0 only: send a reply line to the client. The write fails
+ * rather than raising SIGPIPE if the client has gone, and the
+ * connection is then dropped, so that the next request comes from a
+ * new client instead of taking the server down.
+ */
+void reply(int *conn, FILE **in, const char *fmt, ...)
+{
+    char buf[REQLEN+STRLEN];
+    va_list ap;
+    int len;
+
+    if (*in == NULL)
+        return;
+    va_start(ap, fmt);
+    len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (len > (int)sizeof(buf) - 1)
+        len = sizeof(buf) - 1;
+    if (zsendall(*conn, buf, len) < 0) {
+        fclose(*in);
+        *in = NULL;
+        *conn = -1;
+    }
+}
+
+/*
+ * Processor 0 only: check a vector file before the other processors
+ * start reading it, so that a bad request doesn't abort the server:
+ * it must hold n values, and all of them must parse. Only processor 0
+ * looks at it, so a file the others cannot reach still aborts.
+ */
+bool validvec(const char *filename, gidx n)
+{
+    int format;
+    off_t start;
+    gidx k;
+    long m;
+    double *buf;
+    struct stat st;
+    FILE *fp;
+    zfile zf;
+    fastreader fr;
+
+    if (densefileinfo(filename, &format, &start) != n)
+        return false;
+    if (format == DENSE_BINARY)
+        return stat(filename, &st) == 0 &&
+               st.st_size >= start + (off_t)n*SZDBL;
+
+    if ((fp = zopen(&zf, filename)) == NULL)
+        return false;
+    readdenseheader(fp);
+    if (fastopen(&fr, fp) < 0) {
+        zclose(&zf);
+        return false;
+    }
+    buf = vecallocd(CHECKLEN);
+    for (k = 0; k < n; k += m) {
+        m = (n - k < CHECKLEN ? n - k : CHECKLEN);
+        if (fastvalues(&fr, m, buf) != m)
+            break;
+    }
+    vecfreed(buf);
+    fastclose(&fr);
+    return (zclose(&zf) == 0 && k >= n);
+}
+
+/*
+ * Processor 0 only: check that a vector file can be written, creating
+ * it if it does not exist yet.
+ */
+bool validout(const char *filename)
+{
+    int fd;
+
+    if ((fd = open(filename, O_WRONLY|O_CREAT, 0666)) < 0)
+        return false;
+    close(fd);
+    return true;
+}
+
+void cgserve(cgsolver *cg, const char *socketname)
+{
+    int p, s, q, lsock, conn, done, nargs;
+    gidx nztotal;
+    char request[REQLEN], line[REQLEN], cmd[STRLEN],
+         rhsfile[STRLEN], solfile[STRLEN], guessfile[STRLEN];
+    double *b, *x, *values, time0, time1, nzsum;
+    FILE *in;
+    cgstats stats;
+
+    p = cg->p; s = cg->s;
+
+    lsock = -1; conn = -1; in = NULL;
+    if (s==0) {
+        if ((lsock = opensocket(socketname)) < 0)
+            bsp_abort("Error: cannot listen on socket %s\n", socketname);
+        printf("Listening for solve requests on %s\n", socketname);
+        fflush(stdout);
+    }
+
+    b = vecallocd(cg->nu);
+    x = vecallocd(cg->nv);
+    values = vecallocd(cg->nz);
+    nzsum = cg->nz;
+    bspreduce(p, s, 1, &nzsum);
+    nztotal = nzsum;
+    bsp_push_reg(request, REQLEN);
+    bsp_sync();
+
+    done = 0;
+    while (!done) {
+        if (s==0) {
+            nextrequest(lsock, &conn, &in, line);
+            HERE("Got request: %s\n", line);
+
+            // weed out requests that would make the others abort.
+            nargs = sscanf(line, "solve %99s %99s %99s", rhsfile, solfile, guessfile);
+            if (nargs >= 2 && !validvec(rhsfile, cg->n)) {
+                reply(&conn, &in, "error cannot read a vector of length %" GIDX " from %s\n",
+                      cg->n, rhsfile);
+                strcpy(line, "skip");
+            } else if (nargs == 3 && !validvec(guessfile, cg->n)) {
+                reply(&conn, &in, "error cannot read a vector of length %" GIDX " from %s\n",
+                      cg->n, guessfile);
+                strcpy(line, "skip");
+            } else if (nargs >= 2 && !validout(solfile)) {
+                reply(&conn, &in, "error cannot write %s\n", solfile);
+                strcpy(line, "skip");
+            } else if (sscanf(line, "update %99s", rhsfile) == 1 &&
+                       cg->perm == NULL) {
+                reply(&conn, &in, "error the nonzeros are not in the order of a value file\n");
+                strcpy(line, "skip");
+            } else if (sscanf(line, "update %99s", rhsfile) == 1 &&
+                       !validvec(rhsfile, nztotal)) {
+                reply(&conn, &in, "error cannot read %" GIDX " matrix values from %s\n",
+                      nztotal, rhsfile);
+                strcpy(line, "skip");
+            }
+            for (q=0; q<p; q++)
+                bsp_put(q, line, request, 0, REQLEN);
+        }
+        bsp_sync();
+        time0 = bsp_time();
+
+        cmd[0] = '\0';
+        sscanf(request, "%99s", cmd);
+
+        nargs = sscanf(request, "solve %99s %99s %99s", rhsfile, solfile, guessfile);
+        if (strcmp(cmd, "solve") == 0 && nargs >= 2) {
+            bspinputdense(p, s, rhsfile, cg->n, cg->nu, cg->uindex, b);
+            if (nargs == 3)
+                bspinputdense(p, s, guessfile, cg->n, cg->nv, cg->vindex, x);
+            bspsolve(cg, b, (nargs == 3 ? x : NULL), x, &stats);
+            bspoutputdense(p, s, solfile, cg->n, cg->nv, cg->vindex, x, DENSE_TEXT);
+            time1 = bsp_time();
+            if (s==0) {
+                reply(&conn, &in, "ok %d %.6lf %.6lf %e\n", stats.iters,
+                      stats.time, time1-time0, stats.residual);
+                printf("Request \"%s\": %d CG iterations took %.6lf seconds, %.6lf seconds in total.\n",
+                       request, stats.iters, stats.time, time1-time0);
+                fflush(stdout);
+            }
+        } else if (strcmp(cmd, "update") == 0 &&
+                   sscanf(request, "update %99s", rhsfile) == 1) {
+            bspinputvalues(p, s, rhsfile, cg->nz, values);
+            cgupdate(cg, values);
+            bsp_sync();
+            time1 = bsp_time();
+            if (s==0) {
+                reply(&conn, &in, "ok %.6lf\n", time1-time0);
+                printf("Request \"%s\": matrix update took %.6lf seconds.\n",
+                       request, time1-time0);
+                fflush(stdout);
+            }
+        } else if (strcmp(cmd, "quit") == 0) {
+            if (s==0)
+                reply(&conn, &in, "bye\n");
+            done = 1;
+        } else if (strcmp(cmd, "skip") != 0) {
+            if (s==0)
+                reply(&conn, &in, "error unknown request: %s\n", request);
+        }
+    }
+
+    bsp_pop_reg(request);
+    bsp_sync();
+
+    if (s==0) {
+        if (in != NULL)
+            fclose(in);
+        close(lsock);
+        unlink(socketname);
+    }
+    vecfreed(values);
+    vecfreed(x);
+    vecfreed(b);
+
+} /* end cgserve */
@@ -0,0 +1,6 @@
+#include "libs/cgsolver.h"
+
+#define REQLEN (3*STRLEN)
+#define CHECKLEN (4096)   /* values per chunk when checking a vector file */
+
+void cgserve(cgsolver *cg, const char *socketname);